@@ -0,0 +1,41 @@
+#!/bin/sh
+# 多 reactor 扩展性测试：reactor 数从 1 扫到 N，每一档分别测
+#   echo    长连接回显吞吐（msgs/s）
+#   connect 短连接建连速率（conns/s）
+#
+# 用法: ./bench.sh [max_reactors] [port] [seconds]
+# 环境变量 CLIENT_THREADS / CONNS / SIZE 调整负载；默认 max_reactors = CPU 数。
+# 客户端和服务器在同一台机器上会抢 CPU，可以用 SERVER_CPUS / CLIENT_CPUS
+# （taskset -c 的格式）把两边分到不同的核上。
+
+set -e
+cd "$(dirname "$0")"
+
+NCPU=$(getconf _NPROCESSORS_ONLN)
+MAX=${1:-$NCPU}
+PORT=${2:-9090}
+SECS=${3:-5}
+CLIENT_THREADS=${CLIENT_THREADS:-$NCPU}
+CONNS=${CONNS:-64}
+SIZE=${SIZE:-64}
+SERVER_CPUS=${SERVER_CPUS:-0-$((NCPU - 1))}
+CLIENT_CPUS=${CLIENT_CPUS:-0-$((NCPU - 1))}
+
+make -s all
+
+printf "%-9s %-60s\n" reactors result
+t=1
+while [ "$t" -le "$MAX" ]; do
+    taskset -c "$SERVER_CPUS" ./epoll_server -q -t "$t" "$PORT" > /dev/null &
+    srv=$!
+    sleep 0.3
+
+    echo_res=$(taskset -c "$CLIENT_CPUS" ./loadgen -m echo -t "$CLIENT_THREADS" -c "$CONNS" -s "$SIZE" -d "$SECS" 127.0.0.1 "$PORT" || true)
+    conn_res=$(taskset -c "$CLIENT_CPUS" ./loadgen -m connect -t "$CLIENT_THREADS" -d "$SECS" 127.0.0.1 "$PORT" || true)
+    printf "%-9s %s\n" "$t" "$echo_res"
+    printf "%-9s %s\n" "$t" "$conn_res"
+
+    kill -INT "$srv"
+    wait "$srv" || true
+    t=$((t + 1))
+done
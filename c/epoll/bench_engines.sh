@@ -0,0 +1,47 @@
+#!/bin/sh
+# epoll 与 io_uring 两个引擎对比：同样的回显负载，分别在 1K 和 50K 并发连接下测
+# msgs/s，并用服务端退出时打印的计数算出每条消息摊到的系统调用数。
+#
+# 用法: ./bench_engines.sh [port] [seconds]
+# 环境变量：CONN_COUNTS（默认 "1000 50000"）、SIZE（默认 64）、CLIENT_THREADS（默认 4）、REACTORS（默认 1）
+#
+# 5 万连接需要：服务端和客户端各约 5 万个 fd（ulimit -Hn），
+# 以及足够的本地端口：sysctl -w net.ipv4.ip_local_port_range="1024 65535"
+
+set -e
+cd "$(dirname "$0")"
+
+PORT=${1:-9090}
+SECS=${2:-5}
+CONN_COUNTS=${CONN_COUNTS:-"1000 50000"}
+SIZE=${SIZE:-64}
+CLIENT_THREADS=${CLIENT_THREADS:-4}
+REACTORS=${REACTORS:-1}
+
+make -s all
+ulimit -n "$(ulimit -Hn)" 2>/dev/null || true
+
+printf "%-6s %7s %12s %12s %14s\n" engine conns msgs/s syscalls sys/msg
+for conns in $CONN_COUNTS; do
+    if [ $((conns + 100)) -gt "$(ulimit -n)" ]; then
+        echo "skip $conns conns: fd limit is $(ulimit -n)" >&2
+        continue
+    fi
+    per_thread=$(( (conns + CLIENT_THREADS - 1) / CLIENT_THREADS ))
+    for engine in epoll uring; do
+        ./epoll_server -q -e "$engine" -t "$REACTORS" -c $((conns + 1024)) "$PORT" > /tmp/bench_engines.$$ &
+        srv=$!
+        sleep 0.3
+
+        res=$(./loadgen -m echo -t "$CLIENT_THREADS" -c "$per_thread" -s "$SIZE" -d "$SECS" 127.0.0.1 "$PORT" || true)
+        kill -INT "$srv"
+        wait "$srv" || true
+
+        msgs=$(echo "$res" | sed -n 's/.*msgs=\([0-9]*\).*/\1/p')
+        rate=$(echo "$res" | sed -n 's/.* \([0-9]*\) msgs\/s.*/\1/p')
+        sys=$(awk '$1 == "total" { print $NF }' /tmp/bench_engines.$$)
+        printf "%-6s %7s %12s %12s %14s\n" "$engine" "$conns" "$rate" "$sys" \
+            "$(awk -v s="$sys" -v m="$msgs" 'BEGIN { if (m > 0) printf "%.3f", s / m; else print "-" }')"
+    done
+done
+rm -f /tmp/bench_engines.$$
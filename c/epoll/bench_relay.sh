@@ -0,0 +1,60 @@
+#!/bin/sh
+# 转发路径对比：read/write（经用户态缓冲区）与 splice（经每连接的管道，数据不进用户态），
+# 消息大小 64KB 到 1MB。拓扑：loadgen -> 转发服务 (port) -> 回显服务 (port+1)，
+# 另外也测直接回显时两种路径的差别（此时转发服务不参与）。
+#
+# 用法: ./bench_relay.sh [port] [seconds]
+# 环境变量：SIZES（默认 "65536 262144 1048576"）、CONNS（默认 8）、CLIENT_THREADS（默认 1）
+
+set -e
+cd "$(dirname "$0")"
+
+PORT=${1:-9090}
+SECS=${2:-5}
+SIZES=${SIZES:-"65536 262144 1048576"}
+CONNS=${CONNS:-8}
+CLIENT_THREADS=${CLIENT_THREADS:-1}
+UP=$((PORT + 1))
+
+make -s all
+
+# $1 = 服务端参数，$2 = 连接的端口，$3 = 消息大小；输出 MB/s 和被测服务每 MB 的系统调用数（不含上游）
+run() {
+    ./epoll_server -q $1 "$PORT" > /tmp/bench_relay.$$ &
+    srv=$!
+    sleep 0.3
+    res=$(./loadgen -m echo -t "$CLIENT_THREADS" -c "$CONNS" -s "$3" -d "$SECS" 127.0.0.1 "$2" || true)
+    kill -INT "$srv"
+    wait "$srv" || true
+    mbps=$(echo "$res" | sed -n 's/.* \([0-9.]*\) MB\/s.*/\1/p')
+    msgs=$(echo "$res" | sed -n 's/.*msgs=\([0-9]*\).*/\1/p')
+    sys=$(awk '$1 == "total" { print $NF }' /tmp/bench_relay.$$)
+    printf "%10s %8s %10s %12s\n" "$mbps" "$msgs" "$sys" \
+        "$(awk -v s="$sys" -v m="$msgs" -v z="$3" 'BEGIN { if (m > 0) printf "%.1f", s / (m * z / 1048576); else print "-" }')"
+}
+
+printf "%-14s %8s %10s %8s %10s %12s\n" mode size MB/s msgs syscalls sys/MB
+for size in $SIZES; do
+    for mode in echo-rw echo-splice relay-rw relay-splice; do
+        case $mode in
+        echo-rw)      args="" ;;
+        echo-splice)  args="-z" ;;
+        relay-rw)     args="-u 127.0.0.1:$UP" ;;
+        relay-splice) args="-z -u 127.0.0.1:$UP" ;;
+        esac
+        up=""
+        if [ "${mode#relay}" != "$mode" ]; then
+            # 上游固定用 splice 回显，两种转发路径面对同一个上游
+            ./epoll_server -q -z "$UP" > /dev/null &
+            up=$!
+            sleep 0.2
+        fi
+        printf "%-14s %8s " "$mode" "$size"
+        run "$args" "$PORT" "$size"
+        if [ -n "$up" ]; then
+            kill -INT "$up"
+            wait "$up" || true
+        fi
+    done
+done
+rm -f /tmp/bench_relay.$$
@@ -0,0 +1,63 @@
+#!/bin/sh
+# 回显服务的场景压测，每次改服务器都可以跑一遍对比：
+#   small        64 字节，每连接 1 条在途（闭环）
+#   small-pipe   64 字节，每连接 16 条在途（流水线）
+#   small-open   64 字节，开环固定速率 RATE，延迟从计划发送时间算起
+#   large        LARGE 字节的大消息（默认 1000000，分帧时不超过服务器 1MB 的请求上限）
+#   churn        每条连接 10 个请求后重连；connect：每次 1 字节往返就 RST 关闭
+#   slow-base    4KB 消息，开环 RATE/4，作为下一项的基线
+#   slow         同上，另加每线程 SLOW 个慢读连接（约 400KB/s），看正常连接的延迟是否被拖累
+# 每项输出吞吐、延迟分位数和服务器每个请求的系统调用数。
+#
+# 用法: ./bench_scenarios.sh [port] [seconds]
+# 环境变量：FRAMING（len / line：服务器和客户端都加 -f）、SERVER_ARGS（服务器的其它参数）、
+#           CLIENT_THREADS（默认 1）、RATE（默认 50000）、SLOW（默认 16）、LARGE（默认 1000000）
+
+set -e
+cd "$(dirname "$0")"
+
+PORT=${1:-9090}
+SECS=${2:-5}
+CLIENT_THREADS=${CLIENT_THREADS:-1}
+RATE=${RATE:-50000}
+SLOW=${SLOW:-16}
+LARGE=${LARGE:-1000000}
+SERVER_ARGS=${SERVER_ARGS:-}
+FRAMING=${FRAMING:-}
+FRAME_ARGS=""
+[ -n "$FRAMING" ] && FRAME_ARGS="-f $FRAMING"
+
+make -s all
+
+# $1 = 场景名，其余是 loadgen 参数
+run() {
+    name=$1
+    shift
+    ./epoll_server -q $SERVER_ARGS $FRAME_ARGS "$PORT" > /tmp/bench_scenarios.$$ &
+    srv=$!
+    sleep 0.3
+    res=$(./loadgen -t "$CLIENT_THREADS" -d "$SECS" "$@" 127.0.0.1 "$PORT" || true)
+    kill -INT "$srv"
+    wait "$srv" || true
+
+    rate=$(echo "$res" | sed -n 's/.* \([0-9]*\) \(msgs\|conns\)\/s.*/\1/p')
+    msgs=$(echo "$res" | sed -n 's/.*msgs=\([0-9]*\).*/\1/p')
+    [ -z "$msgs" ] && msgs=$(awk -v r="$rate" -v s="$SECS" 'BEGIN { print r * s }')
+    p50=$(echo "$res" | sed -n 's/.*p50=\([0-9.]*\)us.*/\1/p')
+    p99=$(echo "$res" | sed -n 's/.*p99=\([0-9.]*\)us.*/\1/p')
+    p999=$(echo "$res" | sed -n 's/.*p99\.9=\([0-9.]*\)us.*/\1/p')
+    sys=$(awk '$1 == "total" { print $NF }' /tmp/bench_scenarios.$$)
+    printf "%-11s %12s %10s %10s %10s %9s\n" "$name" "$rate" "${p50:--}" "${p99:--}" "${p999:--}" \
+        "$(awk -v s="$sys" -v m="$msgs" 'BEGIN { if (m > 0) printf "%.2f", s / m; else print "-" }')"
+}
+
+printf "%-11s %12s %10s %10s %10s %9s\n" scenario "req/s" "p50(us)" "p99(us)" "p99.9(us)" "sys/req"
+run small      -m echo -c 64 -s 64 $FRAME_ARGS
+run small-pipe -m echo -c 16 -s 64 -p 16 $FRAME_ARGS
+run small-open -m echo -c 64 -s 64 -p 64 -r "$RATE" $FRAME_ARGS
+run large      -m echo -c 8 -s "$LARGE" $FRAME_ARGS
+run churn      -m echo -c 64 -s 64 -n 10 $FRAME_ARGS
+[ -z "$FRAMING" ] && run connect -m connect
+run slow-base  -m echo -c 64 -s 4096 -p 64 -r $((RATE / 4)) $FRAME_ARGS
+run slow       -m echo -c 64 -s 4096 -p 64 -r $((RATE / 4)) -S "$SLOW" $FRAME_ARGS
+rm -f /tmp/bench_scenarios.$$
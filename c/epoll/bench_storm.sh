@@ -0,0 +1,38 @@
+#!/bin/sh
+# 建连风暴：比较两种多 reactor 的 accept 方式
+#   reuseport  每个 reactor 一个 SO_REUSEPORT 监听套接字（默认）
+#   shared     所有 reactor 共用一个监听套接字，epoll 里加 EPOLLEXCLUSIVE（-s）
+# 客户端用 loadgen -m storm，每个线程同时保持 INFLIGHT 个非阻塞 connect。
+#
+# 用法: ./bench_storm.sh [reactors] [port] [seconds]
+# 环境变量：CLIENT_THREADS（默认 CPU 数）、INFLIGHT（默认 256）、ENGINE（epoll / uring，默认 epoll）
+
+set -e
+cd "$(dirname "$0")"
+
+NCPU=$(getconf _NPROCESSORS_ONLN)
+REACTORS=${1:-$NCPU}
+PORT=${2:-9090}
+SECS=${3:-5}
+CLIENT_THREADS=${CLIENT_THREADS:-$NCPU}
+INFLIGHT=${INFLIGHT:-256}
+ENGINE=${ENGINE:-epoll}
+
+make -s all
+
+for mode in reuseport shared; do
+    flag=""
+    [ "$mode" = shared ] && flag="-s"
+    ./epoll_server -q -e "$ENGINE" -t "$REACTORS" $flag "$PORT" > /tmp/bench_storm.$$ &
+    srv=$!
+    sleep 0.3
+
+    res=$(./loadgen -m storm -t "$CLIENT_THREADS" -c "$INFLIGHT" -d "$SECS" 127.0.0.1 "$PORT" || true)
+    kill -INT "$srv"
+    wait "$srv" || true
+
+    # 每个 reactor 接了多少连接，看负载是否均匀
+    spread=$(awk '$1 ~ /^[0-9]+$/ { printf "%s%s", sep, $3; sep = "/" }' /tmp/bench_storm.$$)
+    printf "%-10s %s  accepted per reactor: %s\n" "$mode" "$res" "$spread"
+done
+rm -f /tmp/bench_storm.$$
@@ -0,0 +1,46 @@
+#!/bin/sh
+# 工作线程池：CPU 密集的 HASH 请求在事件循环里执行（-w 0）和交给工作线程（-w N）对比。
+# 每种配置先测空载时 PING 的延迟，再在后台压 HASH 的同时测 PING 的延迟（开环，延迟从计划发送时间算起），
+# 看重活会不会把其它请求的 IO 延迟拖上去；同时报 HASH 自己的吞吐。
+#
+# 用法: ./bench_workers.sh [port] [seconds] [workers]
+# 环境变量：FRAMING（默认 len）、PING_RATE（默认 2000）、HASH_CONNS（默认 16）、HASH_DEPTH（默认 4）
+
+set -e
+cd "$(dirname "$0")"
+
+PORT=${1:-9090}
+SECS=${2:-5}
+WORKERS=${3:-2}
+FRAMING=${FRAMING:-len}
+PING_RATE=${PING_RATE:-2000}
+HASH_CONNS=${HASH_CONNS:-16}
+HASH_DEPTH=${HASH_DEPTH:-4}
+
+make -s all
+
+ping_p() {
+    ./loadgen -f "$FRAMING" -o ping -c 8 -p 16 -r "$PING_RATE" -d "$1" 127.0.0.1 "$PORT" | sed -n 's/.*latency[^:]*: //p'
+}
+
+printf "%-8s %-10s %s\n" workers load "PING latency / HASH throughput"
+for w in 0 "$WORKERS"; do
+    wargs=""
+    [ "$w" -gt 0 ] && wargs="-w $w"
+    ./epoll_server -q -f "$FRAMING" $wargs "$PORT" > /dev/null &
+    srv=$!
+    sleep 0.3
+
+    printf "%-8s %-10s %s\n" "$w" idle "$(ping_p "$SECS")"
+    ./loadgen -f "$FRAMING" -o hash -c "$HASH_CONNS" -p "$HASH_DEPTH" -d $((SECS + 2)) 127.0.0.1 "$PORT" \
+        > /tmp/bench_workers.$$ &
+    hash=$!
+    sleep 1
+    printf "%-8s %-10s %s\n" "$w" "hash" "$(ping_p "$SECS")"
+    wait "$hash" || true
+    printf "%-8s %-10s %s\n" "$w" "" "HASH $(sed -n 's/.* \([0-9]*\) msgs\/s.*/\1/p' /tmp/bench_workers.$$) req/s"
+
+    kill -INT "$srv"
+    wait "$srv" || true
+done
+rm -f /tmp/bench_workers.$$
@@ -0,0 +1,293 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "buf.h"
+
+// 全局池：空闲块单链表，只有线程缓存空了或满了才来这里，一次搬 IOBUF_BATCH 块
+static pthread_mutex_t g_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static iobuf_t *g_pool;
+static size_t g_pool_count;
+
+static size_t g_allocated;
+static size_t g_peak;
+
+// 每线程缓存：LIFO，刚还回来的块 cache 里还是热的，下一次 get 先拿到它
+static __thread iobuf_t *t_cache;
+static __thread size_t t_cache_count;
+
+static iobuf_t *iobuf_alloc(void) {
+    iobuf_t *b = aligned_alloc(64, sizeof(iobuf_t));
+
+    if (b == NULL) return NULL;
+    size_t n = __atomic_add_fetch(&g_allocated, 1, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&g_peak, __ATOMIC_RELAXED);
+    while (n > peak && !__atomic_compare_exchange_n(&g_peak, &peak, n, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    return b;
+}
+
+static void iobuf_free_list(iobuf_t *b) {
+    while (b) {
+        iobuf_t *next = b->next;
+        free(b);
+        __atomic_sub_fetch(&g_allocated, 1, __ATOMIC_RELAXED);
+        b = next;
+    }
+}
+
+// 本线程缓存空了：从全局池批量取一批
+static void iobuf_cache_refill(void) {
+    pthread_mutex_lock(&g_pool_lock);
+    for (int i = 0; i < IOBUF_BATCH && g_pool; i++) {
+        iobuf_t *b = g_pool;
+        g_pool = b->next;
+        g_pool_count--;
+        b->next = t_cache;
+        t_cache = b;
+        t_cache_count++;
+    }
+    pthread_mutex_unlock(&g_pool_lock);
+}
+
+iobuf_t *iobuf_get(void) {
+    if (t_cache == NULL) iobuf_cache_refill();
+
+    iobuf_t *b = t_cache;
+    if (b) {
+        t_cache = b->next;
+        t_cache_count--;
+    } else if ((b = iobuf_alloc()) == NULL) {
+        return NULL;
+    }
+    b->next = NULL;
+    b->start = b->end = 0;
+    return b;
+}
+
+// 把本线程缓存最前面的 n 块还给全局池；全局池超过 IOBUF_POOL_KEEP 的部分在锁外 free
+static void iobuf_cache_spill(size_t n) {
+    iobuf_t *first = t_cache, *last = NULL, *excess = NULL;
+    size_t moved = 0;
+
+    for (iobuf_t *b = t_cache; b && moved < n; b = b->next) {
+        last = b;
+        moved++;
+    }
+    if (moved == 0) return;
+    t_cache = last->next;
+    t_cache_count -= moved;
+
+    pthread_mutex_lock(&g_pool_lock);
+    last->next = g_pool;
+    g_pool = first;
+    g_pool_count += moved;
+    while (g_pool_count > IOBUF_POOL_KEEP) {
+        iobuf_t *b = g_pool;
+        g_pool = b->next;
+        g_pool_count--;
+        b->next = excess;
+        excess = b;
+    }
+    pthread_mutex_unlock(&g_pool_lock);
+    iobuf_free_list(excess);
+}
+
+void iobuf_put(iobuf_t *b) {
+    b->next = t_cache;
+    t_cache = b;
+    if (++t_cache_count > IOBUF_CACHE_MAX) iobuf_cache_spill(IOBUF_BATCH);
+}
+
+void iobuf_thread_release(void) {
+    iobuf_cache_spill(t_cache_count);
+}
+
+void iobuf_pool_destroy(void) {
+    iobuf_free_list(t_cache);
+    t_cache = NULL;
+    t_cache_count = 0;
+
+    pthread_mutex_lock(&g_pool_lock);
+    iobuf_t *b = g_pool;
+    g_pool = NULL;
+    g_pool_count = 0;
+    pthread_mutex_unlock(&g_pool_lock);
+    iobuf_free_list(b);
+}
+
+size_t iobuf_allocated(void) {
+    return __atomic_load_n(&g_allocated, __ATOMIC_RELAXED);
+}
+
+size_t iobuf_peak(void) {
+    return __atomic_load_n(&g_peak, __ATOMIC_RELAXED);
+}
+
+static void iochain_push(iochain_t *ch, iobuf_t *b) {
+    if (ch->tail) ch->tail->next = b;
+    else ch->head = b;
+    ch->tail = b;
+}
+
+int iochain_append(iochain_t *ch, const char *data, size_t len) {
+    iobuf_t *b = ch->tail;
+
+    while (len > 0) {
+        if (b == NULL || b->end == IOBUF_SIZE) {
+            b = iobuf_get();
+            if (b == NULL) return -1;
+            iochain_push(ch, b);
+        }
+        size_t n = IOBUF_SIZE - b->end;
+        if (n > len) n = len;
+        memcpy(b->data + b->end, data, n);
+        b->end += n;
+        ch->bytes += n;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+void iochain_move(iochain_t *dst, iochain_t *src) {
+    iobuf_t *t = dst->tail;
+
+    if (src->head == NULL) return;
+    // 放得进 dst 尾块的剩余空间就拷过去：慢读的连接上一连串小消息不会各占一整块
+    if (t && src->bytes <= IOBUF_SIZE - t->end) {
+        for (iobuf_t *b = src->head; b; b = b->next) {
+            memcpy(t->data + t->end, b->data + b->start, b->end - b->start);
+            t->end += b->end - b->start;
+        }
+        dst->bytes += src->bytes;
+        iochain_clear(src);
+        return;
+    }
+    iochain_push(dst, src->head);
+    dst->tail = src->tail;
+    dst->bytes += src->bytes;
+    iochain_init(src);
+}
+
+void iochain_consume(iochain_t *ch, size_t n) {
+    ch->bytes -= n;
+    // 用完的块还回池里，最后一块只用掉一部分时只前移 start
+    while (n > 0) {
+        iobuf_t *b = ch->head;
+        size_t left = b->end - b->start;
+        if (n < left) {
+            b->start += n;
+            break;
+        }
+        n -= left;
+        ch->head = b->next;
+        iobuf_put(b);
+    }
+    if (ch->head == NULL) ch->tail = NULL;
+}
+
+void iochain_clear(iochain_t *ch) {
+    while (ch->head) {
+        iobuf_t *b = ch->head;
+        ch->head = b->next;
+        iobuf_put(b);
+    }
+    iochain_init(ch);
+}
+
+void iochain_copy(const iochain_t *ch, char *dst, size_t len) {
+    for (iobuf_t *b = ch->head; b && len > 0; b = b->next) {
+        size_t n = b->end - b->start;
+        if (n > len) n = len;
+        memcpy(dst, b->data + b->start, n);
+        dst += n;
+        len -= n;
+    }
+}
+
+ssize_t iochain_find(const iochain_t *ch, char c, size_t from, size_t max) {
+    size_t off = 0;
+
+    if (from >= max) return -1;
+    for (iobuf_t *b = ch->head; b && off < max; b = b->next) {
+        size_t n = b->end - b->start;
+        if (off + n > from) {
+            size_t skip = from > off ? from - off : 0;
+            size_t k = n - skip;
+            if (k > max - off - skip) k = max - off - skip;
+            const char *base = b->data + b->start + skip;
+            const char *p = memchr(base, c, k);
+            if (p) return (ssize_t)(off + skip + (size_t)(p - base));
+        }
+        off += n;
+    }
+    return -1;
+}
+
+int iochain_iov(const iochain_t *ch, struct iovec *iov, int max) {
+    int cnt = 0;
+
+    for (iobuf_t *b = ch->head; b && cnt < max; b = b->next) {
+        iov[cnt].iov_base = b->data + b->start;
+        iov[cnt].iov_len = b->end - b->start;
+        cnt++;
+    }
+    return cnt;
+}
+
+ssize_t iochain_readv(iochain_t *ch, int fd, int nbufs) {
+    struct iovec iov[IOBUF_READV_MAX + 1];
+    iobuf_t *fresh[IOBUF_READV_MAX];
+    iobuf_t *t = ch->tail;
+    int cnt = 0, nfresh = 0;
+
+    if (nbufs > IOBUF_READV_MAX) nbufs = IOBUF_READV_MAX;
+    // 尾块还有空间就先填它，小消息不会每次都占一整块新的
+    if (t && t->end < IOBUF_SIZE) {
+        iov[cnt].iov_base = t->data + t->end;
+        iov[cnt].iov_len = IOBUF_SIZE - t->end;
+        cnt++;
+    }
+    while (nfresh < nbufs) {
+        iobuf_t *b = iobuf_get();
+        if (b == NULL) break;
+        fresh[nfresh++] = b;
+        iov[cnt].iov_base = b->data;
+        iov[cnt].iov_len = IOBUF_SIZE;
+        cnt++;
+    }
+    if (cnt == 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    ssize_t n;
+    do {
+        n = readv(fd, iov, cnt);
+    } while (n == -1 && errno == EINTR);
+    int saved_errno = errno;
+
+    size_t left = n > 0 ? (size_t)n : 0;
+    ch->bytes += left;
+    if (t && t->end < IOBUF_SIZE) {
+        size_t k = IOBUF_SIZE - t->end;
+        if (k > left) k = left;
+        t->end += k;
+        left -= k;
+    }
+    // 用上的新块挂到链表尾部，没用上的还回池里
+    for (int i = 0; i < nfresh; i++) {
+        iobuf_t *b = fresh[i];
+        if (left == 0) {
+            iobuf_put(b);
+            continue;
+        }
+        b->end = left < IOBUF_SIZE ? (uint32_t)left : IOBUF_SIZE;
+        left -= b->end;
+        iochain_push(ch, b);
+    }
+    errno = saved_errno;
+    return n;
+}
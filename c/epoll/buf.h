@@ -0,0 +1,81 @@
+#ifndef BUF_H
+#define BUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// IO 缓冲池：所有线程共用一个全局空闲链表（加锁），每个线程前面再挂一个无锁的小缓存，
+// 取还缓冲块通常只是本线程缓存上的一次压栈/出栈，只有缓存空了或满了才成批和全局池交换。
+// 连接只在有数据在途时才持有缓冲块，发完就还回池里，内存随在途字节数增长，而不是随连接数。
+
+#define IOBUF_SIZE 16384      // 每块的数据区大小
+#define IOBUF_CACHE_MAX 128   // 每线程缓存上限（2MB），超出就把 IOBUF_BATCH 块还给全局池
+#define IOBUF_BATCH 32        // 线程缓存和全局池之间一次搬多少块
+#define IOBUF_POOL_KEEP 4096  // 全局池最多留多少空闲块（64MB），再多的直接 free 还给系统
+#define IOBUF_READV_MAX 8     // iochain_readv 一次最多新取多少块
+
+// 缓冲块；[start, end) 是有效数据，end 之后是空闲空间
+typedef struct iobuf {
+    struct iobuf *next;
+    uint32_t start;
+    uint32_t end;
+    char data[IOBUF_SIZE];
+} iobuf_t;
+
+// 缓冲块单链表，连接的输入、输出各一条
+typedef struct iochain {
+    iobuf_t *head;
+    iobuf_t *tail;
+    size_t bytes;   // 链表里有效数据的总字节数
+} iochain_t;
+
+// 取一块空的缓冲块（start = end = 0），内存不足返回 NULL
+iobuf_t *iobuf_get(void);
+
+// 还回本线程缓存
+void iobuf_put(iobuf_t *b);
+
+// 把本线程缓存全部还给全局池，线程退出前调用
+void iobuf_thread_release(void);
+
+// 释放全局池和调用线程缓存里的所有空闲块；其它线程须已退出
+void iobuf_pool_destroy(void);
+
+// 当前从系统分配着的块数（在用 + 池里空闲）和历史峰值
+size_t iobuf_allocated(void);
+size_t iobuf_peak(void);
+
+static inline void iochain_init(iochain_t *ch) {
+    ch->head = ch->tail = NULL;
+    ch->bytes = 0;
+}
+
+// 把 data 拷到链表尾部（先填满尾块的剩余空间），内存不足返回 -1
+int iochain_append(iochain_t *ch, const char *data, size_t len);
+
+// 把 src 的所有块整块挂到 dst 尾部，不拷贝数据；src 变为空。
+// 例外：src 放得进 dst 尾块的剩余空间时直接拷过去，避免一串小消息各占一整块
+void iochain_move(iochain_t *dst, iochain_t *src);
+
+// 从头部丢掉 n 个字节，用完的块还回池里
+void iochain_consume(iochain_t *ch, size_t n);
+
+// 丢弃整条链表
+void iochain_clear(iochain_t *ch);
+
+// 把头部的 len 个字节拷到 dst（不消费），调用方保证 len <= ch->bytes
+void iochain_copy(const iochain_t *ch, char *dst, size_t len);
+
+// 在偏移 [from, max) 里找字节 c，返回偏移，找不到返回 -1
+ssize_t iochain_find(const iochain_t *ch, char c, size_t from, size_t max);
+
+// 从头部起最多 max 块填进 iov，返回个数
+int iochain_iov(const iochain_t *ch, struct iovec *iov, int max);
+
+// readv 到尾块的剩余空间加上最多 nbufs 块新缓冲块，读到的块挂到链表尾部，没用上的还回池里。
+// 返回值和 errno 同 readv；一块也取不到时返回 -1，errno = ENOMEM
+ssize_t iochain_readv(iochain_t *ch, int fd, int nbufs);
+
+#endif
@@ -0,0 +1,124 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "conn.h"
+#include "reactor.h"
+
+int conn_queue(conn_t *c, const char *data, size_t len) {
+    return iochain_append(&c->out, data, len);
+}
+
+int conn_flush(conn_t *c) {
+    while (c->out.head) {
+        struct iovec iov[FLUSH_IOV_MAX];
+        int cnt = iochain_iov(&c->out, iov, FLUSH_IOV_MAX);
+
+        ssize_t w = writev(c->fd, iov, cnt);
+        t_syscalls++;
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN ? 0 : -1;
+        }
+        iochain_consume(&c->out, w); // 发完的块还回池里，部分发出的块只前移 start
+    }
+    return 1;
+}
+
+void conn_drop_output(conn_t *c) {
+    iochain_clear(&c->out);
+}
+
+int conn_open_pipe(conn_t *c, int size) {
+    int fds[2];
+
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == -1) return -1;
+    t_syscalls++;
+    // 管道越大，每次 splice 搬得越多；超过 pipe-max-size 或用户的管道页配额时保持默认大小
+    fcntl(fds[1], F_SETPIPE_SZ, size);
+    int cap = fcntl(fds[1], F_GETPIPE_SZ);
+    t_syscalls += 2;
+    c->pipe_r = fds[0];
+    c->pipe_w = fds[1];
+    c->pipe_cap = cap > 0 ? (uint32_t)cap : 65536;
+    c->pipe_bytes = 0;
+    return 0;
+}
+
+int conn_slab_init(conn_slab_t *s, uint32_t cap) {
+    if (cap == 0 || cap > CONN_MAX_CAPACITY) return -1;
+    // 匿名映射按页对齐且清零，槽位天然 64 字节对齐；页面第一次写时才真正分配
+    void *mem = mmap(NULL, (size_t)cap * sizeof(conn_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return -1;
+    s->conns = mem;
+    s->cap = cap;
+    s->fresh = 0;
+    s->free_head = CONN_NONE;
+    s->used = 0;
+    return 0;
+}
+
+void conn_slab_destroy(conn_slab_t *s) {
+    if (s->conns == NULL) return;
+    for (uint32_t i = 0; i < s->fresh; i++) {
+        conn_t *c = &s->conns[i];
+        if (c->fd == -1) continue;
+        close(c->fd);
+        conn_free(s, c);
+    }
+    munmap(s->conns, (size_t)s->cap * sizeof(conn_t));
+    s->conns = NULL;
+}
+
+conn_t *conn_alloc(conn_slab_t *s, int fd) {
+    conn_t *c;
+
+    if (s->free_head != CONN_NONE) {
+        c = &s->conns[s->free_head];
+        s->free_head = c->next_free;
+    } else if (s->fresh < s->cap) {
+        c = &s->conns[s->fresh];
+        c->idx = s->fresh++;
+    } else {
+        return NULL;
+    }
+
+    // gen 和 idx 保留，其它字段清零
+    c->fd = fd;
+    c->events = 0;
+    c->next_free = CONN_NONE;
+    c->read_paused = 0;
+    c->eof = 0;
+    iochain_init(&c->in);
+    iochain_init(&c->out);
+    c->flush_pending = 0;
+    c->offloaded = 0;
+    c->frame_scan = 0;
+    c->seen_data = 0;
+    c->connecting = 0;
+    c->fwd_done = 0;
+    c->peer = NULL;
+    c->pipe_r = c->pipe_w = -1;
+    c->pipe_bytes = c->pipe_cap = 0;
+    s->used++;
+    return c;
+}
+
+void conn_free(conn_slab_t *s, conn_t *c) {
+    iochain_clear(&c->in);
+    conn_drop_output(c);
+    if (c->pipe_r != -1) {
+        close(c->pipe_r);
+        close(c->pipe_w);
+        c->pipe_r = c->pipe_w = -1;
+    }
+    c->fd = -1;
+    c->gen++;
+    c->next_free = s->free_head;
+    s->free_head = c->idx;
+    s->used--;
+}
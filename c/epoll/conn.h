@@ -0,0 +1,92 @@
+#ifndef CONN_H
+#define CONN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "buf.h"
+#include "timer.h"
+
+#define OUT_HIGH_WATER (256 * 1024) // 待发送超过这个值就暂停读，把压力反压回客户端
+#define OUT_LOW_WATER (64 * 1024)   // 回落到这个值以下再恢复读
+#define FLUSH_IOV_MAX 64            // 一次 writev 最多带多少个缓冲块
+#define READ_IOV_BUFS 4             // 一次 readv 最多新取多少个缓冲块（64KB）
+#define SPLICE_PIPE_SIZE (256 * 1024) // 零拷贝模式下每个连接的管道容量（设置失败就用默认的 64KB）
+
+// 每个连接的状态，占三条 cache line，放在预分配的 conn_slab_t 里；accept 时从空闲链表取一个
+typedef struct conn {
+    int fd;              // -1 表示空闲
+    uint32_t gen;        // 槽位每释放一次加 1，用来识别过期事件
+    uint32_t idx;        // 在 slab 里的下标
+    uint32_t events;     // 当前在 epoll 里注册的事件
+    uint32_t next_free;  // 空闲时：空闲链表的下一个
+    int read_paused;     // 输出积压到高水位，暂停读
+    int eof;             // 对端已关闭写方向，发完剩余数据就关闭
+    uint32_t frame_scan; // 分帧模式：输入链表里已经找过、没有换行的字节数
+    iochain_t in;        // 读到还没处理的数据；缓冲块来自共享池，处理完立即还回
+    iochain_t out;       // 待发送的数据，发完的块立即还回池里，空闲连接不占缓冲块
+    // 几个标志用 uint8_t，连接状态保持在三条 cache line 里
+    uint8_t seen_data;   // 收到过数据：超时从读超时切换到空闲超时
+    uint8_t connecting;  // 转发模式下到上游的非阻塞 connect 还没完成
+    uint8_t fwd_done;    // 转发模式：本方向已读到 EOF 并已 shutdown 对端的写方向
+    uint8_t flush_pending; // 分帧模式：本轮有新回复，已登记到 reactor 的待发送列表，本轮末尾统一 writev
+    uint8_t offloaded;   // 分帧模式：有一个请求在工作线程里，回复回来之前不处理后面的请求、不再读
+    struct conn *peer;   // 转发模式下的另一端（客户端 <-> 上游），回显时为 NULL
+    int pipe_r;          // 零拷贝模式：本连接读到的数据先 splice 进这个管道，再 splice 给目标；-1 表示还没建
+    int pipe_w;
+    uint32_t pipe_bytes; // 管道里还没送出去的字节数
+    uint32_t pipe_cap;
+    int64_t last_active; // 最后一次读写的时间（微秒，reactor 每轮取一次时间）
+    tmr_t timer;         // 嵌在连接里的超时定时器，挂在 reactor 的时间轮上
+} __attribute__((aligned(64))) conn_t;
+
+#define CONN_NONE UINT32_MAX
+#define CONN_MAX_CAPACITY (UINT32_MAX - 16) // 更大的下标留给监听/唤醒等特殊 token
+
+// 固定容量的连接表。内存一次 mmap 出来，按需触及（先用从未分配过的槽位，再复用空闲链表），
+// 不用的部分不占物理内存。
+typedef struct conn_slab {
+    conn_t *conns;
+    uint32_t cap;
+    uint32_t fresh;      // [fresh, cap) 从未分配过
+    uint32_t free_head;  // 已释放槽位组成的 LIFO 链表，刚释放的槽位 cache 里还是热的
+    uint32_t used;
+} conn_slab_t;
+
+int conn_slab_init(conn_slab_t *s, uint32_t cap);
+
+// 关闭所有仍在使用的连接并释放整张表
+void conn_slab_destroy(conn_slab_t *s);
+
+// 为 fd 分配一个连接，表满返回 NULL
+conn_t *conn_alloc(conn_slab_t *s, int fd);
+
+// 释放输入/输出链表、关闭管道并归还槽位（不关闭 fd）；gen 加 1，之前发出的 token 全部失效
+void conn_free(conn_slab_t *s, conn_t *c);
+
+// epoll_event.data.u64 里存的是 token：高 32 位 gen，低 32 位下标
+static inline uint64_t conn_token(const conn_t *c) {
+    return (uint64_t)c->gen << 32 | c->idx;
+}
+
+// token 对应的连接；槽位已释放或已被别的连接复用（gen 不符）时返回 NULL
+static inline conn_t *conn_lookup(conn_slab_t *s, uint64_t token) {
+    uint32_t idx = (uint32_t)token;
+
+    if (idx >= s->cap) return NULL;
+    conn_t *c = &s->conns[idx];
+    return (c->gen == (uint32_t)(token >> 32) && c->fd != -1) ? c : NULL;
+}
+
+// 把 data 拷到输出链表尾部，内存不足返回 -1
+int conn_queue(conn_t *c, const char *data, size_t len);
+
+// 用 writev 尽量发送输出链表：全部发完返回 1，内核缓冲区满（EAGAIN）返回 0，出错返回 -1
+int conn_flush(conn_t *c);
+
+// 丢弃并释放输出链表
+void conn_drop_output(conn_t *c);
+
+// 为零拷贝模式建非阻塞管道（第一次有数据时才建，空闲连接不占管道），尽量把容量设为 size。失败返回 -1
+int conn_open_pipe(conn_t *c, int size);
+
+#endif
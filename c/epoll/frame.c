@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <string.h>
+#include "frame.h"
+
+static void cmd_ping(const char *arg, size_t len, frame_reply_t *reply) {
+    (void)arg;
+    (void)len;
+    reply->data = "PONG";
+    reply->len = 4;
+}
+
+static void cmd_echo(const char *arg, size_t len, frame_reply_t *reply) {
+    reply->data = arg;
+    reply->len = len;
+}
+
+// CPU 密集的示例命令：参数反复做 FRAME_HASH_ROUNDS 轮 FNV-1a，回复 16 位十六进制的结果
+static void cmd_hash(const char *arg, size_t len, frame_reply_t *reply) {
+    uint64_t h = 14695981039346656037ULL;
+
+    for (int r = 0; r < FRAME_HASH_ROUNDS; r++) {
+        for (size_t i = 0; i < len; i++) {
+            h ^= (unsigned char)arg[i];
+            h *= 1099511628211ULL;
+        }
+    }
+    snprintf(reply->buf, sizeof(reply->buf), "%016llx", (unsigned long long)h);
+    reply->data = reply->buf;
+    reply->len = 16;
+}
+
+// 处理函数表：新命令加在这里，两种分帧方式共用
+static const frame_cmd_t frame_cmds[] = {
+    { "PING", 'P', 0, cmd_ping },
+    { "ECHO", 'E', 0, cmd_echo },
+    { "HASH", 'H', 1, cmd_hash },
+};
+
+#define FRAME_NCMDS (sizeof(frame_cmds) / sizeof(frame_cmds[0]))
+
+static const frame_cmd_t *frame_lookup_op(uint8_t op) {
+    for (size_t i = 0; i < FRAME_NCMDS; i++) {
+        if (frame_cmds[i].op == op) return &frame_cmds[i];
+    }
+    return NULL;
+}
+
+static const frame_cmd_t *frame_lookup_name(const char *name, size_t len) {
+    for (size_t i = 0; i < FRAME_NCMDS; i++) {
+        if (strlen(frame_cmds[i].name) == len && memcmp(frame_cmds[i].name, name, len) == 0) return &frame_cmds[i];
+    }
+    return NULL;
+}
+
+int frame_mode_parse(const char *s) {
+    if (strcmp(s, "len") == 0) return FRAME_LEN;
+    if (strcmp(s, "line") == 0) return FRAME_LINE;
+    return -1;
+}
+
+// 拆出请求的命令和参数，不认识的命令返回 NULL
+static const frame_cmd_t *frame_parse(int mode, const char *msg, size_t len, const char **arg, size_t *alen) {
+    const frame_cmd_t *cmd;
+
+    if (mode == FRAME_LEN) {
+        *arg = msg + 1;
+        *alen = len - 1;
+        return frame_lookup_op((uint8_t)msg[0]);
+    }
+    if (len > 0 && msg[len - 1] == '\r') len--;
+    const char *sp = memchr(msg, ' ', len);
+    size_t nlen = sp ? (size_t)(sp - msg) : len;
+    cmd = frame_lookup_name(msg, nlen);
+    *arg = sp ? sp + 1 : msg + len;
+    *alen = len - (size_t)(*arg - msg);
+    return cmd;
+}
+
+int frame_reply_append(int mode, const frame_reply_t *reply, iochain_t *out) {
+    if (mode == FRAME_LEN) {
+        uint32_t n = (uint32_t)reply->len + 1;
+        char hdr[FRAME_HDR + 1] = { (char)(n >> 24), (char)(n >> 16), (char)(n >> 8), (char)n, reply->status };
+        if (iochain_append(out, hdr, sizeof(hdr)) == -1) return -1;
+        return iochain_append(out, reply->data, reply->len);
+    }
+    if (iochain_append(out, &reply->status, 1) == -1 || iochain_append(out, reply->data, reply->len) == -1) return -1;
+    return iochain_append(out, "\n", 1);
+}
+
+// 就地执行一个请求，把带帧头的回复追加到 out
+static int frame_dispatch(int mode, const frame_cmd_t *cmd, const char *arg, size_t alen, iochain_t *out) {
+    frame_reply_t reply;
+
+    reply.status = '+';
+    if (cmd) {
+        cmd->fn(arg, alen, &reply);
+    } else {
+        reply.status = '-';
+        reply.data = "ERR unknown command";
+        reply.len = strlen(reply.data);
+    }
+    return frame_reply_append(mode, &reply, out);
+}
+
+// 请求正文在头块里连续就直接用，跨块才拷到 scratch；返回的指针在消费 in 之前有效
+static const char *frame_view(const iochain_t *in, size_t skip, size_t len, char *scratch) {
+    const iobuf_t *b = in->head;
+
+    if (b->end - b->start >= skip + len) return b->data + b->start + skip;
+    iochain_copy(in, scratch, skip + len);
+    return scratch + skip;
+}
+
+int frame_process(int mode, iochain_t *in, iochain_t *out, size_t out_limit, uint32_t *scan, char *scratch,
+                  const frame_offload_t *offload) {
+    int n = 0;
+
+    while (in->bytes > 0 && out->bytes < out_limit) {
+        size_t skip, len, total;
+
+        if (mode == FRAME_LEN) {
+            unsigned char hdr[FRAME_HDR];
+            if (in->bytes < FRAME_HDR) break;
+            iochain_copy(in, (char *)hdr, FRAME_HDR);
+            len = (size_t)hdr[0] << 24 | (size_t)hdr[1] << 16 | (size_t)hdr[2] << 8 | hdr[3];
+            if (len == 0 || len > FRAME_MAX) return -1;
+            if (in->bytes < FRAME_HDR + len) break;
+            skip = FRAME_HDR;
+            total = FRAME_HDR + len;
+        } else {
+            ssize_t nl = iochain_find(in, '\n', *scan, FRAME_LINE_MAX);
+            if (nl < 0) {
+                if (in->bytes >= FRAME_LINE_MAX) return -1;
+                *scan = (uint32_t)in->bytes;
+                break;
+            }
+            skip = 0;
+            len = (size_t)nl;
+            total = len + 1;
+        }
+
+        const char *arg;
+        size_t alen;
+        const frame_cmd_t *cmd = frame_parse(mode, frame_view(in, skip, len, scratch), len, &arg, &alen);
+        int handed_off = 0;
+        if (cmd && cmd->heavy && offload) {
+            if ((handed_off = offload->submit(offload->opaque, cmd, arg, alen)) == -1) return -1;
+        }
+        if (!handed_off && frame_dispatch(mode, cmd, arg, alen, out) == -1) return -1;
+        iochain_consume(in, total);
+        *scan = 0;
+        n++;
+        if (handed_off) break;
+    }
+    return n;
+}
@@ -0,0 +1,63 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "buf.h"
+
+// 分帧：把连接的输入链表切成一个个完整的请求，按命令分发给处理函数表，回复追加到输出链表。
+// 一次读到的所有完整请求都在这里处理完，回复攒在输出链表里，由 reactor 在本轮末尾一次 writev 发出。
+//
+// 长度前缀（-f len）：请求 = 4 字节大端长度 N + N 字节正文，正文第一个字节是命令（'P' / 'E' / 'H'），其余是参数；
+//                    回复 = 4 字节大端长度 + 状态字节（'+' 成功 / '-' 出错）+ 回复正文。
+// 换行分隔（-f line）：请求 = "命令 参数\n"（命令是 PING / ECHO / HASH，行尾的 \r 忽略）；
+//                    回复 = 状态字节 + 回复正文 + "\n"，例如 "+PONG\n"、"-ERR unknown command\n"。
+
+enum { FRAME_NONE, FRAME_LEN, FRAME_LINE };
+
+#define FRAME_HDR 4                  // 长度前缀的字节数
+#define FRAME_MAX (1024 * 1024)      // 长度前缀模式下单个请求正文的上限，超出按协议错误断开
+#define FRAME_LINE_MAX 65536         // 换行模式下一行的上限（含换行），超出按协议错误断开
+#define FRAME_SCRATCH (FRAME_HDR + FRAME_MAX) // 跨块的请求拷到这么大的连续缓冲区里再处理
+#define FRAME_HASH_ROUNDS 1000       // HASH 对参数做多少轮 FNV-1a，64 字节参数约 100us CPU
+
+// 处理函数的回复：正文可以直接指向请求（回显不拷贝），短回复写在 buf 里
+typedef struct frame_reply {
+    char status;          // '+' 或 '-'
+    const char *data;
+    size_t len;
+    char buf[64];
+} frame_reply_t;
+
+typedef void (*frame_handler_fn)(const char *arg, size_t len, frame_reply_t *reply);
+
+typedef struct frame_cmd {
+    const char *name;     // 换行模式按行首的命令字查找
+    uint8_t op;           // 长度前缀模式按正文第一个字节查找
+    int heavy;            // CPU 密集：有工作线程池时交给工作线程，不在事件循环里执行
+    frame_handler_fn fn;
+} frame_cmd_t;
+
+// 把 heavy 命令交出去执行（工作线程池）。submit 返回 1 表示已交出去：这个请求从 in 里消费掉，
+// frame_process 立即返回，后面的请求等回复回来再处理，保证同一连接的回复顺序；
+// 返回 0 表示没交出去（队列满），就地执行；返回 -1 表示出错
+typedef struct frame_offload {
+    int (*submit)(void *opaque, const frame_cmd_t *cmd, const char *arg, size_t len);
+    void *opaque;
+} frame_offload_t;
+
+// "len" / "line" 转成 FRAME_LEN / FRAME_LINE，不认识返回 -1
+int frame_mode_parse(const char *s);
+
+// 从 in 里切出所有完整的请求逐个处理，回复追加到 out，处理过的字节从 in 里消费掉；
+// out 积压到 out_limit 就先停下，剩下的请求留在 in 里。
+// scan 记录换行模式下已经找过、没有换行的字节数，避免一行分很多次到达时反复从头找。
+// scratch 至少 FRAME_SCRATCH 字节；offload 为 NULL 时所有命令都就地执行。
+// 返回处理（含交出去）的请求数，协议错误或内存不足返回 -1
+int frame_process(int mode, iochain_t *in, iochain_t *out, size_t out_limit, uint32_t *scan, char *scratch,
+                  const frame_offload_t *offload);
+
+// 把回复加上帧头追加到 out，内存不足返回 -1；交出去的请求做完后由 reactor 调用
+int frame_reply_append(int mode, const frame_reply_t *reply, iochain_t *out);
+
+#endif
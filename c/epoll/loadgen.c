@@ -0,0 +1,594 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "network_utils.h"
+
+// 压测客户端，三种模式：
+//   echo    每个线程用一个 epoll 驱动 c 个长连接，统计 msgs/s 和延迟分位数。
+//           闭环（默认）：每个连接始终有 p 条请求在途，收到一条回复就补发一条；
+//           开环（-r）：按固定速率排请求，延迟从计划发送时间算起，服务器变慢时排队的时间也算进去，
+//           不会像闭环那样因为“慢了就少发”而把长尾藏起来（coordinated omission）。
+//           -f 按服务器的分帧格式发 ECHO 请求（-o 换成 PING / HASH）；-n 每条连接发够 n 条就重连（连接抖动）；
+//           -S 每个线程另有 k 个慢读连接，只管发、读得很慢，用来看它们会不会拖慢其它连接
+//   connect 每个线程串行地 建连 -> 1 字节往返 -> RST 关闭，统计 conns/s
+//   storm   建连风暴：每个线程同时保持 c 个非阻塞 connect 在途，每个连接 1 字节往返后 RST 关闭，
+//           立刻发起下一个，统计 conns/s（模拟故障切换后大量客户端同时重连）
+
+#define LG_MAX_MSG (1 << 20)
+#define LG_MAX_DEPTH 4096        // 每个连接最多在途（含开环模式下排了队还没发出）的请求数
+#define LG_RBUF_SIZE (256 * 1024)
+#define LG_SLOW_CHUNK 4096       // 慢读连接每个 tick 读多少字节
+#define LG_SLOW_TICK_NS 10000000 // 10ms，慢读连接约 400KB/s
+#define LAT_SUB_BITS 4           // 延迟直方图：每个 2 的幂区间再分 16 格，误差约 6%
+#define LAT_BUCKETS (64 << LAT_SUB_BITS)
+
+enum { LG_RAW, LG_FRAME_LEN, LG_FRAME_LINE };
+
+// 分帧模式下发的命令；reply 是回复正文的长度，0 表示和请求参数一样长（回显）
+typedef struct lg_cmd {
+    const char *name;
+    char op;
+    size_t reply;
+} lg_cmd_t;
+
+static const lg_cmd_t lg_cmds[] = {
+    { "ECHO", 'E', 0 },
+    { "PING", 'P', 4 },   // "PONG"，参数被忽略
+    { "HASH", 'H', 16 },  // 16 位十六进制，服务器上是 CPU 密集的命令
+};
+
+typedef struct lg_conn {
+    int fd;
+    size_t wpos;       // storm：当前消息已发出的字节数
+    size_t rpos;
+    int slow;          // 慢读连接：不注册 EPOLLIN，按 tick 限速读，不计入统计
+    uint32_t events;   // 当前注册的 epoll 事件
+    uint64_t queued;   // 已排上的请求数（已发出 + 还没发出）
+    uint64_t done;     // 已收到完整回复的请求数
+    uint64_t wbytes;   // 已发出的字节数
+    uint64_t rbytes;   // 已收到的字节数
+    int64_t *stamps;   // 环：第 i 条请求的发送时间（开环是计划发送时间），下标 i % depth，单位 ns
+} lg_conn_t;
+
+typedef struct lg_thread {
+    int id;
+    pthread_t thread;
+    uint64_t msgs;
+    uint64_t conns;
+    uint64_t errors;
+    uint64_t slow_msgs;  // 慢读连接完成的请求
+    uint64_t overflow;   // 开环：连接上在途请求已达上限，排不进去的请求
+    uint64_t reconnects;
+    uint64_t lat_max;
+    uint64_t lat[LAT_BUCKETS];
+} __attribute__((aligned(64))) lg_thread_t;
+
+static struct addrinfo *g_addr;
+static int g_conns = 16;
+static size_t g_size = 64;
+static int g_depth = 1;
+static double g_rate;      // 开环：所有线程合计的请求速率，0 表示闭环
+static int g_churn;        // 每条连接发够这么多请求就重连，0 表示不重连
+static int g_slow;         // 每个线程的慢读连接数
+static int g_nthreads = 1;
+static int g_framing = LG_RAW;
+static const lg_cmd_t *g_cmd = &lg_cmds[0];
+static volatile int g_stop;
+
+// 请求模板重复若干遍放在 g_req 里，连续的多条请求一次 write 发出去
+static char *g_req;
+static size_t g_req_len, g_rep_len, g_req_buf_len;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int lat_bucket(uint64_t v) {
+    if (v < (1u << LAT_SUB_BITS)) return (int)v;
+    int shift = 63 - __builtin_clzll(v) - LAT_SUB_BITS;
+    return ((shift + 1) << LAT_SUB_BITS) + (int)((v >> shift) & ((1u << LAT_SUB_BITS) - 1));
+}
+
+// 桶的上界
+static uint64_t lat_bucket_value(int i) {
+    if (i < (1 << LAT_SUB_BITS)) return (uint64_t)i;
+    int shift = (i >> LAT_SUB_BITS) - 1;
+    uint64_t sub = (uint64_t)(i & ((1 << LAT_SUB_BITS) - 1));
+    return (((1u << LAT_SUB_BITS) + sub) << shift) + ((uint64_t)1 << shift) - 1;
+}
+
+static void lat_record(lg_thread_t *t, int64_t ns) {
+    uint64_t v = ns > 0 ? (uint64_t)ns : 0;
+    t->lat[lat_bucket(v)]++;
+    if (v > t->lat_max) t->lat_max = v;
+}
+
+static uint64_t lat_percentile(const uint64_t *lat, uint64_t total, double q) {
+    uint64_t want = (uint64_t)(q * total + 0.5), seen = 0;
+
+    if (want == 0) want = 1;
+    for (int i = 0; i < LAT_BUCKETS; i++) {
+        seen += lat[i];
+        if (seen >= want) return lat_bucket_value(i);
+    }
+    return 0;
+}
+
+static void build_request(void) {
+    size_t hdr = 0, reply = g_cmd->reply ? g_cmd->reply : g_size;
+
+    switch (g_framing) {
+    case LG_FRAME_LEN: // 4 字节长度 + 命令字节 + 正文；回复 4 字节长度 + '+' + 回复正文
+        hdr = 5;
+        g_req_len = g_size + 5;
+        g_rep_len = reply + 5;
+        break;
+    case LG_FRAME_LINE: // "ECHO 正文\n"，回复 "+回复正文\n"
+        hdr = 5;
+        g_req_len = g_size + 6;
+        g_rep_len = reply + 2;
+        break;
+    default:
+        g_req_len = g_rep_len = g_size;
+        break;
+    }
+    size_t copies = g_req_len >= 65536 ? 1 : 65536 / g_req_len;
+    g_req_buf_len = copies * g_req_len;
+    g_req = malloc(g_req_buf_len);
+    if (g_req == NULL) abort();
+
+    char *p = g_req;
+    for (size_t i = 0; i < copies; i++, p += g_req_len) {
+        memset(p + hdr, 'a' + (int)(i % 26), g_size);
+        if (g_framing == LG_FRAME_LEN) {
+            uint32_t n = (uint32_t)g_size + 1;
+            p[0] = (char)(n >> 24);
+            p[1] = (char)(n >> 16);
+            p[2] = (char)(n >> 8);
+            p[3] = (char)n;
+            p[4] = g_cmd->op;
+        } else if (g_framing == LG_FRAME_LINE) {
+            memcpy(p, g_cmd->name, 4);
+            p[4] = ' ';
+            p[g_req_len - 1] = '\n';
+        }
+    }
+}
+
+static int open_conn(int nonblock) {
+    int fd = socket(g_addr->ai_family, g_addr->ai_socktype, g_addr->ai_protocol);
+    if (fd == -1) return -1;
+    if (connect(fd, g_addr->ai_addr, g_addr->ai_addrlen) == -1) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (nonblock && make_socket_non_blocking(fd) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int set_events(int efd, lg_conn_t *c, uint32_t want) {
+    if (want == c->events) return 0;
+    struct epoll_event ev = { .events = want, .data.ptr = c };
+    c->events = want;
+    return epoll_ctl(efd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+// 把排上的请求尽量写出去，写不完就等 EPOLLOUT
+static int send_pending(int efd, lg_conn_t *c) {
+    uint64_t total = c->queued * g_req_len;
+
+    while (c->wbytes < total) {
+        size_t off = c->wbytes % g_req_len;
+        size_t n = g_req_buf_len - off;
+        if (n > total - c->wbytes) n = total - c->wbytes;
+        ssize_t w = write(c->fd, g_req + off, n);
+        if (w == -1) {
+            if (errno != EAGAIN) return -1;
+            return set_events(efd, c, (c->slow ? 0 : EPOLLIN) | EPOLLOUT);
+        }
+        c->wbytes += w;
+    }
+    return set_events(efd, c, c->slow ? 0 : EPOLLIN);
+}
+
+static int conn_start(int efd, lg_conn_t *c) {
+    c->fd = open_conn(1);
+    if (c->fd == -1) return -1;
+    c->queued = c->done = c->wbytes = c->rbytes = 0;
+    c->events = c->slow ? 0 : EPOLLIN;
+    struct epoll_event ev = { .events = c->events, .data.ptr = c };
+    if (epoll_ctl(efd, EPOLL_CTL_ADD, c->fd, &ev) == -1) {
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static void conn_close(lg_conn_t *c) {
+    close(c->fd);
+    c->fd = -1;
+}
+
+// 闭环连接（和所有慢读连接）把在途请求补到 depth 条
+static void fill_closed_loop(lg_conn_t *c, int64_t now) {
+    while (c->queued - c->done < (uint64_t)g_depth) {
+        c->stamps[c->queued % g_depth] = now;
+        c->queued++;
+    }
+}
+
+// 读回复：每凑够 g_rep_len 字节就完成一条请求，按发送时间记延迟。返回 -1 表示连接出错或被关闭
+static int read_replies(lg_thread_t *t, lg_conn_t *c, char *buf, size_t max) {
+    ssize_t r = read(c->fd, buf, max);
+    if (r == -1 && errno == EAGAIN) return 0;
+    if (r <= 0) return -1;
+    c->rbytes += r;
+
+    int64_t now = now_ns();
+    while (c->done < c->queued && c->rbytes >= (c->done + 1) * g_rep_len) {
+        if (c->slow) {
+            t->slow_msgs++;
+        } else {
+            lat_record(t, now - c->stamps[c->done % g_depth]);
+            __atomic_store_n(&t->msgs, t->msgs + 1, __ATOMIC_RELAXED);
+        }
+        c->done++;
+    }
+    return 0;
+}
+
+static void *echo_thread(void *arg) {
+    lg_thread_t *t = arg;
+    int nconns = g_conns + g_slow;
+    lg_conn_t *conns = calloc(nconns, sizeof(lg_conn_t));
+    int64_t *stamps = calloc((size_t)nconns * g_depth, sizeof(int64_t));
+    char *buf = malloc(LG_RBUF_SIZE);
+    int efd = epoll_create1(0);
+    struct epoll_event events[64];
+
+    if (conns == NULL || stamps == NULL || buf == NULL || efd == -1) abort();
+
+    int64_t start = now_ns();
+    for (int i = 0; i < nconns; i++) {
+        lg_conn_t *c = &conns[i];
+        c->slow = i >= g_conns;
+        c->stamps = stamps + (size_t)i * g_depth;
+        if (conn_start(efd, c) == -1) {
+            perror("connect");
+            t->errors++;
+            continue;
+        }
+        t->conns++;
+        if (g_rate == 0 || c->slow) fill_closed_loop(c, start);
+        if (send_pending(efd, c) == -1) t->errors++;
+    }
+
+    // 开环：整个线程按 interval 排请求，依次轮到各个连接
+    int64_t interval = g_rate > 0 ? (int64_t)(1e9 * g_nthreads / g_rate) : 0;
+    int64_t next_at = now_ns(), next_slow = next_at + LG_SLOW_TICK_NS;
+    int rr = 0;
+    if (interval < 1 && g_rate > 0) interval = 1;
+
+    while (!g_stop) {
+        int64_t now = now_ns();
+
+        if (interval) {
+            for (; next_at <= now; next_at += interval) {
+                lg_conn_t *c = &conns[rr];
+                rr = (rr + 1) % g_conns;
+                if (c->fd == -1) continue;
+                if (c->queued - c->done >= (uint64_t)g_depth) {
+                    t->overflow++;
+                    continue;
+                }
+                c->stamps[c->queued % g_depth] = next_at;
+                c->queued++;
+                if (!(c->events & EPOLLOUT) && send_pending(efd, c) == -1) {
+                    t->errors++;
+                    conn_close(c);
+                }
+            }
+        }
+        if (g_slow && next_slow <= now) {
+            // 慢读连接：每个 tick 只读一小块
+            for (int i = g_conns; i < nconns; i++) {
+                lg_conn_t *c = &conns[i];
+                if (c->fd == -1) continue;
+                if (read_replies(t, c, buf, LG_SLOW_CHUNK) == -1) {
+                    t->errors++;
+                    conn_close(c);
+                    continue;
+                }
+                fill_closed_loop(c, now);
+                if (!(c->events & EPOLLOUT) && send_pending(efd, c) == -1) {
+                    t->errors++;
+                    conn_close(c);
+                }
+            }
+            next_slow = now + LG_SLOW_TICK_NS;
+        }
+
+        // 等到下一个要排请求（或慢读 tick）的时刻，精确到纳秒；闭环时最多等 100ms 检查 g_stop
+        int64_t wake = now + 100000000;
+        if (interval && next_at < wake) wake = next_at;
+        if (g_slow && next_slow < wake) wake = next_slow;
+        int64_t wait = wake > now ? wake - now : 0;
+        struct timespec ts = { wait / 1000000000, wait % 1000000000 };
+        int n = epoll_pwait2(efd, events, 64, &ts, NULL);
+
+        for (int i = 0; i < n; i++) {
+            lg_conn_t *c = events[i].data.ptr;
+
+            if (c->fd == -1) continue;
+            if ((events[i].events & EPOLLOUT) && send_pending(efd, c) == -1) goto fail;
+            if (c->slow) {
+                if ((events[i].events & (EPOLLERR | EPOLLHUP)) && read_replies(t, c, buf, LG_SLOW_CHUNK) == -1) goto fail;
+                continue;
+            }
+            if (!(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) continue;
+            if (read_replies(t, c, buf, LG_RBUF_SIZE) == -1) goto fail;
+
+            // 连接抖动：发够 g_churn 条且都收到回复后换一条新连接
+            if (g_churn && c->done >= (uint64_t)g_churn && c->done == c->queued) {
+                conn_close(c);
+                if (conn_start(efd, c) == -1) goto fail;
+                t->reconnects++;
+            }
+            if (g_rate == 0) fill_closed_loop(c, now_ns());
+            if (!(c->events & EPOLLOUT) && send_pending(efd, c) == -1) goto fail;
+            continue;
+fail:
+            t->errors++;
+            if (c->fd != -1) conn_close(c);
+        }
+    }
+
+    for (int i = 0; i < nconns; i++) {
+        if (conns[i].fd != -1) close(conns[i].fd);
+    }
+    close(efd);
+    free(buf);
+    free(stamps);
+    free(conns);
+    return NULL;
+}
+
+// 发起一个非阻塞 connect，完成（EPOLLOUT）后再发数据
+static int storm_connect(int efd, lg_conn_t *c) {
+    c->fd = socket(g_addr->ai_family, g_addr->ai_socktype | SOCK_NONBLOCK, g_addr->ai_protocol);
+    if (c->fd == -1) return -1;
+    c->wpos = c->rpos = 0;
+    if (connect(c->fd, g_addr->ai_addr, g_addr->ai_addrlen) == -1 && errno != EINPROGRESS) {
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = c };
+    return epoll_ctl(efd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+static void *storm_thread(void *arg) {
+    lg_thread_t *t = arg;
+    lg_conn_t *conns = calloc(g_conns, sizeof(lg_conn_t));
+    struct linger lg = { .l_onoff = 1, .l_linger = 0 };
+    struct epoll_event events[64];
+    int efd = epoll_create1(0);
+
+    if (conns == NULL || efd == -1) abort();
+    for (int i = 0; i < g_conns; i++) {
+        if (storm_connect(efd, &conns[i]) == -1) t->errors++;
+    }
+
+    while (!g_stop) {
+        int n = epoll_wait(efd, events, 64, 100);
+        for (int i = 0; i < n; i++) {
+            lg_conn_t *c = events[i].data.ptr;
+            char ch = 'x';
+            int err = 0, ok = 0;
+            socklen_t len = sizeof(err);
+
+            if (c->wpos == 0) {
+                // connect 完成：检查结果，发 1 字节，改等回显
+                getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0 || write(c->fd, &ch, 1) != 1) goto done;
+                c->wpos = 1;
+                struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+                if (epoll_ctl(efd, EPOLL_CTL_MOD, c->fd, &ev) == -1) goto done;
+                continue;
+            }
+            ssize_t r = read(c->fd, &ch, 1);
+            if (r == -1 && errno == EAGAIN) continue;
+            ok = r == 1;
+done:
+            if (ok) __atomic_store_n(&t->conns, t->conns + 1, __ATOMIC_RELAXED);
+            else t->errors++;
+            setsockopt(c->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+            close(c->fd);
+            c->fd = -1;
+            if (storm_connect(efd, c) == -1) t->errors++;
+        }
+    }
+
+    for (int i = 0; i < g_conns; i++) {
+        if (conns[i].fd != -1) close(conns[i].fd);
+    }
+    close(efd);
+    free(conns);
+    return NULL;
+}
+
+static void *connect_thread(void *arg) {
+    lg_thread_t *t = arg;
+    struct linger lg = { .l_onoff = 1, .l_linger = 0 };
+    char c = 'x';
+
+    while (!g_stop) {
+        int fd = open_conn(0);
+        if (fd == -1) {
+            t->errors++;
+            continue;
+        }
+        if (write(fd, &c, 1) != 1 || read(fd, &c, 1) != 1) t->errors++;
+        else __atomic_store_n(&t->conns, t->conns + 1, __ATOMIC_RELAXED);
+        // RST 关闭，客户端不留 TIME_WAIT，压测时不会耗尽本地端口
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        close(fd);
+    }
+    return NULL;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-m echo|connect|storm] [-t threads] [-c conns] [-s size] [-d seconds] [-p depth] [-r rate]\n"
+            "          [-f len|line] [-o echo|ping|hash] [-n msgs] [-S slow_conns] <host> <port>\n",
+            prog);
+    fprintf(stderr, "  -m  echo: c persistent connections per thread, p requests in flight each (default)\n");
+    fprintf(stderr, "      connect: connect, 1-byte round trip, close with RST, in a loop\n");
+    fprintf(stderr, "      storm: like connect, but c non-blocking connects in flight per thread\n");
+    fprintf(stderr, "  -t  client threads (default 1)\n");
+    fprintf(stderr, "  -c  connections per thread in echo / storm mode (default 16)\n");
+    fprintf(stderr, "  -s  message size in bytes in echo mode (default 64, max %d)\n", LG_MAX_MSG);
+    fprintf(stderr, "  -d  duration in seconds (default 5)\n");
+    fprintf(stderr, "  -p  echo: requests in flight per connection (default 1, max %d); with -r, the queue limit\n",
+            LG_MAX_DEPTH);
+    fprintf(stderr, "  -r  echo: open loop at this many requests/s in total; latency counts from the scheduled send time\n");
+    fprintf(stderr, "  -f  echo: send framed ECHO requests for a server started with -f len|line\n");
+    fprintf(stderr, "  -o  with -f: command to send, echo (default), ping or hash (CPU-heavy on the server)\n");
+    fprintf(stderr, "  -n  echo: reconnect after this many requests per connection (connection churn)\n");
+    fprintf(stderr, "  -S  echo: extra slow-reading connections per thread (~%d KB/s each), not counted in the results\n",
+            (int)((int64_t)LG_SLOW_CHUNK * 1000000000 / LG_SLOW_TICK_NS / 1024));
+}
+
+static void print_latency(const lg_thread_t *threads, int n, uint64_t msgs) {
+    static uint64_t lat[LAT_BUCKETS];
+    uint64_t max = 0;
+
+    for (int i = 0; i < n; i++) {
+        for (int b = 0; b < LAT_BUCKETS; b++) lat[b] += threads[i].lat[b];
+        if (threads[i].lat_max > max) max = threads[i].lat_max;
+    }
+    if (msgs == 0) return;
+    printf("latency (%s): p50=%.1fus p90=%.1fus p99=%.1fus p99.9=%.1fus max=%.1fus\n",
+           g_rate > 0 ? "from scheduled send" : "closed loop", lat_percentile(lat, msgs, 0.5) / 1e3,
+           lat_percentile(lat, msgs, 0.9) / 1e3, lat_percentile(lat, msgs, 0.99) / 1e3,
+           lat_percentile(lat, msgs, 0.999) / 1e3, max / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+    int seconds = 5, echo = 1, storm = 0, opt;
+
+    while ((opt = getopt(argc, argv, "m:t:c:s:d:p:r:f:o:n:S:")) != -1) {
+        switch (opt) {
+        case 'm':
+            echo = strcmp(optarg, "echo") == 0;
+            storm = strcmp(optarg, "storm") == 0;
+            if (!echo && !storm && strcmp(optarg, "connect") != 0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 't': g_nthreads = atoi(optarg); break;
+        case 'c': g_conns = atoi(optarg); break;
+        case 's': g_size = strtoul(optarg, NULL, 10); break;
+        case 'd': seconds = atoi(optarg); break;
+        case 'p': g_depth = atoi(optarg); break;
+        case 'r': g_rate = atof(optarg); break;
+        case 'f':
+            if (strcmp(optarg, "len") == 0) g_framing = LG_FRAME_LEN;
+            else if (strcmp(optarg, "line") == 0) g_framing = LG_FRAME_LINE;
+            else { usage(argv[0]); exit(EXIT_FAILURE); }
+            break;
+        case 'o':
+            g_cmd = NULL;
+            for (size_t i = 0; i < sizeof(lg_cmds) / sizeof(lg_cmds[0]); i++) {
+                if (strcasecmp(optarg, lg_cmds[i].name) == 0) g_cmd = &lg_cmds[i];
+            }
+            if (g_cmd == NULL) { usage(argv[0]); exit(EXIT_FAILURE); }
+            break;
+        case 'n': g_churn = atoi(optarg); break;
+        case 'S': g_slow = atoi(optarg); break;
+        default: usage(argv[0]); exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 2 || g_nthreads < 1 || g_conns < 1 || g_size < 1 || g_size > LG_MAX_MSG || seconds < 1 ||
+        g_depth < 1 || g_depth > LG_MAX_DEPTH || g_rate < 0 || g_churn < 0 || g_slow < 0 ||
+        (g_cmd != &lg_cmds[0] && g_framing == LG_RAW)) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    int s = getaddrinfo(argv[optind], argv[optind + 1], &hints, &g_addr);
+    if (s != 0) {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(s));
+        exit(EXIT_FAILURE);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    if (echo) build_request();
+
+    lg_thread_t *threads = aligned_alloc(64, sizeof(lg_thread_t) * g_nthreads);
+    if (threads == NULL) abort();
+    memset(threads, 0, sizeof(lg_thread_t) * g_nthreads);
+
+    double start = now_sec();
+    for (int i = 0; i < g_nthreads; i++) {
+        threads[i].id = i;
+        pthread_create(&threads[i].thread, NULL, echo ? echo_thread : storm ? storm_thread : connect_thread, &threads[i]);
+    }
+    sleep(seconds);
+    g_stop = 1;
+
+    uint64_t msgs = 0, conns = 0, errors = 0, slow_msgs = 0, overflow = 0, reconnects = 0;
+    for (int i = 0; i < g_nthreads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        msgs += threads[i].msgs;
+        conns += threads[i].conns;
+        errors += threads[i].errors;
+        slow_msgs += threads[i].slow_msgs;
+        overflow += threads[i].overflow;
+        reconnects += threads[i].reconnects;
+    }
+    double elapsed = now_sec() - start;
+
+    if (echo) {
+        printf("echo: threads=%d conns=%" PRIu64 " size=%zu depth=%d msgs=%" PRIu64 "  %.0f msgs/s  %.1f MB/s  errors=%" PRIu64
+               "\n", g_nthreads, conns, g_size, g_depth, msgs, msgs / elapsed,
+               msgs * (double)(g_req_len + g_rep_len) / elapsed / 1e6, errors);
+        print_latency(threads, g_nthreads, msgs);
+        if (g_rate > 0)
+            printf("open loop: target %.0f req/s, %" PRIu64 " requests not queued (depth limit reached)\n", g_rate,
+                   overflow);
+        if (g_churn) printf("churn: reconnect every %d requests, %" PRIu64 " reconnects\n", g_churn, reconnects);
+        if (g_slow) printf("slow readers: %d per thread, %" PRIu64 " requests completed\n", g_slow, slow_msgs);
+    } else {
+        printf("%s: threads=%d  %.0f conns/s  errors=%" PRIu64 "\n", storm ? "storm" : "connect", g_nthreads,
+               conns / elapsed, errors);
+    }
+
+    freeaddrinfo(g_addr);
+    free(g_req);
+    free(threads);
+    return errors != 0;
+}
@@ -0,0 +1,341 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "log.h"
+
+#define LOG_STR_SPACE 160     // 每条记录里存放字符串参数的空间
+#define LOG_LINE_MAX 1024     // 单行格式化后的上限，超出截断
+#define LOG_OUT_SIZE 65536    // 写线程攒够这么多再 write
+#define LOG_IDLE_NS 1000000   // 所有环都空时写线程睡 1ms
+
+// 一条记录 256 字节：格式串指针、原始参数、拷贝过来的字符串
+typedef struct log_rec {
+    uint64_t ts_ns;
+    const char *fmt;
+    uint8_t level;
+    uint8_t nargs;
+    uint8_t types[LOG_MAX_ARGS];
+    log_arg_t args[LOG_MAX_ARGS];   // LOG_T_STR 时存的是 strs 里的偏移
+    char strs[LOG_STR_SPACE];
+} log_rec_t;
+
+// 每个线程一个单生产者单消费者环。head 只有写线程改，tail 只有所属线程改，分开两条缓存行
+typedef struct log_ring {
+    uint64_t head __attribute__((aligned(64)));
+    uint64_t tail __attribute__((aligned(64)));
+    uint64_t head_cache;   // 生产者看到的 head，只有环看起来满了才重新读
+    uint64_t dropped;
+    struct log_ring *next;
+    log_rec_t recs[LOG_RING_SLOTS];
+} log_ring_t;
+
+int g_log_level = LOG_LVL_DEBUG;
+
+static log_ring_t *g_rings;   // 所有线程的环，只增不减，写线程遍历
+static __thread log_ring_t *t_ring;
+static pthread_t g_writer;
+static int g_running;
+static volatile int g_stop;
+static int g_fd = -1;
+static uint64_t g_dropped_reported;
+
+static const char *const level_names[] = { "DEBUG", "INFO ", "WARN ", "ERROR" };
+
+static log_ring_t *log_ring_register(void) {
+    log_ring_t *ring = aligned_alloc(64, sizeof(*ring));
+
+    if (ring == NULL) return NULL;
+    memset(ring, 0, offsetof(log_ring_t, recs));
+    ring->next = __atomic_load_n(&g_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&g_rings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    t_ring = ring;
+    return ring;
+}
+
+void log_emit(int level, const char *fmt, int nargs, const uint8_t *types, const log_arg_t *args) {
+    log_ring_t *ring = t_ring ? t_ring : log_ring_register();
+    struct timespec ts;
+
+    if (ring == NULL) return;
+    uint64_t tail = ring->tail;
+    if (tail - ring->head_cache >= LOG_RING_SLOTS) {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (tail - ring->head_cache >= LOG_RING_SLOTS) {
+            // 写线程跟不上：丢掉这条，绝不让事件循环等
+            __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    log_rec_t *rec = &ring->recs[tail & (LOG_RING_SLOTS - 1)];
+    clock_gettime(CLOCK_REALTIME, &ts);   // vDSO，不进内核
+    rec->ts_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    rec->fmt = fmt;
+    rec->level = (uint8_t)level;
+    if (nargs > LOG_MAX_ARGS) nargs = LOG_MAX_ARGS;
+    rec->nargs = (uint8_t)nargs;
+
+    size_t used = 0;
+    for (int i = 0; i < nargs; i++) {
+        rec->types[i] = types[i];
+        if (types[i] != LOG_T_STR) {
+            rec->args[i] = args[i];
+            continue;
+        }
+        // 字符串在这里就拷走，调用方的缓冲区马上会被复用
+        const char *s = args[i].p ? args[i].p : "(null)";
+        if (used >= LOG_STR_SPACE) {
+            rec->args[i].u = LOG_STR_SPACE - 1;   // 空间用完，指向末尾的空串
+            continue;
+        }
+        size_t n = strnlen(s, LOG_STR_SPACE - used - 1);
+        memcpy(rec->strs + used, s, n);
+        rec->strs[used + n] = '\0';
+        rec->args[i].u = used;
+        used += n + 1;
+    }
+    rec->strs[LOG_STR_SPACE - 1] = '\0';
+
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+typedef struct log_out {
+    char *buf;
+    size_t len;
+    size_t cap;
+} log_out_t;
+
+static void log_put(log_out_t *o, const char *fmt, ...) {
+    va_list ap;
+
+    if (o->len + 1 >= o->cap) return;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    o->len += (size_t)n;
+    if (o->len >= o->cap) o->len = o->cap - 1;
+}
+
+static void log_putc(log_out_t *o, char ch) {
+    if (o->len + 1 < o->cap) o->buf[o->len++] = ch;
+}
+
+// 按格式串逐个转换说明符格式化。参数在记录里都被放宽成了 64 位，
+// 所以长度修饰符一律丢掉，整数统一改成 ll，浮点统一按 double。
+static void log_format_rec(const log_rec_t *rec, log_out_t *o) {
+    const char *p = rec->fmt;
+    int ai = 0;
+
+    while (*p) {
+        if (*p != '%') {
+            const char *q = strchrnul(p, '%');
+            size_t n = (size_t)(q - p);
+            if (n > o->cap - 1 - o->len) n = o->cap - 1 - o->len;
+            memcpy(o->buf + o->len, p, n);
+            o->len += n;
+            p = q;
+            continue;
+        }
+        if (p[1] == '%') {
+            log_putc(o, '%');
+            p += 2;
+            continue;
+        }
+
+        char spec[24];
+        size_t sl = 0;
+        int star[2], nstar = 0;
+        spec[sl++] = *p++;
+        while (*p && strchr("-+ #0", *p) && sl < 8) spec[sl++] = *p++;
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*p != '.') break;
+                spec[sl++] = *p++;
+            }
+            if (*p == '*') {
+                spec[sl++] = *p++;
+                star[nstar++] = ai < rec->nargs ? (int)rec->args[ai++].i : 0;
+            } else {
+                while (*p >= '0' && *p <= '9') {
+                    if (sl < 18) spec[sl++] = *p;
+                    p++;
+                }
+            }
+        }
+        while (*p && strchr("hlLqjzt", *p)) p++;
+        char conv = *p;
+        if (conv == '\0') break;
+        p++;
+
+        if (ai >= rec->nargs) {
+            log_put(o, "<?>");
+            continue;
+        }
+        int type = rec->types[ai];
+        log_arg_t a = rec->args[ai++];
+
+#define LOG_PUT_(v)                                                   \
+    (nstar == 0   ? log_put(o, spec, v)                               \
+     : nstar == 1 ? log_put(o, spec, star[0], v)                      \
+                  : log_put(o, spec, star[0], star[1], v))
+
+        switch (conv) {
+        case 'd': case 'i':
+        case 'u': case 'o': case 'x': case 'X':
+            spec[sl++] = 'l';
+            spec[sl++] = 'l';
+            spec[sl++] = conv;
+            spec[sl] = '\0';
+            if (type == LOG_T_DBL) a.i = (long long)a.d;
+            if (conv == 'd' || conv == 'i') LOG_PUT_(a.i);
+            else LOG_PUT_(a.u);
+            break;
+        case 'c':
+            spec[sl++] = conv;
+            spec[sl] = '\0';
+            LOG_PUT_((int)a.i);
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            spec[sl++] = conv;
+            spec[sl] = '\0';
+            LOG_PUT_(type == LOG_T_DBL ? a.d : (double)a.i);
+            break;
+        case 's':
+            spec[sl++] = conv;
+            spec[sl] = '\0';
+            LOG_PUT_(type == LOG_T_STR ? rec->strs + a.u : "(?)");
+            break;
+        case 'p':
+            spec[sl++] = conv;
+            spec[sl] = '\0';
+            LOG_PUT_(type == LOG_T_STR ? NULL : (void *)(uintptr_t)a.u);
+            break;
+        default:
+            log_put(o, "<%%%c?>", conv);
+            break;
+        }
+#undef LOG_PUT_
+    }
+}
+
+static void log_write_all(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(g_fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+static char g_out[LOG_OUT_SIZE];
+
+// 把所有环里现有的记录格式化写出，返回处理条数
+static size_t log_drain(void) {
+    static time_t last_sec = -1;
+    static char stamp[16];
+    log_out_t o = { g_out, 0, sizeof(g_out) };
+    uint64_t dropped = 0;
+    size_t total = 0;
+
+    for (log_ring_t *ring = __atomic_load_n(&g_rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+        uint64_t head = ring->head;
+        uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++) {
+            const log_rec_t *rec = &ring->recs[head & (LOG_RING_SLOTS - 1)];
+            time_t sec = (time_t)(rec->ts_ns / 1000000000ull);
+
+            if (o.cap - o.len < LOG_LINE_MAX) {
+                log_write_all(o.buf, o.len);
+                o.len = 0;
+            }
+            if (sec != last_sec) {
+                struct tm tm;
+                localtime_r(&sec, &tm);
+                strftime(stamp, sizeof(stamp), "%H:%M:%S", &tm);
+                last_sec = sec;
+            }
+
+            // 每行限制在 LOG_LINE_MAX 以内，并保证以换行结尾
+            log_out_t line = { o.buf + o.len, 0, LOG_LINE_MAX };
+            log_put(&line, "%s.%06u %s ", stamp, (unsigned)(rec->ts_ns % 1000000000ull / 1000),
+                    level_names[rec->level < LOG_LVL_OFF ? rec->level : LOG_LVL_ERROR]);
+            log_format_rec(rec, &line);
+            if (line.len == 0 || line.buf[line.len - 1] != '\n') {
+                if (line.len + 1 >= line.cap) line.len = line.cap - 2;
+                line.buf[line.len++] = '\n';
+            }
+            o.len += line.len;
+            total++;
+        }
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+        dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    }
+
+    if (dropped != g_dropped_reported) {
+        log_put(&o, "log: %llu records dropped (ring full)\n", (unsigned long long)(dropped - g_dropped_reported));
+        g_dropped_reported = dropped;
+    }
+    if (o.len > 0) log_write_all(o.buf, o.len);
+    return total;
+}
+
+static void *log_writer(void *arg) {
+    (void)arg;
+    while (!g_stop) {
+        if (log_drain() == 0) {
+            struct timespec ts = { 0, LOG_IDLE_NS };
+            nanosleep(&ts, NULL);
+        }
+    }
+    log_drain();
+    return NULL;
+}
+
+int log_init(int fd) {
+    g_fd = fd;
+    g_stop = 0;
+    int err = pthread_create(&g_writer, NULL, log_writer, NULL);
+    if (err != 0) {
+        fprintf(stderr, "log: pthread_create: %s\n", strerror(err));
+        return -1;
+    }
+    g_running = 1;
+    return 0;
+}
+
+void log_shutdown(void) {
+    if (!g_running) return;
+    g_stop = 1;
+    pthread_join(g_writer, NULL);
+    g_running = 0;
+
+    log_ring_t *ring = g_rings;
+    g_rings = NULL;
+    t_ring = NULL;   // 其他线程此时都已退出
+    while (ring) {
+        log_ring_t *next = ring->next;
+        free(ring);
+        ring = next;
+    }
+}
+
+void log_set_level(int level) {
+    g_log_level = level;
+}
+
+uint64_t log_dropped(void) {
+    return g_dropped_reported;
+}
@@ -0,0 +1,120 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+
+// 异步日志：事件循环线程只把 格式串指针 + 参数 + 时间戳 拷进本线程的无锁环（单生产者单消费者），
+// 格式化和 write 都在后台写线程里做。环满时丢弃并计数，绝不阻塞事件循环。
+//
+// 编译期过滤：低于 LOG_LEVEL 的宏展开成空语句，参数都不会求值，例如
+//   make LOG_LEVEL=WARN
+// 运行期还可以用 log_set_level() 再提高门槛（-q 就是这么做的）。
+//
+// 限制：格式串必须是字符串字面量（只保存指针）；最多 LOG_MAX_ARGS 个参数；
+// 字符串参数在调用时拷贝，总长受记录大小限制，超出截断；%n 不支持。
+
+enum { LOG_LVL_DEBUG, LOG_LVL_INFO, LOG_LVL_WARN, LOG_LVL_ERROR, LOG_LVL_OFF };
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LVL_DEBUG
+#endif
+
+#define LOG_MAX_ARGS 8
+#define LOG_RING_SLOTS 4096   // 每个线程的环有多少条记录（2 的幂）
+
+enum { LOG_T_INT, LOG_T_UINT, LOG_T_DBL, LOG_T_STR, LOG_T_PTR };
+
+typedef union log_arg {
+    long long i;
+    unsigned long long u;
+    double d;
+    const void *p;
+} log_arg_t;
+
+extern int g_log_level;
+
+// 启动后台写线程，日志写到 fd（通常是 STDOUT_FILENO）
+int log_init(int fd);
+
+// 取走所有线程环里剩下的记录并写出，然后停止写线程
+void log_shutdown(void);
+
+void log_set_level(int level);
+
+// 因环满被丢弃的记录数
+uint64_t log_dropped(void);
+
+void log_emit(int level, const char *fmt, int nargs, const uint8_t *types, const log_arg_t *args);
+
+static inline log_arg_t log_arg_i(long long v) { log_arg_t a; a.i = v; return a; }
+static inline log_arg_t log_arg_u(unsigned long long v) { log_arg_t a; a.u = v; return a; }
+static inline log_arg_t log_arg_d(double v) { log_arg_t a; a.d = v; return a; }
+static inline log_arg_t log_arg_p(const void *v) { log_arg_t a; a.p = v; return a; }
+
+#define LOG_TYPE_(x) _Generic((x), \
+    char *: LOG_T_STR, const char *: LOG_T_STR, \
+    void *: LOG_T_PTR, const void *: LOG_T_PTR, \
+    float: LOG_T_DBL, double: LOG_T_DBL, \
+    unsigned char: LOG_T_UINT, unsigned short: LOG_T_UINT, unsigned int: LOG_T_UINT, \
+    unsigned long: LOG_T_UINT, unsigned long long: LOG_T_UINT, \
+    default: LOG_T_INT)
+
+#define LOG_VALUE_(x) _Generic((x), \
+    char *: log_arg_p, const char *: log_arg_p, \
+    void *: log_arg_p, const void *: log_arg_p, \
+    float: log_arg_d, double: log_arg_d, \
+    unsigned char: log_arg_u, unsigned short: log_arg_u, unsigned int: log_arg_u, \
+    unsigned long: log_arg_u, unsigned long long: log_arg_u, \
+    default: log_arg_i)(x)
+
+// 对每个参数套一个宏，最多 LOG_MAX_ARGS 个
+#define LOG_MAP0_(m)
+#define LOG_MAP1_(m, a) , m(a)
+#define LOG_MAP2_(m, a, ...) , m(a) LOG_MAP1_(m, __VA_ARGS__)
+#define LOG_MAP3_(m, a, ...) , m(a) LOG_MAP2_(m, __VA_ARGS__)
+#define LOG_MAP4_(m, a, ...) , m(a) LOG_MAP3_(m, __VA_ARGS__)
+#define LOG_MAP5_(m, a, ...) , m(a) LOG_MAP4_(m, __VA_ARGS__)
+#define LOG_MAP6_(m, a, ...) , m(a) LOG_MAP5_(m, __VA_ARGS__)
+#define LOG_MAP7_(m, a, ...) , m(a) LOG_MAP6_(m, __VA_ARGS__)
+#define LOG_MAP8_(m, a, ...) , m(a) LOG_MAP7_(m, __VA_ARGS__)
+#define LOG_PICK_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define LOG_NARGS_(...) LOG_PICK_(_, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_MAPN_(n) LOG_MAP##n##_
+#define LOG_MAPX_(n) LOG_MAPN_(n)
+#define LOG_MAP_(m, ...) LOG_MAPX_(LOG_NARGS_(__VA_ARGS__))(m, ##__VA_ARGS__)
+
+// 数组第 0 个元素是占位，保证没有参数时也不是空初始化列表
+#define LOG_AT_(lvl, fmt, ...)                                                              \
+    do {                                                                                    \
+        if ((lvl) >= g_log_level) {                                                         \
+            static const uint8_t log_types_[] = { 0 LOG_MAP_(LOG_TYPE_, ##__VA_ARGS__) };   \
+            const log_arg_t log_args_[] = { { 0 } LOG_MAP_(LOG_VALUE_, ##__VA_ARGS__) };    \
+            log_emit((lvl), "" fmt, LOG_NARGS_(__VA_ARGS__), log_types_ + 1, log_args_ + 1); \
+        }                                                                                   \
+    } while (0)
+
+#if LOG_LEVEL <= LOG_LVL_DEBUG
+#define LOG_DEBUG(fmt, ...) LOG_AT_(LOG_LVL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(fmt, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LVL_INFO
+#define LOG_INFO(fmt, ...) LOG_AT_(LOG_LVL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LVL_WARN
+#define LOG_WARN(fmt, ...) LOG_AT_(LOG_LVL_WARN, fmt, ##__VA_ARGS__)
+#else
+#define LOG_WARN(fmt, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LVL_ERROR
+#define LOG_ERROR(fmt, ...) LOG_AT_(LOG_LVL_ERROR, fmt, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(fmt, ...) ((void)0)
+#endif
+
+#endif
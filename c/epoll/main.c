@@ -1,102 +1,279 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/epoll.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "buf.h"
+#include "log.h"
 #include "network_utils.h"
+#include "reactor.h"
+#include "worker.h"
 
-#define MAX_EVENTS 64
-#define BUFFER_SIZE 512
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-t threads] [-e epoll|uring] [-s] [-c max_conns] [-i idle_ms] [-r read_ms] [-u host:port] [-z] [-f len|line] [-w workers] [-q] [-P] <port>\n",
+            prog);
+    fprintf(stderr, "  -t threads  number of reactors, one event loop per thread (default 1)\n");
+    fprintf(stderr, "  -e engine   epoll (default) or uring: multishot accept/recv, provided buffers, linked sends\n");
+    fprintf(stderr, "  -s          one shared listening socket (EPOLLEXCLUSIVE) instead of SO_REUSEPORT per reactor\n");
+    fprintf(stderr, "  -c max_conns  connection table size per reactor (default %d)\n", DEFAULT_MAX_CONNS);
+    fprintf(stderr, "  -i idle_ms  close connections with no reads or writes for this long, 0 = never (default %d)\n",
+            DEFAULT_IDLE_MS);
+    fprintf(stderr, "  -r read_ms  close connections that send nothing this long after accept, 0 = use -i (default %d)\n",
+            DEFAULT_READ_MS);
+    fprintf(stderr, "  -u host:port  relay every connection to this upstream instead of echoing (epoll engine only)\n");
+    fprintf(stderr, "  -z          zero-copy: move data with splice() through a per-connection pipe (epoll engine only)\n");
+    fprintf(stderr, "  -f framing  len (4-byte length prefix) or line (newline-delimited): parse requests, answer PING/ECHO/HASH,\n"
+                    "              one coalesced writev per connection per loop iteration (epoll engine only)\n");
+    fprintf(stderr, "  -w workers  with -f: run CPU-heavy commands (HASH) on this many worker threads, off the event loop\n"
+                    "              (max %d)\n", WORKER_MAX);
+    fprintf(stderr, "  -q          quiet: log warnings and errors only (build with LOG_LEVEL=WARN to compile the rest out)\n");
+    fprintf(stderr, "  -P          do not pin reactor threads to CPUs\n");
+}
 
-void handle_new_connection(int efd, int listen_fd) {
-    while (1) {
-        struct sockaddr in_addr;
-        socklen_t in_len = sizeof(in_addr);
-        int infd = accept(listen_fd, &in_addr, &in_len);
+// 第 i 个 reactor 绑到进程允许集合（taskset）里的第 i 个 CPU，超出后轮转
+static int pick_cpu(const cpu_set_t *allowed, int i) {
+    int n = CPU_COUNT(allowed);
+    int want = i % n;
 
-        if (infd == -1) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
-            perror("accept"); break;
-        }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, allowed) && want-- == 0) return cpu;
+    }
+    return -1;
+}
 
-        printf("[Info] Accepted connection on FD %d\n", infd);
-        make_socket_non_blocking(infd);
+static void print_stats_row(const char *name, int cpu, const reactor_t *r) {
+    printf("%-8s %4d %10" PRIu64 " %10" PRIu64 " %11" PRIu64 " %13" PRIu64 " %7" PRIu64 " %8" PRIu64 " %6" PRIu64
+           " %8" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %11" PRIu64 "\n",
+           name, cpu, r->accepted, r->closed, r->reads, r->bytes_in, r->stalls, r->rejected, r->stale, r->timeouts,
+           r->frames, r->offloaded, r->polls, r->syscalls);
+}
 
-        struct epoll_event event;
-        event.data.fd = infd;
-        event.events = EPOLLIN | EPOLLET; // 读事件 + 边缘触发
-        if (epoll_ctl(efd, EPOLL_CTL_ADD, infd, &event) == -1) {
-            perror("epoll_ctl");
-            abort();
-        }
+static void print_stats(reactor_t *reactors, int n) {
+    reactor_t total;
+    char name[16];
+
+    memset(&total, 0, sizeof(total));
+    printf("\n%-8s %4s %10s %10s %11s %13s %7s %8s %6s %8s %10s %10s %10s %11s\n", "reactor", "cpu", "accepted",
+           "closed", "reads", "bytes_in", "stalls", "rejected", "stale", "timeouts", "frames", "offloaded", "polls",
+           "syscalls");
+    for (int i = 0; i < n; i++) {
+        reactor_t *r = &reactors[i];
+        snprintf(name, sizeof(name), "%d", r->id);
+        print_stats_row(name, r->cpu, r);
+        total.accepted += r->accepted;
+        total.closed += r->closed;
+        total.reads += r->reads;
+        total.bytes_in += r->bytes_in;
+        total.stalls += r->stalls;
+        total.rejected += r->rejected;
+        total.stale += r->stale;
+        total.timeouts += r->timeouts;
+        total.frames += r->frames;
+        total.offloaded += r->offloaded;
+        total.offload_full += r->offload_full;
+        total.polls += r->polls;
+        total.syscalls += r->syscalls;
     }
+    print_stats_row("total", -1, &total);
+    if (total.offload_full > 0)
+        printf("%" PRIu64 " heavy requests ran on the event loop (worker queues full)\n", total.offload_full);
 }
 
-void handle_client_data(int client_fd) {
-    char buf[BUFFER_SIZE];
-    int done = 0;
-
-    while (1) {
-        ssize_t count = read(client_fd, buf, sizeof(buf));
-        if (count == -1) {
-            if (errno != EAGAIN) {
-                perror("read error");
-                done = 1;
-            }
-            break;
-        } else if (count == 0) {
-            done = 1; // 客户端关闭了连接
-            break;
-        }
+// 每个工作线程执行了多少请求，看负载是否均匀
+static void print_worker_stats(const worker_pool_t *p) {
+    printf("workers:");
+    for (int i = 0; i < p->nworkers; i++) printf(" %" PRIu64, p->workers[i].jobs);
+    printf(" jobs\n");
+}
 
-        // 打印收到的数据并原样写回（Echo Server）
-        printf("[Data] From FD %d: %.*s", client_fd, (int)count, buf);
-        write(client_fd, buf, count);
+// 解析 host:port（取最后一个冒号，IPv6 写成 [::1]:port），失败返回 NULL
+static struct addrinfo *resolve_upstream(const char *spec) {
+    char host[256];
+    const char *colon = strrchr(spec, ':');
+    struct addrinfo hints, *ai = NULL;
+
+    if (colon == NULL || colon == spec || (size_t)(colon - spec) >= sizeof(host)) return NULL;
+    memcpy(host, spec, colon - spec);
+    host[colon - spec] = '\0';
+    char *h = host;
+    if (h[0] == '[' && h[strlen(h) - 1] == ']') {
+        h[strlen(h) - 1] = '\0';
+        h++;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int s = getaddrinfo(h, colon + 1, &hints, &ai);
+    if (s != 0) {
+        fprintf(stderr, "getaddrinfo %s: %s\n", spec, gai_strerror(s));
+        return NULL;
     }
+    return ai;
+}
 
-    if (done) {
-        printf("[Info] Closed connection on FD %d\n", client_fd);
-        close(client_fd); 
+// 每个连接一个 fd，把软限制提到硬限制，免得几万连接时 accept 报 EMFILE
+static void raise_nofile_limit(void) {
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
     }
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s [port]\n", argv[0]);
+    int nthreads = 1, pin = 1, engine = ENGINE_EPOLL, shared = 0, opt;
+    int idle_ms = DEFAULT_IDLE_MS, read_ms = DEFAULT_READ_MS, zero_copy = 0, framing = FRAME_NONE, nworkers = 0;
+    const char *upstream_spec = NULL;
+    long max_conns = DEFAULT_MAX_CONNS;
+
+    while ((opt = getopt(argc, argv, "t:e:sc:i:r:u:zf:w:qP")) != -1) {
+        switch (opt) {
+        case 't': nthreads = atoi(optarg); break;
+        case 'e':
+            if (strcmp(optarg, "uring") == 0) engine = ENGINE_URING;
+            else if (strcmp(optarg, "epoll") == 0) engine = ENGINE_EPOLL;
+            else { usage(argv[0]); exit(EXIT_FAILURE); }
+            break;
+        case 's': shared = 1; break;
+        case 'c': max_conns = atol(optarg); break;
+        case 'i': idle_ms = atoi(optarg); break;
+        case 'r': read_ms = atoi(optarg); break;
+        case 'u': upstream_spec = optarg; break;
+        case 'z': zero_copy = 1; break;
+        case 'f':
+            if ((framing = frame_mode_parse(optarg)) == -1) { usage(argv[0]); exit(EXIT_FAILURE); }
+            break;
+        case 'w': nworkers = atoi(optarg); break;
+        case 'q': log_set_level(LOG_LVL_WARN); break;
+        case 'P': pin = 0; break;
+        default: usage(argv[0]); exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 1 || nthreads < 1 || max_conns < 1 || max_conns > CONN_MAX_CAPACITY || idle_ms < 0 ||
+        read_ms < 0 || (engine == ENGINE_URING && (upstream_spec || zero_copy || framing)) ||
+        (framing && (upstream_spec || zero_copy)) || nworkers < 0 || nworkers > WORKER_MAX || (nworkers && !framing)) {
+        usage(argv[0]);
         exit(EXIT_FAILURE);
     }
+    char *port = argv[optind];
 
-    int listen_fd = create_and_bind(argv[1]);
-    if (listen_fd == -1) abort();
+    struct addrinfo *upstream = NULL;
+    if (upstream_spec && (upstream = resolve_upstream(upstream_spec)) == NULL) {
+        fprintf(stderr, "bad upstream address %s\n", upstream_spec);
+        exit(EXIT_FAILURE);
+    }
 
-    if (make_socket_non_blocking(listen_fd) == -1) abort();
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        perror("sched_getaffinity");
+        pin = 0;
+    }
+
+    raise_nofile_limit();
+
+    // 对端关闭后再 write 会触发 SIGPIPE，忽略它，由 write 返回 EPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    // 工作线程继承这个信号掩码，SIGINT/SIGTERM 只由主线程 sigwait 处理
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+    // 事件循环只把日志记录放进本线程的环，格式化和 write 都由这个后台线程做
+    if (log_init(STDOUT_FILENO) == -1) exit(EXIT_FAILURE);
+
+    reactor_t *reactors = aligned_alloc(64, sizeof(reactor_t) * nthreads);
+    if (reactors == NULL) abort();
 
-    if (listen(listen_fd, SOMAXCONN) == -1) {
-        perror("listen");
-        abort();
+    // 工作线程不绑核，由调度器放到 reactor 之外空闲的 CPU 上
+    worker_pool_t *workers = NULL;
+    if (nworkers > 0 && (workers = worker_pool_create(nworkers, nthreads)) == NULL) {
+        fprintf(stderr, "cannot start %d worker threads\n", nworkers);
+        exit(EXIT_FAILURE);
     }
 
-    int efd = epoll_create1(0);
-    struct epoll_event event = { .data.fd = listen_fd, .events = EPOLLIN | EPOLLET };
-    epoll_ctl(efd, EPOLL_CTL_ADD, listen_fd, &event);
-
-    struct epoll_event *events = calloc(MAX_EVENTS, sizeof(event));
-    printf("Server started on port %s. Waiting for connections...\n", argv[1]);
-
-    while (1) {
-        int n = epoll_wait(efd, events, MAX_EVENTS, -1);
-        for (int i = 0; i < n; i++) {
-            if ((events[i].events & EPOLLERR) || (events[i].events & EPOLLHUP) || (!(events[i].events & EPOLLIN))) {
-                fprintf(stderr, "epoll error on FD %d\n", events[i].data.fd);
-                close(events[i].data.fd);
-                continue;
-            } else if (listen_fd == events[i].data.fd) {
-                handle_new_connection(efd, listen_fd);
-            } else {
-                handle_client_data(events[i].data.fd);
-            }
+    reactor_opts_t opts = { .port = port, .max_conns = max_conns, .engine = engine, .shared_fd = -1,
+                            .idle_ms = idle_ms, .read_ms = read_ms, .upstream = upstream, .splice = zero_copy,
+                            .framing = framing, .workers = workers };
+    if (shared) {
+        opts.shared_fd = reactor_listen(port, 0, engine);
+        if (opts.shared_fd == -1) {
+            fprintf(stderr, "cannot listen on port %s\n", port);
+            exit(EXIT_FAILURE);
         }
     }
 
-    free(events);
-    close(listen_fd);
+    for (int i = 0; i < nthreads; i++) {
+        if (reactor_init(&reactors[i], i, pin ? pick_cpu(&allowed, i) : -1, &opts) == -1) {
+            fprintf(stderr, "reactor %d: cannot listen on port %s\n", i, port);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < nthreads; i++) {
+        reactor_t *r = &reactors[i];
+        pthread_attr_t attr;
+
+        // 在创建时就设置亲和性，线程从第一条指令起就跑在自己的核上
+        pthread_attr_init(&attr);
+        if (r->cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(r->cpu, &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+        int err = pthread_create(&r->thread, &attr, reactor_run, r);
+        pthread_attr_destroy(&attr);
+        if (err != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    char mode[300];
+    if (upstream) snprintf(mode, sizeof(mode), "relaying to %s", upstream_spec);
+    else if (framing)
+        snprintf(mode, sizeof(mode), "%s-framed requests%s", framing == FRAME_LEN ? "length" : "line",
+                 workers ? " with a worker pool" : "");
+    else snprintf(mode, sizeof(mode), "echo");
+    printf("Server started on port %s with %d %s reactor(s), %s, %s via %s. Waiting for connections...\n", port,
+           nthreads, engine == ENGINE_URING ? "io_uring" : "epoll", shared ? "shared listener" : "SO_REUSEPORT", mode,
+           zero_copy ? "splice" : "read/write");
+    fflush(stdout);
+
+    int sig;
+    sigwait(&sigs, &sig);
+
+    // 先停工作线程：reactor 还在跑、还在取完成队列，工作线程不会卡在满的完成队列上；
+    // 停下之后排队的任务直接丢弃，不再执行。之后 reactor 提交的任务留在队列里由 worker_pool_destroy 释放
+    if (workers) worker_pool_stop(workers);
+    for (int i = 0; i < nthreads; i++) {
+        reactor_stop(&reactors[i]);
+        pthread_join(reactors[i].thread, NULL);
+    }
+    log_shutdown(); // 先把剩下的日志写完，统计表不会和日志交错
+    print_stats(reactors, nthreads);
+    if (log_dropped() > 0) printf("log records dropped: %" PRIu64 "\n", log_dropped());
+    // 缓冲池的峰值反映的是同时在途的数据量，和连接数无关
+    if (iobuf_peak() > 0)
+        printf("io buffers: peak %zu x %dKB = %zuKB, %zu still allocated\n", iobuf_peak(), IOBUF_SIZE / 1024,
+               iobuf_peak() * (IOBUF_SIZE / 1024), iobuf_allocated());
+    // 工作线程已经停了，不会再往 reactor 的完成队列和 wake_fd 里写，可以销毁 reactor
+    if (workers) {
+        print_worker_stats(workers);
+        worker_pool_destroy(workers);
+    }
+    for (int i = 0; i < nthreads; i++) reactor_destroy(&reactors[i]);
+    iobuf_pool_destroy();
+    if (opts.shared_fd != -1) close(opts.shared_fd);
+
+    if (upstream) freeaddrinfo(upstream);
+    free(reactors);
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
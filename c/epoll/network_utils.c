@@ -16,7 +16,7 @@ int make_socket_non_blocking(int sfd) {
     return 0;
 }
 
-int create_and_bind(char *port) {
+static int bind_port(char *port, int reuseport) {
     struct addrinfo hints;
     struct addrinfo *result, *rp;
     int s, sfd;
@@ -39,6 +39,11 @@ int create_and_bind(char *port) {
         // 设置端口复用，防止重启服务器时出现 Address already in use 错误
         int opt = 1;
         setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        // 多个 socket 绑定同一端口，由内核按四元组哈希把新连接分给它们
+        if (reuseport && setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1) {
+            close(sfd);
+            continue;
+        }
 
         s = bind(sfd, rp->ai_addr, rp->ai_addrlen);
         if (s == 0) break; // 绑定成功
@@ -50,4 +55,12 @@ int create_and_bind(char *port) {
     if (rp == NULL) return -1;
 
     return sfd;
-}
\ No newline at end of file
+}
+
+int create_and_bind(char *port) {
+    return bind_port(port, 0);
+}
+
+int create_and_bind_reuseport(char *port) {
+    return bind_port(port, 1);
+}
@@ -13,6 +13,9 @@
 // 创建、绑定并监听套接字
 int create_and_bind(char *port);
 
+// 同 create_and_bind()，但设置 SO_REUSEPORT：每个线程各建一个，内核在它们之间分发连接
+int create_and_bind_reuseport(char *port);
+
 // 设置套接字为非阻塞模式
 int make_socket_non_blocking(int sfd);
 
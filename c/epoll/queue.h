@@ -0,0 +1,122 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// 有界无锁队列，元素是指针，容量是 2 的幂。
+//   spsc_t：单生产者单消费者（reactor -> 工作线程），两边各自缓存对方的下标，通常不碰对方的 cache line
+//   mpsc_t：多生产者单消费者（所有工作线程 -> 一个 reactor），每个槽位带序号（Vyukov 的有界队列）
+
+typedef struct spsc {
+    uint64_t head __attribute__((aligned(64))); // 消费者写
+    uint64_t tail_cache;                        // 消费者看到的 tail，读空了才重新读
+    uint64_t tail __attribute__((aligned(64))); // 生产者写
+    uint64_t head_cache;                        // 生产者看到的 head，看起来满了才重新读
+    uint64_t mask __attribute__((aligned(64)));
+    void **slots;
+} spsc_t;
+
+static inline int spsc_init(spsc_t *q, uint32_t cap) {
+    q->head = q->tail = q->tail_cache = q->head_cache = 0;
+    q->mask = cap - 1;
+    q->slots = calloc(cap, sizeof(void *));
+    return q->slots ? 0 : -1;
+}
+
+static inline void spsc_destroy(spsc_t *q) {
+    free(q->slots);
+    q->slots = NULL;
+}
+
+// 满了返回 -1
+static inline int spsc_push(spsc_t *q, void *v) {
+    uint64_t t = q->tail;
+
+    if (t - q->head_cache > q->mask) {
+        q->head_cache = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+        if (t - q->head_cache > q->mask) return -1;
+    }
+    q->slots[t & q->mask] = v;
+    __atomic_store_n(&q->tail, t + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// 空了返回 NULL
+static inline void *spsc_pop(spsc_t *q) {
+    uint64_t h = q->head;
+
+    if (h == q->tail_cache) {
+        q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+        if (h == q->tail_cache) return NULL;
+    }
+    void *v = q->slots[h & q->mask];
+    __atomic_store_n(&q->head, h + 1, __ATOMIC_RELEASE);
+    return v;
+}
+
+// seq_cst：工作线程睡前的"先写 sleeping 再查队列"靠它不被重排到写之前
+static inline int spsc_empty(spsc_t *q) {
+    return __atomic_load_n(&q->tail, __ATOMIC_SEQ_CST) == q->head;
+}
+
+typedef struct mpsc_cell {
+    uint64_t seq;   // == 下标：空闲可写；== 下标 + 1：已写入可读
+    void *data;
+} mpsc_cell_t;
+
+typedef struct mpsc {
+    uint64_t tail __attribute__((aligned(64))); // 生产者 CAS 抢槽位
+    uint64_t head __attribute__((aligned(64))); // 只有消费者写
+    uint64_t mask __attribute__((aligned(64)));
+    mpsc_cell_t *cells;
+} mpsc_t;
+
+static inline int mpsc_init(mpsc_t *q, uint32_t cap) {
+    q->head = q->tail = 0;
+    q->mask = cap - 1;
+    q->cells = malloc(cap * sizeof(mpsc_cell_t));
+    if (q->cells == NULL) return -1;
+    for (uint32_t i = 0; i < cap; i++) q->cells[i].seq = i;
+    return 0;
+}
+
+static inline void mpsc_destroy(mpsc_t *q) {
+    free(q->cells);
+    q->cells = NULL;
+}
+
+// 满了返回 -1
+static inline int mpsc_push(mpsc_t *q, void *v) {
+    uint64_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    mpsc_cell_t *cell;
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        int64_t diff = (int64_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (diff < 0) {
+            return -1; // 消费者还没取走上一圈的数据
+        } else {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+    cell->data = v;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// 空了（或下一个槽位的生产者还没写完）返回 NULL
+static inline void *mpsc_pop(mpsc_t *q) {
+    uint64_t pos = q->head;
+    mpsc_cell_t *cell = &q->cells[pos & q->mask];
+
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) return NULL;
+    void *v = cell->data;
+    __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    q->head = pos + 1;
+    return v;
+}
+
+#endif
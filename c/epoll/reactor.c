@@ -0,0 +1,645 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "network_utils.h"
+#include "conn.h"
+#include "log.h"
+#include "reactor.h"
+
+__thread uint64_t t_syscalls;
+
+// 只有本线程写统计字段，不需要 lock 前缀的原子加，relaxed store 足够让主线程读到完整值
+#define STAT_ADD(r, field, n) __atomic_store_n(&(r)->field, (r)->field + (n), __ATOMIC_RELAXED)
+
+static void on_conn_timeout(tmr_t *t, void *opaque, int id);
+
+// 数据流向：回显时读到的数据写回自己，转发时写给对端。两边对称，所以写给 c 的数据也来自 conn_dst(c)
+static inline conn_t *conn_dst(conn_t *c) {
+    return c->peer ? c->peer : c;
+}
+
+static int add_connection(reactor_t *r, conn_t *c) {
+    struct epoll_event event = { .events = c->events, .data.u64 = conn_token(c) };
+
+    t_syscalls++;
+    if (epoll_ctl(r->efd, EPOLL_CTL_ADD, c->fd, &event) == -1) {
+        LOG_ERROR("epoll_ctl: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// 转发模式：为客户端连接发起到上游的非阻塞 connect，连上之前上游连接只关心 EPOLLOUT（连接完成）。
+// 超时定时器只挂在客户端连接上，两边任何一边有活动都算活动。
+static conn_t *connect_upstream(reactor_t *r, conn_t *c) {
+    const struct addrinfo *ai = r->upstream;
+    int fd = socket(ai->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    t_syscalls++;
+    if (fd == -1) {
+        LOG_WARN("socket: %s", strerror(errno));
+        return NULL;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    t_syscalls += 2;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == -1 && errno != EINPROGRESS) {
+        LOG_WARN("connect upstream: %s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    conn_t *u = conn_alloc(&r->conns, fd);
+    if (u == NULL) {
+        close(fd);
+        return NULL;
+    }
+    u->connecting = 1;
+    u->events = EPOLLIN | EPOLLOUT | EPOLLET;
+    tmr_init(&u->timer, "upstream", NULL, NULL, (int)u->idx);
+    if (add_connection(r, u) == -1) {
+        close(fd);
+        conn_free(&r->conns, u);
+        return NULL;
+    }
+    c->peer = u;
+    u->peer = c;
+    return u;
+}
+
+// 监听套接字是水平触发的：一次最多 accept ACCEPT_BATCH 个，没取完的下一轮 epoll_wait 还会报告。
+// accept4 直接带上 SOCK_NONBLOCK，TCP_NODELAY 从监听套接字继承，每个连接只剩 accept4 + epoll_ctl 两次系统调用。
+static void handle_new_connection(reactor_t *r) {
+    for (int n = 0; n < ACCEPT_BATCH; n++) {
+        int infd = accept4(r->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        t_syscalls++;
+
+        if (infd == -1) {
+            // 共享监听套接字时别的 reactor 可能先取走了，EAGAIN 很正常
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            LOG_WARN("accept4: %s", strerror(errno)); break;
+        }
+
+        LOG_INFO("Reactor %d accepted connection on FD %d", r->id, infd);
+
+        conn_t *c = conn_alloc(&r->conns, infd);
+        if (c == NULL) {
+            close(infd); // 连接表满了
+            STAT_ADD(r, rejected, 1);
+            continue;
+        }
+        c->events = EPOLLIN | EPOLLET; // 读事件 + 边缘触发；EPOLLOUT 只在有积压时才注册
+        if (add_connection(r, c) == -1) {
+            close(infd);
+            conn_free(&r->conns, c);
+            continue;
+        }
+        if (r->upstream && connect_upstream(r, c) == NULL) {
+            close(infd); // 上游连不上或连接表满了，客户端直接断开
+            conn_free(&r->conns, c);
+            STAT_ADD(r, rejected, 1);
+            continue;
+        }
+        reactor_conn_timer_start(r, c, on_conn_timeout, r);
+        STAT_ADD(r, accepted, 1);
+    }
+}
+
+static void close_one(reactor_t *r, conn_t *c) {
+    LOG_INFO("Reactor %d closed connection on FD %d", r->id, c->fd);
+    tmr_stop(&r->timers, &c->timer);
+    close(c->fd); // close 会自动把 fd 从 epoll 中移除
+    t_syscalls++;
+    conn_free(&r->conns, c);
+    STAT_ADD(r, closed, 1);
+}
+
+// 转发时两端一起关；对端在同一批里的事件会因为 gen 变化被当作过期事件丢掉
+static void close_connection(reactor_t *r, conn_t *c) {
+    conn_t *p = c->peer;
+
+    if (p) {
+        p->peer = c->peer = NULL;
+        close_one(r, p);
+    }
+    close_one(r, c);
+}
+
+// 读到 EAGAIN、对端关闭或输出积压到高水位为止，读到的数据原样写给 conn_dst(c)（回显或转发）。
+// readv 读进 c 的输入链表（一次最多 READ_IOV_BUFS 块，64KB），读到的块整块挂到目标的输出链表上，不拷贝。
+// 目标原来没有积压时立即 writev，有积压时只排队，等 EPOLLOUT，保证字节顺序不乱。
+static int pump_rw(reactor_t *r, conn_t *c) {
+    conn_t *d = conn_dst(c);
+
+    while (d->out.bytes < OUT_HIGH_WATER) {
+        ssize_t count = iochain_readv(&c->in, c->fd, READ_IOV_BUFS);
+        t_syscalls++;
+        if (count == -1) {
+            if (errno == EAGAIN) return 0;
+            LOG_INFO("read error on FD %d: %s", c->fd, strerror(errno));
+            return -1;
+        } else if (count == 0) {
+            c->eof = 1; // 对方关闭了写方向，发完积压的数据再关
+            return 0;
+        }
+        STAT_ADD(r, reads, 1);
+        STAT_ADD(r, bytes_in, count);
+        c->seen_data = 1;
+        LOG_DEBUG("[Data] From FD %d: %.*s", c->fd, (int)c->in.head->end, c->in.head->data);
+
+        int idle = d->out.bytes == 0;
+        iochain_move(&d->out, &c->in);
+        if (idle && !d->connecting && conn_flush(d) == -1) return -1;
+    }
+
+    // 套接字里可能还有数据，但边缘触发不会再通知；等输出降到低水位时主动再读
+    c->read_paused = 1;
+    STAT_ADD(r, stalls, 1);
+    return 0;
+}
+
+// 零拷贝：socket -> c 的管道 -> conn_dst(c)，数据只在内核里的页之间移动，不进用户态。
+// 管道里有数据就先往外送，清空之后才再从套接字读，所以读时管道总是空的，
+// 这时的 EAGAIN 只可能是套接字读空了（管道满也会返回 EAGAIN，两者没法区分）。
+// 往外送不动（EAGAIN）就暂停读，等目标的 EPOLLOUT 再接着送、接着读。
+static int pump_splice(reactor_t *r, conn_t *c) {
+    conn_t *d = conn_dst(c);
+
+    if (c->pipe_w == -1 && conn_open_pipe(c, SPLICE_PIPE_SIZE) == -1) {
+        LOG_ERROR("pipe2: %s", strerror(errno));
+        return -1;
+    }
+    for (;;) {
+        if (c->pipe_bytes > 0) {
+            if (d->connecting) {
+                c->read_paused = 1;
+                return 0;
+            }
+            ssize_t n = splice(c->pipe_r, NULL, d->fd, NULL, c->pipe_bytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            t_syscalls++;
+            if (n == -1) {
+                if (errno != EAGAIN) return -1;
+                if (!c->read_paused) STAT_ADD(r, stalls, 1);
+                c->read_paused = 1;
+                return 0;
+            }
+            c->pipe_bytes -= n;
+            continue;
+        }
+        c->read_paused = 0;
+        if (c->eof) return 0;
+
+        ssize_t n = splice(c->fd, NULL, c->pipe_w, NULL, c->pipe_cap, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        t_syscalls++;
+        if (n == -1) {
+            if (errno == EAGAIN) return 0;
+            LOG_INFO("splice error on FD %d: %s", c->fd, strerror(errno));
+            return -1;
+        } else if (n == 0) {
+            c->eof = 1;
+            return 0;
+        }
+        STAT_ADD(r, reads, 1);
+        STAT_ADD(r, bytes_in, n);
+        c->seen_data = 1;
+        LOG_DEBUG("[Data] From FD %d: %zd bytes spliced", c->fd, n);
+        c->pipe_bytes += n;
+    }
+}
+
+// 登记到本轮的待发送列表，本轮末尾由 flush_pending() 统一 writev；已登记过的不重复登记
+static int defer_flush(reactor_t *r, conn_t *c) {
+    if (c->flush_pending) return 0;
+    if (r->npending == r->pending_cap) {
+        uint32_t cap = r->pending_cap ? r->pending_cap * 2 : MAX_EVENTS;
+        uint64_t *p = realloc(r->pending, cap * sizeof(*p));
+        if (p == NULL) return -1;
+        r->pending = p;
+        r->pending_cap = cap;
+    }
+    r->pending[r->npending++] = conn_token(c);
+    c->flush_pending = 1;
+    return 0;
+}
+
+typedef struct offload_ctx {
+    reactor_t *r;
+    conn_t *c;
+} offload_ctx_t;
+
+// 把一个 heavy 请求交给工作线程：参数拷进任务，任务里只带连接的 token，连接仍归本线程。
+// 提交队列全满时返回 0，由 frame_process 就地执行
+static int offload_submit(void *opaque, const frame_cmd_t *cmd, const char *arg, size_t len) {
+    offload_ctx_t *ctx = opaque;
+    reactor_t *r = ctx->r;
+    worker_job_t *job = malloc(sizeof(*job) + len);
+
+    if (job == NULL) return -1;
+    job->token = conn_token(ctx->c);
+    job->cq = &r->cq;
+    job->fn = cmd->fn;
+    job->len = len;
+    memcpy(job->arg, arg, len);
+    int w = worker_submit(r->workers, r->id, &r->next_worker, job);
+    if (w == -1) {
+        free(job);
+        STAT_ADD(r, offload_full, 1);
+        return 0;
+    }
+    r->kick |= (uint64_t)1 << w;
+    ctx->c->offloaded = 1;
+    STAT_ADD(r, offloaded, 1);
+    return 1;
+}
+
+// 分帧模式：先处理输入链表里剩下的完整请求（上次因高水位停下时留下的），再读；
+// 每次 readv 之后把读到的所有完整请求都处理掉，回复只追加到输出链表，不在这里写。
+// 有请求交给了工作线程就停下，等回复回来再从这里继续
+static int pump_framed(reactor_t *r, conn_t *c) {
+    offload_ctx_t ctx = { r, c };
+    frame_offload_t off = { offload_submit, &ctx };
+
+    for (;;) {
+        if (c->offloaded) return 0; // 套接字里的数据留到回复回来之后再读
+        int n = frame_process(r->framing, &c->in, &c->out, OUT_HIGH_WATER, &c->frame_scan, r->frame_buf,
+                              r->workers ? &off : NULL);
+        if (n == -1) {
+            LOG_INFO("bad frame or out of memory on FD %d", c->fd);
+            return -1;
+        }
+        if (n > 0) {
+            STAT_ADD(r, frames, n);
+            if (defer_flush(r, c) == -1) return -1;
+        }
+        if (c->out.bytes >= OUT_HIGH_WATER) {
+            c->read_paused = 1;
+            STAT_ADD(r, stalls, 1);
+            return 0;
+        }
+        if (c->eof) return 0;
+
+        ssize_t count = iochain_readv(&c->in, c->fd, READ_IOV_BUFS);
+        t_syscalls++;
+        if (count == -1) {
+            if (errno == EAGAIN) return 0;
+            LOG_INFO("read error on FD %d: %s", c->fd, strerror(errno));
+            return -1;
+        } else if (count == 0) {
+            c->eof = 1; // 不完整的尾巴丢掉，回复发完就关
+            return 0;
+        }
+        STAT_ADD(r, reads, 1);
+        STAT_ADD(r, bytes_in, count);
+        c->seen_data = 1;
+        LOG_DEBUG("[Data] From FD %d: %zd bytes", c->fd, count);
+    }
+}
+
+static int pump(reactor_t *r, conn_t *c) {
+    if (r->splice) return pump_splice(r, c);
+    return r->framing ? pump_framed(r, c) : pump_rw(r, c);
+}
+
+// d 可写了：先确认上游 connect 完成，再把发给 d 的积压送出去，积压降下来后恢复来源的读
+static int handle_writable(reactor_t *r, conn_t *d) {
+    conn_t *src = conn_dst(d);
+
+    if (d->connecting) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        t_syscalls++;
+        if (getsockopt(d->fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err != 0) {
+            LOG_WARN("connect upstream: %s", strerror(err ? err : errno));
+            return -1;
+        }
+        d->connecting = 0;
+    }
+    if (r->splice) return src->pipe_bytes > 0 ? pump_splice(r, src) : 0;
+
+    if (conn_flush(d) == -1) return -1;
+    if (src->read_paused && d->out.bytes <= OUT_LOW_WATER) {
+        src->read_paused = 0;
+        return pump(r, src);
+    }
+    return 0;
+}
+
+// 一个方向的数据是否都已交给目标：零拷贝看来源的管道，否则看目标的输出链表
+static int conn_drained(reactor_t *r, conn_t *c) {
+    return r->splice ? c->pipe_bytes == 0 : conn_dst(c)->out.bytes == 0;
+}
+
+// 有积压或正在 connect 才关心 EPOLLOUT，暂停读时不关心 EPOLLIN；只有变化时才 EPOLL_CTL_MOD
+static int update_events(reactor_t *r, conn_t *c) {
+    uint32_t want = EPOLLET;
+
+    if (!c->read_paused && !c->eof) want |= EPOLLIN;
+    if (c->connecting || !conn_drained(r, conn_dst(c))) want |= EPOLLOUT;
+    if (want == c->events) return 0;
+
+    struct epoll_event event = { .events = want, .data.u64 = conn_token(c) };
+    t_syscalls++;
+    if (epoll_ctl(r->efd, EPOLL_CTL_MOD, c->fd, &event) == -1) return -1;
+    c->events = want;
+    return 0;
+}
+
+// 对方关闭写方向后：回显时发完积压就关；转发时把 EOF 传给目标（shutdown 写方向），两个方向都结束再一起关。
+// 返回 1 表示连接已经关掉
+static int finish_direction(reactor_t *r, conn_t *c) {
+    if (!c->eof || c->fwd_done || c->offloaded || !conn_drained(r, c)) return 0;
+    if (c->peer == NULL) {
+        close_connection(r, c);
+        return 1;
+    }
+    c->fwd_done = 1;
+    shutdown(c->peer->fd, SHUT_WR);
+    t_syscalls++;
+    if (c->peer->fwd_done) {
+        close_connection(r, c);
+        return 1;
+    }
+    return 0;
+}
+
+static void handle_connection_event(reactor_t *r, conn_t *c, uint32_t events) {
+    conn_t *p = c->peer;
+
+    if (events & EPOLLERR) {
+        LOG_INFO("epoll error on FD %d", c->fd);
+        goto close;
+    }
+    // 两个方向都关了；套接字里可能还有没读的数据，当作可读处理，读到 EOF 或错误为止
+    if (events & EPOLLHUP) events |= EPOLLIN;
+    reactor_touch(r, c);
+    if (p) reactor_touch(r, p);
+
+    if (events & EPOLLOUT) {
+        if (handle_writable(r, c) == -1) goto close;
+    }
+    if ((events & EPOLLIN) && !c->read_paused && !c->eof) {
+        if (pump(r, c) == -1) goto close;
+    }
+
+    if (finish_direction(r, c)) return;
+    if (p && finish_direction(r, p)) return;
+    if (c->flush_pending) return; // 回复在本轮末尾统一发，发完再调整关心的事件
+    if (update_events(r, c) == -1) goto close;
+    if (p && update_events(r, p) == -1) goto close;
+    return;
+
+close:
+    close_connection(r, c);
+}
+
+// 本轮末尾：每个有新回复的连接一次 writev 把攒下的回复全部发出去。
+// 发送时恢复读又产生的回复会再次登记，留到下一轮（那一轮 epoll_wait 不等待），一个连接不会独占本轮
+static void flush_pending(reactor_t *r) {
+    uint32_t n = r->npending;
+
+    for (uint32_t i = 0; i < n; i++) {
+        conn_t *c = conn_lookup(&r->conns, r->pending[i]);
+        if (c == NULL) continue; // 本轮里已经关掉了
+        c->flush_pending = 0;
+        if (handle_writable(r, c) == -1) {
+            close_connection(r, c);
+            continue;
+        }
+        if (finish_direction(r, c) || c->flush_pending) continue;
+        if (update_events(r, c) == -1) close_connection(r, c);
+    }
+    r->npending -= n;
+    memmove(r->pending, r->pending + n, r->npending * sizeof(*r->pending));
+}
+
+// 被 wake_fd 唤醒：取出工作线程做完的请求，回复追加到连接的输出链表，本轮末尾和其它回复一起发；
+// 再接着处理这个连接等待期间留在输入链表和套接字里的请求。连接已经关掉的直接丢弃
+static void handle_completions(reactor_t *r) {
+    worker_job_t *job;
+    uint64_t v;
+
+    t_syscalls++;
+    if (read(r->wake_fd, &v, sizeof(v)) == -1 && errno != EAGAIN) LOG_WARN("eventfd read: %s", strerror(errno));
+    worker_cq_rearm(&r->cq);
+    while ((job = worker_cq_pop(&r->cq)) != NULL) {
+        conn_t *c = conn_lookup(&r->conns, job->token);
+        if (c == NULL) {
+            STAT_ADD(r, stale, 1);
+            free(job);
+            continue;
+        }
+        c->offloaded = 0;
+        reactor_touch(r, c);
+        int rc = frame_reply_append(r->framing, &job->reply, &c->out);
+        free(job);
+        if (rc == -1 || defer_flush(r, c) == -1 || (!c->read_paused && pump_framed(r, c) == -1)) {
+            LOG_INFO("bad frame or out of memory on FD %d", c->fd);
+            close_connection(r, c);
+        }
+    }
+}
+
+static void on_conn_timeout(tmr_t *t, void *opaque, int id) {
+    reactor_t *r = opaque;
+    conn_t *c = &r->conns.conns[id];
+
+    (void)t;
+    if (!reactor_conn_timer_expired(r, c)) return;
+    LOG_INFO("Reactor %d: FD %d timed out", r->id, c->fd);
+    STAT_ADD(r, timeouts, 1);
+    close_connection(r, c);
+}
+
+// 还没收到过数据时用读超时（没启用就用空闲超时），之后用空闲超时；0 表示不超时
+static int64_t conn_timeout_us(const reactor_t *r, const conn_t *c) {
+    return (!c->seen_data && r->read_us > 0) ? r->read_us : r->idle_us;
+}
+
+void reactor_conn_timer_start(reactor_t *r, conn_t *c, tmr_callback_fn cb, void *opaque) {
+    int64_t us;
+
+    tmr_init(&c->timer, "conn", cb, opaque, (int)c->idx);
+    c->last_active = r->now;
+    us = conn_timeout_us(r, c);
+    if (us > 0) tmr_start(&r->timers, &c->timer, us);
+}
+
+int reactor_conn_timer_expired(reactor_t *r, conn_t *c) {
+    int64_t us = conn_timeout_us(r, c);
+
+    if (us == 0) return 0; // 收到数据后只剩读超时，而空闲超时没启用
+    int64_t left = c->last_active + us - r->now;
+    if (left <= 0) return 1;
+    tmr_start(&r->timers, &c->timer, left);
+    return 0;
+}
+
+int reactor_run_timers(reactor_t *r) {
+    r->now = tmr_now();
+    if (tmr_exec_max(&r->timers, TIMER_BUDGET) >= TIMER_BUDGET) return 0; // 还有到期的，下一轮不等待
+    return tmr_poll_timeout(&r->timers);
+}
+
+int reactor_listen(char *port, int reuseport, int engine) {
+    int fd = reuseport ? create_and_bind_reuseport(port) : create_and_bind(port);
+    if (fd == -1) return -1;
+
+    // 回显是一段段小 write，关掉 Nagle，否则和对端的延迟 ACK 叠加会卡 40ms
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // io_uring 自己处理等待，监听套接字保持阻塞模式（非阻塞 fd 上的请求会直接返回 EAGAIN）
+    if ((engine == ENGINE_EPOLL && make_socket_non_blocking(fd) == -1) || listen(fd, SOMAXCONN) == -1) {
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int reactor_init(reactor_t *r, int id, int cpu, const reactor_opts_t *opts) {
+    memset(r, 0, sizeof(*r));
+    r->id = id;
+    r->cpu = cpu;
+    r->engine = opts->engine;
+    r->efd = r->listen_fd = r->wake_fd = -1;
+    r->idle_us = (int64_t)opts->idle_ms * 1000;
+    r->read_us = (int64_t)opts->read_ms * 1000;
+    r->upstream = opts->upstream;
+    r->splice = opts->splice;
+    r->framing = opts->framing;
+    r->workers = opts->workers;
+    tmr_ctx_init(&r->timers);
+
+    if (conn_slab_init(&r->conns, opts->max_conns) == -1) {
+        perror("conn_slab_init");
+        return -1;
+    }
+    if (r->framing && (r->frame_buf = malloc(FRAME_SCRATCH)) == NULL) {
+        perror("malloc");
+        goto fail;
+    }
+
+    if (opts->shared_fd >= 0) {
+        r->listen_fd = opts->shared_fd;
+    } else {
+        // 每个 reactor 自己的监听套接字，内核按四元组哈希把新连接分到各个 accept 队列
+        r->listen_fd = reactor_listen(opts->port, 1, opts->engine);
+        if (r->listen_fd == -1) goto fail;
+        r->owns_listen = 1;
+    }
+
+    if (r->engine == ENGINE_URING) {
+        r->wake_fd = eventfd(0, 0);
+        if (r->wake_fd == -1) {
+            perror("eventfd");
+            goto fail;
+        }
+        return 0;
+    }
+
+    r->efd = epoll_create1(0);
+    r->wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (r->efd == -1 || r->wake_fd == -1) {
+        perror("epoll_create1/eventfd");
+        goto fail;
+    }
+    if (r->workers && worker_cq_init(&r->cq, r->wake_fd) == -1) {
+        perror("worker_cq_init");
+        goto fail;
+    }
+
+    // 监听套接字用水平触发（配合 ACCEPT_BATCH）；共享时加 EPOLLEXCLUSIVE，
+    // 新连接只唤醒其中一个（或少数几个）reactor，而不是所有线程一起醒来抢
+    struct epoll_event event = { .data.u64 = TOKEN_LISTEN, .events = EPOLLIN };
+    if (opts->shared_fd >= 0) event.events |= EPOLLEXCLUSIVE;
+    if (epoll_ctl(r->efd, EPOLL_CTL_ADD, r->listen_fd, &event) == -1) {
+        perror("epoll_ctl");
+        goto fail;
+    }
+    event.data.u64 = TOKEN_WAKE;
+    event.events = EPOLLIN;
+    if (epoll_ctl(r->efd, EPOLL_CTL_ADD, r->wake_fd, &event) == -1) {
+        perror("epoll_ctl");
+        goto fail;
+    }
+    return 0;
+
+fail:
+    reactor_destroy(r);
+    return -1;
+}
+
+void *reactor_run(void *arg) {
+    reactor_t *r = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    if (r->engine == ENGINE_URING) return reactor_run_uring(r);
+
+    while (!r->stop) {
+        __atomic_store_n(&r->syscalls, t_syscalls, __ATOMIC_RELAXED);
+        // 等待时间由时间轮决定：到最近一个定时器到期为止，没有定时器就一直等
+        int timeout = reactor_run_timers(r);
+        if (r->npending > 0) timeout = 0; // 上一轮还有没发的回复
+        STAT_ADD(r, polls, 1);
+        t_syscalls++;
+        int n = epoll_wait(r->efd, events, MAX_EVENTS, timeout);
+        r->now = tmr_now();
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("reactor %d: epoll_wait: %s", r->id, strerror(errno));
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            uint64_t token = events[i].data.u64;
+
+            if (token == TOKEN_WAKE) {
+                if (r->workers) handle_completions(r);
+                continue; // 否则是 r->stop 已置位，处理完这一批就退出
+            } else if (token == TOKEN_LISTEN) {
+                handle_new_connection(r);
+            } else {
+                // 同一批事件里，前面的处理可能已经关掉这个连接，槽位甚至已经被新连接复用
+                conn_t *c = conn_lookup(&r->conns, token);
+                if (c == NULL) {
+                    STAT_ADD(r, stale, 1);
+                    continue;
+                }
+                handle_connection_event(r, c, events[i].events);
+            }
+        }
+        if (r->npending > 0) flush_pending(r);
+        if (r->kick) {
+            t_syscalls += worker_kick(r->workers, r->kick);
+            r->kick = 0;
+        }
+    }
+    __atomic_store_n(&r->syscalls, t_syscalls, __ATOMIC_RELAXED);
+    iobuf_thread_release(); // 本线程缓存的空闲块还给全局池，连接手里的块由 reactor_destroy 归还
+    return NULL;
+}
+
+void reactor_stop(reactor_t *r) {
+    uint64_t one = 1;
+
+    r->stop = 1;
+    if (write(r->wake_fd, &one, sizeof(one)) == -1) perror("eventfd write");
+}
+
+void reactor_destroy(reactor_t *r) {
+    if (r->wake_fd != -1) close(r->wake_fd);
+    if (r->efd != -1) close(r->efd);
+    if (r->listen_fd != -1 && r->owns_listen) close(r->listen_fd);
+    r->efd = r->listen_fd = r->wake_fd = -1;
+    conn_slab_destroy(&r->conns);
+    worker_cq_destroy(&r->cq);
+    free(r->frame_buf);
+    free(r->pending);
+    r->frame_buf = NULL;
+    r->pending = NULL;
+}
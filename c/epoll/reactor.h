@@ -0,0 +1,121 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <netdb.h>
+#include "conn.h"
+#include "frame.h"
+#include "timer.h"
+#include "worker.h"
+
+#define MAX_EVENTS 64
+#define DEFAULT_MAX_CONNS 65536 // 每个 reactor 的连接表容量
+#define ACCEPT_BATCH 64         // 每次唤醒最多 accept 多少个连接，剩下的留到下一轮，不饿死已有连接
+#define DEFAULT_IDLE_MS 60000   // 空闲超时：这么久没有任何读写就关闭
+#define DEFAULT_READ_MS 10000   // 读超时：accept 之后这么久还没收到第一个字节就关闭
+#define TIMER_BUDGET 256        // 每轮最多处理多少个到期定时器，大批连接同时超时也不会卡住事件循环
+
+// epoll_event.data.u64 里监听/唤醒 fd 的 token，下标超出任何连接表容量
+#define TOKEN_LISTEN ((uint64_t)UINT32_MAX)
+#define TOKEN_WAKE ((uint64_t)UINT32_MAX - 1)
+
+enum { ENGINE_EPOLL, ENGINE_URING };
+
+typedef struct reactor_opts {
+    char *port;
+    uint32_t max_conns;  // 每个 reactor 的连接表容量
+    int engine;          // ENGINE_EPOLL / ENGINE_URING
+    int shared_fd;       // >= 0：所有 reactor 共用这个监听套接字（EPOLLEXCLUSIVE）；-1：各自建 SO_REUSEPORT 套接字
+    int idle_ms;         // 空闲超时，0 表示不启用
+    int read_ms;         // 读超时，0 表示不启用（只用空闲超时）
+    const struct addrinfo *upstream; // 非 NULL：转发模式，每个连接都连到这个上游地址；NULL：回显
+    int splice;          // 用 splice 经每连接的管道搬数据（零拷贝），否则 read/write
+    int framing;         // FRAME_NONE：原样回显字节流；FRAME_LEN / FRAME_LINE：分帧后按命令处理
+    worker_pool_t *workers; // 非 NULL：分帧模式下 CPU 密集的命令交给这个工作线程池
+} reactor_opts_t;
+
+// 一个 reactor = 一个线程 + 一个 epoll 实例（或 io_uring）+ 一个 SO_REUSEPORT 监听套接字。
+// 连接由哪个监听套接字 accept，就一直留在那个线程里，不做跨线程迁移。
+typedef struct reactor {
+    int id;
+    int cpu;        // 绑定的 CPU，-1 表示不绑定
+    int engine;     // ENGINE_EPOLL / ENGINE_URING
+    int efd;        // 仅 epoll 引擎
+    int listen_fd;
+    int owns_listen;    // 监听套接字是自己建的（SO_REUSEPORT），销毁时关闭
+    int wake_fd;    // eventfd，reactor_stop() 和工作线程用它唤醒 epoll_wait
+    volatile int stop;
+    pthread_t thread;
+    conn_slab_t conns;  // 本线程的连接表，只有本线程访问
+    tmr_ctx_t timers;   // 本线程的时间轮，挂着每个连接的超时定时器
+    int64_t now;        // 本轮开始时的时间（微秒），记录连接活动时不用每次都取时间
+    int64_t idle_us;
+    int64_t read_us;
+    const struct addrinfo *upstream;
+    int splice;
+    int framing;
+    char *frame_buf;    // 跨块请求的拼接缓冲区（FRAME_SCRATCH 字节），只在分帧模式下分配
+    uint64_t *pending;  // 本轮有新回复的连接（token），本轮末尾逐个 writev
+    uint32_t npending;
+    uint32_t pending_cap;
+    worker_pool_t *workers;
+    uint32_t next_worker; // 轮流提交到各个工作线程
+    uint64_t kick;        // 本轮提交过任务的工作线程，本轮末尾统一唤醒
+    worker_cq_t cq;       // 工作线程做完的请求，推进来后写 wake_fd 唤醒本线程
+
+    // 统计：只有本线程写，主线程用 relaxed 原子读
+    uint64_t accepted;
+    uint64_t closed;
+    uint64_t reads;
+    uint64_t bytes_in;
+    uint64_t stalls;    // 输出积压到高水位而暂停读的次数
+    uint64_t rejected;  // 连接表满而拒绝的连接
+    uint64_t stale;     // 连接已关闭/槽位已复用后才到达的过期事件
+    uint64_t timeouts;  // 因空闲/读超时关闭的连接
+    uint64_t frames;    // 分帧模式下处理的请求数
+    uint64_t offloaded; // 交给工作线程的请求数
+    uint64_t offload_full; // 提交队列全满、只好就地执行的请求数
+    uint64_t polls;     // epoll_wait / io_uring_enter 次数
+    uint64_t syscalls;  // 事件循环发起的系统调用总数（含 polls）
+} __attribute__((aligned(64))) reactor_t;
+
+// 本线程在事件循环里发起的系统调用次数，conn.c 的 writev 也计在这里
+extern __thread uint64_t t_syscalls;
+
+// 连接上有读写：只记下时间，不碰时间轮。定时器照旧在原来的截止时间到期，
+// 到期时再按 last_active 算出真正的截止时间，没到就把剩下的时间重新挂上。
+static inline void reactor_touch(reactor_t *r, conn_t *c) {
+    c->last_active = r->now;
+}
+
+// accept 之后启动连接的超时定时器；两种超时都没启用时什么也不做
+void reactor_conn_timer_start(reactor_t *r, conn_t *c, tmr_callback_fn cb, void *opaque);
+
+// 定时器到期时调用：连接期间有过活动就按剩余时间重新挂上并返回 0，真的超时返回 1
+int reactor_conn_timer_expired(reactor_t *r, conn_t *c);
+
+// 每轮等待之前调用：更新 r->now，执行最多 TIMER_BUDGET 个到期定时器，
+// 返回下一次等待的超时（毫秒，-1 表示没有定时器，0 表示还有到期的没处理完）
+int reactor_run_timers(reactor_t *r);
+
+// 创建监听套接字：reuseport 为真时设置 SO_REUSEPORT；epoll 引擎设为非阻塞，io_uring 引擎保持阻塞。
+// 同时打开 TCP_NODELAY，accept 出来的连接会继承，不用每个连接再 setsockopt 一次。失败返回 -1
+int reactor_listen(char *port, int reuseport, int engine);
+
+// 创建本 reactor 的监听套接字（或使用共享的）、epoll 实例（io_uring 在线程里创建）和连接表，失败返回 -1
+int reactor_init(reactor_t *r, int id, int cpu, const reactor_opts_t *opts);
+
+// 线程入口，arg 为 reactor_t *，直到 reactor_stop() 后返回
+void *reactor_run(void *arg);
+
+// io_uring 引擎的事件循环（reactor_uring.c），由 reactor_run 按 engine 调用
+void *reactor_run_uring(reactor_t *r);
+
+// 通知事件循环退出（可在其它线程调用）
+void reactor_stop(reactor_t *r);
+
+// 关闭所有连接、自己的监听套接字和 epoll 实例；线程须已退出
+void reactor_destroy(reactor_t *r);
+
+#endif
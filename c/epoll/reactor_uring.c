@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include "log.h"
+#include "uring.h"
+#include "reactor.h"
+
+// io_uring 引擎：同样的回显语义，但不再是“就绪通知 + read + write”：
+//   - 监听套接字上一个多发（multishot）accept，一个 SQE 持续产出新连接；
+//   - 每个连接一个多发 recv，内核从提供缓冲区环里自己挑一块收数据，CQE 带回 buffer id；
+//   - 收到的那块缓冲区直接作为 send 的数据源（不拷贝），同一连接上的多个 send 用 IOSQE_IO_LINK
+//     串成链，保证按顺序发出；send 完成后缓冲区放回环里；
+//   - 所有 SQE 攒到一轮末尾用一次 io_uring_enter 提交并等待完成。
+// 稳态下一次 io_uring_enter 处理一整批连接的收发，每条消息摊到的系统调用接近 0。
+
+#define UR_ENTRIES 4096
+#define UR_NBUFS 4096            // 提供缓冲区块数（2 的幂，≤ 32768）
+#define UR_BUF_SIZE 4096
+#define UR_BGID 0
+#define UR_MAX_CHAIN 32          // 一条 send 链最多多少个 SQE
+#define UR_CONN_MAX_BUFS 64      // 一个连接最多积压的缓冲块（256KB），超过就取消 recv，反压给客户端
+#define UR_CONN_RESUME_BUFS 16   // 积压降到这里以下再重新提交 recv
+#define UR_BID_NONE 0xffff
+
+enum { UR_ACCEPT = 1, UR_RECV, UR_SEND, UR_CANCEL, UR_WAKE, UR_TIMEOUT };
+
+// user_data：高 8 位操作类型，中间 24 位 gen，低 32 位连接下标
+#define UR_DATA(op, c) ((uint64_t)(op) << 56 | (uint64_t)((c)->gen & 0xffffff) << 32 | (c)->idx)
+#define UR_OP(data) ((unsigned)((data) >> 56))
+
+// io_uring 专用的连接状态，和 r->conns 按下标平行
+typedef struct ur_conn {
+    uint16_t send_head;    // 待发送缓冲块队列（经 next_bid 串起来），包括已提交还没完成的
+    uint16_t send_tail;
+    uint16_t queued;       // 队列中的块数
+    uint16_t inflight;     // 已提交还没完成的 send SQE
+    uint8_t recv_armed;    // 多发 recv 还活着
+    uint8_t recv_paused;   // 因积压取消了 recv
+    uint8_t eof;           // 对端关闭了写方向
+    uint8_t closing;       // 要关闭：等所有 SQE 完成后再 close
+    uint8_t shut;          // 已 shutdown，挂着的 recv/send 会很快带错误完成
+    uint8_t dirty;         // 已在本轮的 dirty 列表里
+    uint8_t starved;       // recv 因缓冲区耗尽（ENOBUFS）结束，已在 starved 列表里
+} ur_conn_t;
+
+typedef struct ur_engine {
+    reactor_t *r;
+    uring_t ring;
+    uring_buf_ring_t bufs;
+    ur_conn_t *uc;
+    uint16_t *next_bid;    // 缓冲块队列的链
+    uint16_t *buf_len;     // 每块收到的字节数
+    uint16_t *buf_off;     // 每块已发出的字节数
+    uint32_t *dirty;       // 本轮有变化、轮末需要处理的连接
+    uint32_t ndirty;
+    uint32_t *starved;     // 等缓冲区回收后重新提交 recv 的连接
+    uint32_t nstarved;
+    uint32_t recycled;     // 本轮放回环里的块数
+    uint64_t wake_val;
+    struct __kernel_timespec timeout_ts;
+    int timeout_armed;     // 有一个 IORING_OP_TIMEOUT 在等
+    int64_t timeout_deadline;
+} ur_engine_t;
+
+static conn_t *ur_lookup(ur_engine_t *e, uint64_t data) {
+    uint32_t idx = (uint32_t)data;
+
+    if (idx >= e->r->conns.fresh) return NULL;
+    conn_t *c = &e->r->conns.conns[idx];
+    if (c->fd == -1 || (c->gen & 0xffffff) != ((data >> 32) & 0xffffff)) return NULL;
+    return c;
+}
+
+static void ur_mark_dirty(ur_engine_t *e, conn_t *c) {
+    ur_conn_t *u = &e->uc[c->idx];
+
+    if (u->dirty) return;
+    u->dirty = 1;
+    e->dirty[e->ndirty++] = c->idx;
+}
+
+static void ur_recycle(ur_engine_t *e, uint16_t bid) {
+    uring_buf_ring_add(&e->bufs, bid);
+    e->recycled++;
+}
+
+static int ur_arm_accept(ur_engine_t *e) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&e->ring);
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = e->r->listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = (uint64_t)UR_ACCEPT << 56;
+    return 0;
+}
+
+static int ur_arm_wake(ur_engine_t *e) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&e->ring);
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = e->r->wake_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&e->wake_val;
+    sqe->len = sizeof(e->wake_val);
+    sqe->user_data = (uint64_t)UR_WAKE << 56;
+    return 0;
+}
+
+// 时间轮的下一次到期用一个纯超时 SQE 表示，它的完成事件让 io_uring_enter 按时返回。
+// 已经有一个不晚于它的在等就不再提交；更晚的那个到期时只是多醒一次。
+static void ur_arm_timeout(ur_engine_t *e, int ms) {
+    int64_t deadline = e->r->now + (int64_t)ms * 1000;
+
+    if (ms <= 0 || (e->timeout_armed && e->timeout_deadline <= deadline)) return;
+    struct io_uring_sqe *sqe = uring_get_sqe(&e->ring);
+    if (sqe == NULL) return;
+    // 内核在提交时就拷走了 timespec，下一次覆盖它是安全的
+    e->timeout_ts.tv_sec = ms / 1000;
+    e->timeout_ts.tv_nsec = (long long)(ms % 1000) * 1000000;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uint64_t)(uintptr_t)&e->timeout_ts;
+    sqe->len = 1;
+    sqe->user_data = (uint64_t)UR_TIMEOUT << 56;
+    e->timeout_armed = 1;
+    e->timeout_deadline = deadline;
+}
+
+static int ur_arm_recv(ur_engine_t *e, conn_t *c) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&e->ring);
+    if (sqe == NULL) return -1;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = UR_BGID;
+    sqe->user_data = UR_DATA(UR_RECV, c);
+    e->uc[c->idx].recv_armed = 1;
+    return 0;
+}
+
+static void ur_cancel_recv(ur_engine_t *e, conn_t *c) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&e->ring);
+    if (sqe == NULL) return;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = UR_DATA(UR_RECV, c);
+    sqe->user_data = (uint64_t)UR_CANCEL << 56;
+}
+
+// 从队头起把还没提交的块串成一条 IO_LINK 链提交。只在上一条链全部完成后调用，
+// 所以链里的第一个 SQE 就是队头，前一条链失败（短写、被取消）时从断点重发。
+static void ur_submit_sends(ur_engine_t *e, conn_t *c) {
+    ur_conn_t *u = &e->uc[c->idx];
+    struct io_uring_sqe *prev = NULL;
+    uint16_t bid = u->send_head;
+    unsigned want = u->queued < UR_MAX_CHAIN ? u->queued : UR_MAX_CHAIN;
+
+    // 整条链必须在同一次提交里：SQ 放不下就先把已有的提交掉，免得 uring_get_sqe 在链中间提交
+    if (uring_sq_space(&e->ring) < want) uring_submit_and_wait(&e->ring, 0);
+    for (int n = 0; bid != UR_BID_NONE && n < UR_MAX_CHAIN; n++, bid = e->next_bid[bid]) {
+        struct io_uring_sqe *sqe = uring_get_sqe(&e->ring);
+        if (sqe == NULL) break;
+        if (prev) prev->flags |= IOSQE_IO_LINK;
+        // MSG_WAITALL：没发完就算失败，链上后面的 send 会被取消，不会越过缺口先发出去
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = c->fd;
+        sqe->addr = (uint64_t)(uintptr_t)(uring_buf_addr(&e->bufs, bid) + e->buf_off[bid]);
+        sqe->len = e->buf_len[bid] - e->buf_off[bid];
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        sqe->user_data = UR_DATA(UR_SEND, c);
+        u->inflight++;
+        prev = sqe;
+    }
+}
+
+static void ur_close(ur_engine_t *e, conn_t *c) {
+    ur_conn_t *u = &e->uc[c->idx];
+
+    u->closing = 1;
+    if (!u->shut) {
+        // 让还挂着的 recv/send 尽快带错误完成；fd 要等它们都完成后才能关
+        u->shut = 1;
+        shutdown(c->fd, SHUT_RDWR);
+        t_syscalls++;
+    }
+    if (u->recv_armed || u->inflight) return;
+
+    while (u->send_head != UR_BID_NONE) {
+        uint16_t bid = u->send_head;
+        u->send_head = e->next_bid[bid];
+        ur_recycle(e, bid);
+    }
+    LOG_INFO("Reactor %d closed connection on FD %d", e->r->id, c->fd);
+    tmr_stop(&e->r->timers, &c->timer);
+    close(c->fd);
+    t_syscalls++;
+    conn_free(&e->r->conns, c);
+    __atomic_store_n(&e->r->closed, e->r->closed + 1, __ATOMIC_RELAXED);
+}
+
+static void ur_on_timeout(tmr_t *t, void *opaque, int id) {
+    ur_engine_t *e = opaque;
+    conn_t *c = &e->r->conns.conns[id];
+
+    (void)t;
+    if (e->uc[id].closing || !reactor_conn_timer_expired(e->r, c)) return;
+    LOG_INFO("Reactor %d: FD %d timed out", e->r->id, c->fd);
+    __atomic_store_n(&e->r->timeouts, e->r->timeouts + 1, __ATOMIC_RELAXED);
+    ur_close(e, c);
+}
+
+static void ur_on_accept(ur_engine_t *e, struct io_uring_cqe *cqe) {
+    reactor_t *r = e->r;
+
+    if (!(cqe->flags & IORING_CQE_F_MORE) && !r->stop) ur_arm_accept(e);
+    if (cqe->res < 0) {
+        LOG_WARN("accept: %s", strerror(-cqe->res));
+        return;
+    }
+
+    int fd = cqe->res;
+    conn_t *c = conn_alloc(&r->conns, fd);
+    if (c == NULL) {
+        close(fd); // 连接表满了
+        t_syscalls++;
+        __atomic_store_n(&r->rejected, r->rejected + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    LOG_INFO("Reactor %d accepted connection on FD %d", r->id, fd);
+
+    memset(&e->uc[c->idx], 0, sizeof(ur_conn_t));
+    e->uc[c->idx].send_head = e->uc[c->idx].send_tail = UR_BID_NONE;
+    reactor_conn_timer_start(r, c, ur_on_timeout, e);
+    ur_arm_recv(e, c);
+    __atomic_store_n(&r->accepted, r->accepted + 1, __ATOMIC_RELAXED);
+}
+
+static void ur_on_recv(ur_engine_t *e, conn_t *c, struct io_uring_cqe *cqe) {
+    ur_conn_t *u = &e->uc[c->idx];
+    reactor_t *r = e->r;
+
+    if (cqe->res > 0) {
+        uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+        if (u->closing) {
+            ur_recycle(e, bid);
+        } else {
+            e->buf_len[bid] = (uint16_t)cqe->res;
+            e->buf_off[bid] = 0;
+            e->next_bid[bid] = UR_BID_NONE;
+            if (u->send_tail == UR_BID_NONE) u->send_head = bid;
+            else e->next_bid[u->send_tail] = bid;
+            u->send_tail = bid;
+            u->queued++;
+            __atomic_store_n(&r->reads, r->reads + 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&r->bytes_in, r->bytes_in + cqe->res, __ATOMIC_RELAXED);
+            c->seen_data = 1;
+            reactor_touch(r, c);
+            LOG_DEBUG("[Data] From FD %d: %.*s", c->fd, cqe->res, uring_buf_addr(&e->bufs, bid));
+
+            if (u->queued >= UR_CONN_MAX_BUFS && (cqe->flags & IORING_CQE_F_MORE) && !u->recv_paused) {
+                u->recv_paused = 1;
+                ur_cancel_recv(e, c);
+                __atomic_store_n(&r->stalls, r->stalls + 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        u->recv_armed = 0;
+        if (cqe->res == 0) {
+            u->eof = 1; // 客户端关闭了写方向，发完积压的数据再关
+        } else if (cqe->res == -ENOBUFS) {
+            if (!u->starved) {
+                u->starved = 1;
+                e->starved[e->nstarved++] = c->idx;
+            }
+        } else if (cqe->res == -ECANCELED && u->recv_paused) {
+            // 等积压降下来再恢复
+        } else if (cqe->res < 0) {
+            if (!u->closing) LOG_INFO("recv on FD %d: %s", c->fd, strerror(-cqe->res));
+            u->closing = 1;
+        } else if (!u->closing) {
+            ur_arm_recv(e, c); // 多发 recv 被内核结束（例如 CQ 溢出），重新提交
+        }
+    }
+    ur_mark_dirty(e, c);
+}
+
+static void ur_on_send(ur_engine_t *e, conn_t *c, struct io_uring_cqe *cqe) {
+    ur_conn_t *u = &e->uc[c->idx];
+    uint16_t bid = u->send_head;
+
+    u->inflight--;
+    if (cqe->res > 0) reactor_touch(e->r, c);
+    if (cqe->res >= 0 && bid != UR_BID_NONE) {
+        e->buf_off[bid] += cqe->res;
+        if (e->buf_off[bid] == e->buf_len[bid]) {
+            u->send_head = e->next_bid[bid];
+            if (u->send_head == UR_BID_NONE) u->send_tail = UR_BID_NONE;
+            u->queued--;
+            ur_recycle(e, bid);
+        }
+    } else if (cqe->res != -ECANCELED) {
+        u->closing = 1; // EPIPE / ECONNRESET 等，对端已经不在了
+    }
+    ur_mark_dirty(e, c);
+}
+
+// 轮末处理有变化的连接：上一条 send 链完成后提交下一条，积压降下来后恢复 recv，该关的关掉
+static void ur_flush_dirty(ur_engine_t *e) {
+    for (uint32_t i = 0; i < e->ndirty; i++) {
+        conn_t *c = &e->r->conns.conns[e->dirty[i]];
+        ur_conn_t *u = &e->uc[c->idx];
+
+        u->dirty = 0;
+        if (c->fd == -1) continue;
+        if (u->closing || (u->eof && u->queued == 0 && u->inflight == 0)) {
+            ur_close(e, c);
+            continue;
+        }
+        if (u->inflight == 0 && u->queued > 0) ur_submit_sends(e, c);
+        if (u->recv_paused && !u->recv_armed && u->queued <= UR_CONN_RESUME_BUFS && !u->eof) {
+            u->recv_paused = 0;
+            ur_arm_recv(e, c);
+        }
+    }
+    e->ndirty = 0;
+
+    // 有缓冲区回到环里了，给因 ENOBUFS 停掉的连接重新提交 recv
+    if (e->recycled > 0) {
+        uring_buf_ring_publish(&e->bufs);
+        for (uint32_t i = 0; i < e->nstarved; i++) {
+            conn_t *c = &e->r->conns.conns[e->starved[i]];
+            ur_conn_t *u = &e->uc[c->idx];
+
+            u->starved = 0;
+            if (c->fd != -1 && !u->closing && !u->eof && !u->recv_armed && !u->recv_paused) ur_arm_recv(e, c);
+        }
+        e->nstarved = 0;
+        e->recycled = 0;
+    }
+}
+
+static void *ur_calloc(size_t n, size_t size) {
+    // 按连接数分配的平行数组用匿名映射，和连接表一样按需触及
+    void *p = mmap(NULL, n * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+void *reactor_run_uring(reactor_t *r) {
+    ur_engine_t e;
+    uint32_t cap = r->conns.cap;
+    int ret;
+
+    memset(&e, 0, sizeof(e));
+    e.r = r;
+    // SINGLE_ISSUER 要求创建和提交在同一个线程，所以在线程里创建
+    ret = uring_init(&e.ring, UR_ENTRIES);
+    if (ret < 0) {
+        fprintf(stderr, "reactor %d: io_uring_setup: %s\n", r->id, strerror(-ret));
+        return NULL;
+    }
+    ret = uring_buf_ring_init(&e.ring, &e.bufs, UR_BGID, UR_NBUFS, UR_BUF_SIZE);
+    if (ret < 0) {
+        fprintf(stderr, "reactor %d: provided buffer ring: %s\n", r->id, strerror(-ret));
+        uring_exit(&e.ring);
+        return NULL;
+    }
+    e.uc = ur_calloc(cap, sizeof(ur_conn_t));
+    e.dirty = ur_calloc(cap, sizeof(uint32_t));
+    e.starved = ur_calloc(cap, sizeof(uint32_t));
+    e.next_bid = calloc(UR_NBUFS, sizeof(uint16_t));
+    e.buf_len = calloc(UR_NBUFS, sizeof(uint16_t));
+    e.buf_off = calloc(UR_NBUFS, sizeof(uint16_t));
+    if (!e.uc || !e.dirty || !e.starved || !e.next_bid || !e.buf_len || !e.buf_off) abort();
+
+    ur_arm_accept(&e);
+    ur_arm_wake(&e);
+
+    while (!r->stop) {
+        // 到期的定时器先处理，等待时间由时间轮决定；还有到期的没处理完就不等
+        int timeout = reactor_run_timers(r);
+        ur_arm_timeout(&e, timeout);
+        ret = uring_submit_and_wait(&e.ring, timeout == 0 ? 0 : 1);
+        r->now = tmr_now();
+        if (ret < 0 && ret != -EBUSY && ret != -EAGAIN) {
+            LOG_ERROR("reactor %d: io_uring_enter: %s", r->id, strerror(-ret));
+            break;
+        }
+
+        unsigned head, n = uring_cq_ready(&e.ring, &head);
+        for (unsigned i = 0; i < n; i++) {
+            struct io_uring_cqe *cqe = uring_cqe_at(&e.ring, head + i);
+            uint64_t data = cqe->user_data;
+            conn_t *c;
+
+            switch (UR_OP(data)) {
+            case UR_ACCEPT:
+                ur_on_accept(&e, cqe);
+                break;
+            case UR_RECV:
+            case UR_SEND:
+                c = ur_lookup(&e, data);
+                if (c == NULL) {
+                    __atomic_store_n(&r->stale, r->stale + 1, __ATOMIC_RELAXED);
+                    // 过期的 recv 也可能带着缓冲区，要还回去
+                    if (cqe->flags & IORING_CQE_F_BUFFER) ur_recycle(&e, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                    break;
+                }
+                if (UR_OP(data) == UR_RECV) ur_on_recv(&e, c, cqe);
+                else ur_on_send(&e, c, cqe);
+                break;
+            case UR_WAKE:
+                break; // r->stop 已置位
+            case UR_TIMEOUT:
+                e.timeout_armed = 0;
+                break;
+            default:
+                break; // UR_CANCEL 自己的完成事件
+            }
+        }
+        uring_cq_advance(&e.ring, n);
+        ur_flush_dirty(&e);
+        __atomic_store_n(&r->polls, e.ring.enters, __ATOMIC_RELAXED);
+        __atomic_store_n(&r->syscalls, e.ring.enters + t_syscalls, __ATOMIC_RELAXED);
+    }
+
+    // 先关 ring（取消所有还挂着的请求，缓冲区环随之注销），再释放缓冲区；连接 fd 由 reactor_destroy() 关闭
+    uring_exit(&e.ring);
+    uring_buf_ring_exit(&e.ring, &e.bufs);
+    munmap(e.uc, (size_t)cap * sizeof(ur_conn_t));
+    munmap(e.dirty, (size_t)cap * sizeof(uint32_t));
+    munmap(e.starved, (size_t)cap * sizeof(uint32_t));
+    free(e.next_bid);
+    free(e.buf_len);
+    free(e.buf_off);
+    return NULL;
+}
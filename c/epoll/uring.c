@@ -0,0 +1,174 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "uring.h"
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+int uring_init(uring_t *u, unsigned entries) {
+    static const unsigned setup_flags[] = {
+        IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+        IORING_SETUP_COOP_TASKRUN,
+        0,
+    };
+    struct io_uring_params p;
+    int fd = -1;
+
+    memset(u, 0, sizeof(*u));
+    for (size_t i = 0; i < sizeof(setup_flags) / sizeof(setup_flags[0]); i++) {
+        memset(&p, 0, sizeof(p));
+        p.flags = setup_flags[i] | IORING_SETUP_CQSIZE;
+        p.cq_entries = entries * 4; // 多发 accept/recv 一个 SQE 会产生很多 CQE
+        fd = sys_io_uring_setup(entries, &p);
+        if (fd >= 0 || errno != EINVAL) break;
+    }
+    if (fd < 0) return -errno;
+
+    u->fd = fd;
+    u->features = p.features;
+    u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if ((p.features & IORING_FEAT_SINGLE_MMAP) && u->cq_ring_size > u->sq_ring_size)
+        u->sq_ring_size = u->cq_ring_size;
+
+    u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED) goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ring = u->sq_ring; // SQ 和 CQ 两个环共用一次映射
+    } else {
+        u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                          IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED) goto fail;
+    }
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) goto fail;
+
+    char *sq = u->sq_ring, *cq = u->cq_ring;
+    u->sq_head = (unsigned *)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    u->sq_flags = (unsigned *)(sq + p.sq_off.flags);
+    u->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    u->sq_entries = *(unsigned *)(sq + p.sq_off.ring_entries);
+    u->sq_array = (unsigned *)(sq + p.sq_off.array);
+    u->sqe_tail = *u->sq_tail;
+    u->cq_head = (unsigned *)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    u->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // SQ 下标数组固定成恒等映射，之后只需要推进 tail
+    for (unsigned i = 0; i < u->sq_entries; i++) u->sq_array[i] = i;
+    return 0;
+
+fail:
+    fd = -errno;
+    uring_exit(u);
+    return fd;
+}
+
+void uring_exit(uring_t *u) {
+    if (u->sqes && u->sqes != MAP_FAILED) munmap(u->sqes, u->sqes_size);
+    if (u->cq_ring && u->cq_ring != MAP_FAILED && u->cq_ring != u->sq_ring) munmap(u->cq_ring, u->cq_ring_size);
+    if (u->sq_ring && u->sq_ring != MAP_FAILED) munmap(u->sq_ring, u->sq_ring_size);
+    if (u->fd > 0) close(u->fd);
+    memset(u, 0, sizeof(*u));
+    u->fd = -1;
+}
+
+struct io_uring_sqe *uring_get_sqe(uring_t *u) {
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+
+    if (u->sqe_tail - head >= u->sq_entries) {
+        if (uring_submit_and_wait(u, 0) < 0) return NULL;
+        head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+        if (u->sqe_tail - head >= u->sq_entries) return NULL;
+    }
+    struct io_uring_sqe *sqe = &u->sqes[u->sqe_tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sqe_tail++;
+    u->to_submit++;
+    return sqe;
+}
+
+int uring_submit_and_wait(uring_t *u, unsigned wait_nr) {
+    unsigned flags = 0;
+    int ret;
+
+    __atomic_store_n(u->sq_tail, u->sqe_tail, __ATOMIC_RELEASE);
+    // DEFER_TASKRUN 下即使不等待，也要带 GETEVENTS 才会把完成事件跑出来
+    if (wait_nr > 0 || (__atomic_load_n(u->sq_flags, __ATOMIC_RELAXED) & (IORING_SQ_TASKRUN | IORING_SQ_CQ_OVERFLOW)))
+        flags |= IORING_ENTER_GETEVENTS;
+    if (u->to_submit == 0 && flags == 0) return 0;
+
+    do {
+        ret = sys_io_uring_enter(u->fd, u->to_submit, wait_nr, flags);
+    } while (ret < 0 && errno == EINTR);
+    u->enters++;
+    if (ret < 0) return -errno;
+    u->to_submit -= (unsigned)ret;
+    return ret;
+}
+
+int uring_buf_ring_init(uring_t *u, uring_buf_ring_t *r, uint16_t bgid, unsigned nbufs, unsigned buf_size) {
+    struct io_uring_buf_reg reg;
+    int err;
+
+    memset(r, 0, sizeof(*r));
+    if (nbufs == 0 || (nbufs & (nbufs - 1)) != 0 || nbufs > 32768 || buf_size == 0) return -EINVAL;
+    r->nbufs = nbufs;
+    r->buf_size = buf_size;
+    r->bgid = bgid;
+
+    r->br = mmap(NULL, nbufs * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r->br == MAP_FAILED) {
+        r->br = NULL;
+        goto fail;
+    }
+    r->bufs = mmap(NULL, (size_t)nbufs * buf_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r->bufs == MAP_FAILED) {
+        r->bufs = NULL;
+        goto fail;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)r->br;
+    reg.ring_entries = nbufs;
+    reg.bgid = bgid;
+    if (sys_io_uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) goto fail;
+    r->registered = 1;
+
+    for (unsigned i = 0; i < nbufs; i++) uring_buf_ring_add(r, (uint16_t)i);
+    uring_buf_ring_publish(r);
+    return 0;
+
+fail:
+    err = -errno;
+    uring_buf_ring_exit(u, r);
+    return err;
+}
+
+void uring_buf_ring_exit(uring_t *u, uring_buf_ring_t *r) {
+    if (r->registered && u->fd >= 0) {
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.bgid = r->bgid;
+        sys_io_uring_register(u->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    if (r->bufs) munmap(r->bufs, (size_t)r->nbufs * r->buf_size);
+    if (r->br) munmap(r->br, r->nbufs * sizeof(struct io_uring_buf));
+    memset(r, 0, sizeof(*r));
+}
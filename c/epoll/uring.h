@@ -0,0 +1,107 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+// 不依赖 liburing 的最小 io_uring 封装：直接用 io_uring_setup / io_uring_enter / io_uring_register
+// 三个系统调用，mmap 出 SQ/CQ 两个环。只有创建它的线程使用，不做任何加锁。
+
+typedef struct uring {
+    int fd;
+    unsigned features;
+
+    // 提交队列
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_flags;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sqe_tail;   // 本地已填好、还没发布给内核的尾部
+    unsigned to_submit;
+
+    // 完成队列
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    uint64_t enters;     // io_uring_enter 调用次数
+} uring_t;
+
+// 优先尝试 SINGLE_ISSUER | DEFER_TASKRUN（完成事件只在 enter 时处理，不打断用户态），
+// 内核不支持时逐级退回。必须在之后使用它的线程里调用。成功返回 0，失败返回 -errno。
+int uring_init(uring_t *u, unsigned entries);
+
+void uring_exit(uring_t *u);
+
+// 取一个空闲 SQE（已清零）；SQ 满时先提交一次
+struct io_uring_sqe *uring_get_sqe(uring_t *u);
+
+// SQ 里还能放多少个 SQE
+static inline unsigned uring_sq_space(uring_t *u) {
+    return u->sq_entries - (u->sqe_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE));
+}
+
+// 提交所有已填好的 SQE，并至少等待 wait_nr 个完成事件。返回提交数或 -errno。
+int uring_submit_and_wait(uring_t *u, unsigned wait_nr);
+
+// 完成队列遍历：for (head = *cq_head; head != tail; head++) ...，处理完用 uring_cq_advance 一次性归还
+static inline unsigned uring_cq_ready(uring_t *u, unsigned *head) {
+    *head = *u->cq_head;
+    return __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) - *head;
+}
+
+static inline struct io_uring_cqe *uring_cqe_at(uring_t *u, unsigned head) {
+    return &u->cqes[head & u->cq_mask];
+}
+
+static inline void uring_cq_advance(uring_t *u, unsigned n) {
+    __atomic_store_n(u->cq_head, *u->cq_head + n, __ATOMIC_RELEASE);
+}
+
+// 提供缓冲区环（IORING_REGISTER_PBUF_RING）：内核收数据时自己从环里挑一块，
+// CQE 的 flags 高 16 位带回 buffer id；用完后应用再把这块放回环里。
+typedef struct uring_buf_ring {
+    struct io_uring_buf_ring *br;
+    char *bufs;          // nbufs 块连续内存，每块 buf_size 字节
+    unsigned nbufs;      // 2 的幂
+    unsigned buf_size;
+    uint16_t bgid;
+    uint16_t tail;       // 本地尾部，uring_buf_ring_publish 时写回共享环
+    int registered;
+} uring_buf_ring_t;
+
+// 注册一个 nbufs × buf_size 的缓冲区环，并把所有块都放进去
+int uring_buf_ring_init(uring_t *u, uring_buf_ring_t *r, uint16_t bgid, unsigned nbufs, unsigned buf_size);
+
+// 注销（ring 已经关闭时跳过）并释放缓冲区
+void uring_buf_ring_exit(uring_t *u, uring_buf_ring_t *r);
+
+static inline char *uring_buf_addr(uring_buf_ring_t *r, uint16_t bid) {
+    return r->bufs + (size_t)bid * r->buf_size;
+}
+
+// 把 bid 放回环里；攒一批后用 uring_buf_ring_publish 一次发布
+static inline void uring_buf_ring_add(uring_buf_ring_t *r, uint16_t bid) {
+    struct io_uring_buf *b = &r->br->bufs[r->tail & (r->nbufs - 1)];
+
+    b->addr = (uint64_t)(uintptr_t)uring_buf_addr(r, bid);
+    b->len = r->buf_size;
+    b->bid = bid;
+    r->tail++;
+}
+
+static inline void uring_buf_ring_publish(uring_buf_ring_t *r) {
+    __atomic_store_n(&r->br->tail, r->tail, __ATOMIC_RELEASE);
+}
+
+#endif
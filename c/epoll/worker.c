@@ -0,0 +1,185 @@
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "worker.h"
+
+// 做完的任务推回 reactor 的完成队列；本轮第一个推回去的写一次 eventfd，
+// 后面的看到 notified 已置位就不写，一批完成只唤醒 reactor 一次。
+// 完成队列满了就等 reactor 取走一些；停机时 reactor 可能已经不再取了，丢掉任务，不能一直等
+static void worker_complete(worker_pool_t *p, worker_job_t *job) {
+    worker_cq_t *cq = job->cq;
+    uint64_t one = 1;
+
+    while (mpsc_push(&cq->q, job) == -1) {
+        if (__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+            free(job);
+            return;
+        }
+        sched_yield();
+    }
+    if (!__atomic_exchange_n(&cq->notified, 1, __ATOMIC_SEQ_CST)) {
+        if (write(cq->efd, &one, sizeof(one)) == -1) perror("eventfd write");
+    }
+}
+
+static int worker_idle(worker_t *w) {
+    for (int i = 0; i < w->pool->nreactors; i++) {
+        if (!spsc_empty(&w->in[i])) return 0;
+    }
+    return 1;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    worker_pool_t *p = w->pool;
+
+    for (;;) {
+        uint64_t done = 0;
+        worker_job_t *job;
+
+        for (int i = 0; i < p->nreactors; i++) {
+            for (int k = 0; k < WORKER_BATCH && (job = spsc_pop(&w->in[i])) != NULL; k++) {
+                if (__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) {
+                    free(job); // 停机：排队的任务不再执行，没人等它们的回复了
+                    continue;
+                }
+                job->reply.status = '+';
+                job->fn(job->arg, job->len, &job->reply);
+                worker_complete(p, job);
+                done++;
+            }
+        }
+        if (done > 0) {
+            __atomic_store_n(&w->jobs, w->jobs + done, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) break;
+
+        // 先声明要睡，再检查一遍队列：提交方放入任务之后才读 sleeping，两边都是 seq_cst，
+        // 要么这里看到新任务，要么提交方看到 sleeping 写 eventfd，不会两边都错过
+        __atomic_store_n(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+        if (worker_idle(w) && !__atomic_load_n(&p->stop, __ATOMIC_SEQ_CST)) {
+            uint64_t v;
+            if (read(w->efd, &v, sizeof(v)) == -1 && errno != EINTR) perror("eventfd read");
+        }
+        __atomic_store_n(&w->sleeping, 0, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+worker_pool_t *worker_pool_create(int nworkers, int nreactors) {
+    worker_pool_t *p = calloc(1, sizeof(*p));
+
+    if (p == NULL) return NULL;
+    p->nreactors = nreactors;
+    p->workers = aligned_alloc(64, sizeof(worker_t) * nworkers);
+    if (p->workers == NULL) {
+        free(p);
+        return NULL;
+    }
+    memset(p->workers, 0, sizeof(worker_t) * nworkers);
+    p->nworkers = nworkers;
+
+    for (int i = 0; i < nworkers; i++) {
+        worker_t *w = &p->workers[i];
+
+        w->pool = p;
+        w->efd = eventfd(0, 0); // 阻塞读
+        w->in = aligned_alloc(64, sizeof(spsc_t) * nreactors);
+        if (w->efd == -1 || w->in == NULL) {
+            perror("eventfd/aligned_alloc");
+            goto fail;
+        }
+        memset(w->in, 0, sizeof(spsc_t) * nreactors);
+        for (int r = 0; r < nreactors; r++) {
+            if (spsc_init(&w->in[r], WORKER_QUEUE) == -1) {
+                perror("spsc_init");
+                goto fail;
+            }
+        }
+    }
+    for (; p->started < nworkers; p->started++) {
+        worker_t *w = &p->workers[p->started];
+        int err = pthread_create(&w->thread, NULL, worker_main, w);
+        if (err != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            goto fail;
+        }
+    }
+    return p;
+
+fail:
+    worker_pool_destroy(p);
+    return NULL;
+}
+
+void worker_pool_stop(worker_pool_t *p) {
+    uint64_t one = 1;
+
+    __atomic_store_n(&p->stop, 1, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < p->started; i++) {
+        if (write(p->workers[i].efd, &one, sizeof(one)) == -1) perror("eventfd write");
+        pthread_join(p->workers[i].thread, NULL);
+    }
+    p->started = 0;
+}
+
+void worker_pool_destroy(worker_pool_t *p) {
+    worker_pool_stop(p);
+    for (int i = 0; i < p->nworkers; i++) {
+        worker_t *w = &p->workers[i];
+        worker_job_t *job;
+
+        for (int r = 0; w->in && r < p->nreactors; r++) {
+            if (w->in[r].slots == NULL) continue;
+            while ((job = spsc_pop(&w->in[r])) != NULL) free(job);
+            spsc_destroy(&w->in[r]);
+        }
+        free(w->in);
+        if (w->efd > 0) close(w->efd);
+    }
+    free(p->workers);
+    free(p);
+}
+
+int worker_submit(worker_pool_t *p, int reactor_id, uint32_t *next, worker_job_t *job) {
+    for (int n = 0; n < p->nworkers; n++) {
+        int i = (int)(*next % (uint32_t)p->nworkers);
+        (*next)++;
+        if (spsc_push(&p->workers[i].in[reactor_id], job) == 0) return i;
+    }
+    return -1;
+}
+
+int worker_kick(worker_pool_t *p, uint64_t mask) {
+    uint64_t one = 1;
+    int n = 0;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // 前面入队的写不能和下面读 sleeping 重排
+    while (mask) {
+        worker_t *w = &p->workers[__builtin_ctzll(mask)];
+        mask &= mask - 1;
+        if (!__atomic_load_n(&w->sleeping, __ATOMIC_SEQ_CST)) continue;
+        if (write(w->efd, &one, sizeof(one)) == -1) perror("eventfd write");
+        n++;
+    }
+    return n;
+}
+
+int worker_cq_init(worker_cq_t *cq, int efd) {
+    cq->efd = efd;
+    cq->notified = 0;
+    return mpsc_init(&cq->q, WORKER_CQ);
+}
+
+void worker_cq_destroy(worker_cq_t *cq) {
+    worker_job_t *job;
+
+    if (cq->q.cells == NULL) return;
+    while ((job = worker_cq_pop(cq)) != NULL) free(job);
+    mpsc_destroy(&cq->q);
+}
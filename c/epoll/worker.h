@@ -0,0 +1,85 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "frame.h"
+#include "queue.h"
+
+// 工作线程池：CPU 密集的请求（frame_cmd_t.heavy）不在事件循环里执行，交给工作线程，
+// 事件循环只管 IO，重活再多也不会卡住其它连接的读写。
+//   提交：每个 reactor 到每个工作线程一条 SPSC 队列，reactor 轮流挑一个队列没满的工作线程；
+//   完成：每个 reactor 一条 MPSC 完成队列，工作线程做完推回去，再写 reactor 的 eventfd 唤醒它。
+// 任务里只有连接的 token，连接始终只由 reactor 线程访问；回复回来时连接已经关掉（gen 变了）就丢弃。
+
+#define WORKER_MAX 64          // 工作线程数上限（reactor 用 64 位掩码记下本轮要唤醒哪些）
+#define WORKER_QUEUE 1024      // 每个 reactor 到每个工作线程的提交队列容量
+#define WORKER_CQ 4096         // 每个 reactor 的完成队列容量，满了工作线程让出 CPU 等 reactor 取走
+#define WORKER_BATCH 32        // 工作线程每条提交队列一次最多取多少个，不让一个 reactor 饿着其它的
+
+// reactor 的完成队列
+typedef struct worker_cq {
+    mpsc_t q;
+    int efd;              // reactor 的 wake_fd
+    int notified;         // 已经写过 eventfd、reactor 还没处理，后面完成的任务不用再写
+} worker_cq_t;
+
+// 一个交出去的请求，参数拷在结构体后面；reactor 分配和释放，中间只有一个工作线程访问
+typedef struct worker_job {
+    uint64_t token;       // 请求所在连接的 token
+    worker_cq_t *cq;      // 做完推到这个完成队列
+    frame_handler_fn fn;
+    frame_reply_t reply;  // 工作线程填写；data 指向 arg 或 reply.buf，都在本结构体里
+    size_t len;
+    char arg[];
+} worker_job_t;
+
+typedef struct worker {
+    pthread_t thread;
+    struct worker_pool *pool;
+    int efd;              // 没活干时阻塞在这个 eventfd 上
+    int sleeping;         // 即将或正在阻塞，提交方看到才写 eventfd
+    uint64_t jobs;        // 统计：只有本线程写
+    spsc_t *in;           // 每个 reactor 一条提交队列
+} __attribute__((aligned(64))) worker_t;
+
+typedef struct worker_pool {
+    int nworkers;
+    int nreactors;
+    int started;          // 已经启动的线程数
+    int stop;
+    worker_t *workers;
+} worker_pool_t;
+
+// 创建并启动 nworkers 个工作线程，为 nreactors 个 reactor 各建一组提交队列；失败返回 NULL
+worker_pool_t *worker_pool_create(int nworkers, int nreactors);
+
+// 停止并回收所有工作线程：正在做的任务做完，还在排队的丢弃，完成队列满了也不再等。
+// reactor 线程可以还在跑（之后提交的任务留在队列里），停机时应先于 reactor 调用
+void worker_pool_stop(worker_pool_t *p);
+
+// 停止工作线程（如果还没停），释放提交队列和里面还没做的任务；reactor 线程须已退出
+void worker_pool_destroy(worker_pool_t *p);
+
+// reactor 线程调用：从 *next 开始轮流找一个提交队列没满的工作线程放进去，返回它的编号；
+// 全满返回 -1。放进去不会立即唤醒工作线程，reactor 在本轮末尾统一 worker_kick
+int worker_submit(worker_pool_t *p, int reactor_id, uint32_t *next, worker_job_t *job);
+
+// 唤醒 mask 里正在睡的工作线程，返回写 eventfd 的次数
+int worker_kick(worker_pool_t *p, uint64_t mask);
+
+int worker_cq_init(worker_cq_t *cq, int efd);
+
+// 释放完成队列里剩下的任务；工作线程须已退出
+void worker_cq_destroy(worker_cq_t *cq);
+
+// reactor 被 eventfd 唤醒、读掉计数之后，取任务之前调用：之后完成的任务会重新写 eventfd
+static inline void worker_cq_rearm(worker_cq_t *cq) {
+    __atomic_store_n(&cq->notified, 0, __ATOMIC_SEQ_CST);
+}
+
+static inline worker_job_t *worker_cq_pop(worker_cq_t *cq) {
+    return mpsc_pop(&cq->q);
+}
+
+#endif
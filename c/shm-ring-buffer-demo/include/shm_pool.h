@@ -0,0 +1,118 @@
+/*
+ * shm_pool.h
+ *
+ * A shared-memory buffer pool for payloads too large for shm_ring slots.
+ *
+ * The pool is its own POSIX shm segment holding a few fixed size classes
+ * of buffers, each class with a lock-free free list. Large frames are
+ * written once into a pool buffer; the ring then only carries a small
+ * descriptor (pool offset + length) and the slot's usual seq/ts. The
+ * consumer reads the frame in place and releases the buffer back to the
+ * pool. This is the descriptor-ring + buffer-pool split used by NICs,
+ * applied to IPC: ring slots stay tiny regardless of frame size.
+ *
+ * See docs/SHM_RING_BUFFER.md, section "描述符环与共享缓冲池".
+ */
+
+#ifndef SHM_POOL_H
+#define SHM_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <shm_ring.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHMPOOL_MAGIC        0x53484D50u /* "SHMP" */
+#define SHMPOOL_MAX_CLASSES  8U
+#define SHMPOOL_ALIGN        64U         /* buffers are cache-line aligned */
+
+/*
+ * One size class. `free_head` is a tagged index: the low 32 bits are
+ * (buffer index + 1), 0 meaning empty; the high 32 bits are a counter
+ * bumped by every successful CAS, which defeats ABA when a buffer is
+ * popped and pushed back between another thread's load and CAS.
+ * Free-list links live in a separate uint32_t array (next_off) rather
+ * than inside the buffers, so alloc/free never touch payload cache lines.
+ */
+typedef struct {
+    uint64_t free_head __attribute__((aligned(64))); /* one cache line per class */
+    uint32_t buf_size;  /* bytes per buffer, multiple of SHMPOOL_ALIGN */
+    uint32_t nbufs;     /* number of buffers in this class */
+    uint64_t buf_off;   /* segment offset of buffer 0 */
+    uint64_t next_off;  /* segment offset of the uint32_t next[nbufs] array */
+    uint32_t in_use;    /* buffers currently allocated (monitoring only) */
+} shmpool_class_t;
+
+/* Control block at the start of the pool segment. */
+typedef struct {
+    uint32_t magic;
+    uint32_t nclasses;
+    uint64_t map_size;
+    shmpool_class_t classes[SHMPOOL_MAX_CLASSES]; /* sorted by buf_size */
+} shmpool_hdr_t;
+
+/* Process-local handle. */
+typedef struct {
+    shmpool_hdr_t *hdr;
+    size_t map_size;
+    char name[SHMRING_NAME_MAX];
+} shmpool_t;
+
+/*
+ * What travels through the ring instead of the payload: the buffer's
+ * offset inside the pool segment (valid in every process, unlike a
+ * pointer) and the number of valid bytes. seq and ts come from the slot.
+ */
+typedef struct {
+    uint64_t off;
+    uint32_t len;
+    uint32_t reserved;
+} shmpool_desc_t;
+
+/*
+ * Create a pool named `name` with `nclasses` size classes: class i holds
+ * counts[i] buffers of sizes[i] bytes (rounded up to SHMPOOL_ALIGN).
+ * Like shmring_create(), falls back to attaching if the pool exists.
+ * Returns SHMRING_OK or a SHMRING_ERR_* code.
+ */
+int shmpool_create(const char *name, const uint32_t *sizes, const uint32_t *counts, uint32_t nclasses,
+                   shmpool_t **out);
+int shmpool_attach(const char *name, shmpool_t **out);
+void shmpool_close(shmpool_t *pool);
+int shmpool_destroy(const char *name);
+
+/*
+ * Take a buffer of at least `size` bytes from the smallest class that
+ * fits and has one free. Lock-free; never blocks. Returns NULL when every
+ * suitable class is exhausted (size the pool for capacity + in-flight
+ * buffers per process). `out_off` receives the buffer's pool offset.
+ */
+void *shmpool_alloc(shmpool_t *pool, uint32_t size, uint64_t *out_off);
+
+/* Return a buffer obtained from shmpool_alloc() (in any process). */
+int shmpool_free(shmpool_t *pool, uint64_t off);
+
+/* Translate a pool offset to a pointer in this process, or NULL. */
+void *shmpool_ptr(shmpool_t *pool, uint64_t off);
+
+/*
+ * Ring glue. shmpool_send() pushes the descriptor for a filled buffer; on
+ * any error the caller still owns the buffer. shmpool_recv() pops one
+ * descriptor and resolves it; the caller must shmpool_free(desc->off)
+ * once it is done with *out_ptr. Ring must have max_payload >=
+ * sizeof(shmpool_desc_t).
+ */
+int shmpool_send(shmring_t *ring, shmpool_t *pool, uint64_t off, uint32_t len, uint64_t *out_seq, int block);
+int shmpool_recv(shmring_t *ring, shmpool_t *pool, shmpool_desc_t *desc, void **out_ptr, uint64_t *out_seq,
+                 struct timespec *out_ts, int block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHM_POOL_H */
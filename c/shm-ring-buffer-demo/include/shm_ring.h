@@ -15,15 +15,58 @@
 #include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 #include <time.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define SHMRING_MAGIC        0x53484D52u /* "SHMR" */
-#define SHMRING_NAME_MAX      64U
+/*
+ * Every header starts with magic + layout_version. Bump the version
+ * whenever the layout of shmring_hdr_t or shmring_slot_t changes:
+ * persistent ring files outlive the binary that wrote them, and opening
+ * one with a different layout fails with SHMRING_ERR_SYS/EPROTO instead
+ * of mapping it with the wrong offsets. SHMRING_MAGIC_V0 marks headers
+ * written before the version field existed; they are rejected the same way.
+ */
+#define SHMRING_MAGIC          0x53484D56u /* "SHMV" */
+#define SHMRING_MAGIC_V0       0x53484D52u /* "SHMR": unversioned layouts */
+#define SHMRING_LAYOUT_VERSION 1U
+#define SHMRING_NAME_MAX     256U /* shm object name, or "file:" + path */
 #define SHMRING_MIN_CAPACITY   1U
+#define SHMRING_MAX_CAPACITY   (1U << 31) /* capacities round up to a power of two */
+
+/*
+ * Ring names starting with this prefix denote a persistent ring backed by
+ * a regular file instead of a POSIX shm object, e.g. "file:/var/lib/x.ring".
+ * Every API taking a `name` accepts both forms. See shmring_commit().
+ */
+#define SHMRING_FILE_PREFIX    "file:"
+
+/* shmring_hdr_t.flags */
+#define SHMRING_F_PERSIST      0x1u /* file-backed; pops must be committed */
+#define SHMRING_BOOT_ID_LEN    40U
+
+/*
+ * Per-ring timestamp source (shmring_opts_t.ts_mode). Every mode stamps
+ * before taking the ring lock; shmring_pop() converts the raw slot stamp
+ * into a struct timespec in the ring's clock, shmring_now() reads that
+ * clock so readers can compute latencies without knowing the mode.
+ */
+#define SHMRING_TS_REALTIME  0U /* clock_gettime(CLOCK_REALTIME), ns (default) */
+#define SHMRING_TS_NONE      1U /* no stamp; out_ts is zero */
+#define SHMRING_TS_MONOTONIC 2U /* clock_gettime(CLOCK_MONOTONIC), ns; immune to clock steps */
+#define SHMRING_TS_TSC       3U /* raw rdtsc ticks, converted with the header's
+                                 * calibration to the CLOCK_MONOTONIC time base.
+                                 * x86-64 with an invariant TSC only. */
+
+#define SHMRING_NUMA_ANY       (-1) /* no placement policy; first-touch */
+
+/* Readiness FIFO used by shmring_notify_open(): "<dir><name><suffix>",
+ * e.g. /dev/shm/demo_ring.notify for a ring named "/demo_ring". */
+#define SHMRING_NOTIFY_DIR     "/dev/shm"
+#define SHMRING_NOTIFY_SUFFIX  ".notify"
 
 /* Return codes for shmring_push()/shmring_pop() and lifecycle calls. */
 enum {
@@ -47,11 +90,60 @@ enum {
  */
 typedef struct {
     uint64_t seq;          /* monotonically increasing message number */
-    struct timespec ts;    /* producer-side timestamp (CLOCK_REALTIME) */
+    uint64_t stamp;        /* producer-side timestamp, raw, in hdr->ts_mode units */
     uint32_t len;           /* actual payload length in bytes */
+    uint32_t crc;           /* persistent rings only: checksum of seq/len/payload */
     uint8_t payload[];      /* up to hdr->max_payload bytes */
 } shmring_slot_t;
 
+/*
+ * Latency histogram geometry: log-linear buckets, 2^SHMRING_LAT_SUB_BITS
+ * per power of two, so any recorded value is within 25% of its bucket's
+ * floor. Values below 2^SUB_BITS ns get a bucket each.
+ */
+#define SHMRING_LAT_SUB_BITS 2U
+#define SHMRING_LAT_BUCKETS  (64U << SHMRING_LAT_SUB_BITS)
+
+static inline uint32_t
+shmring_lat_bucket(uint64_t ns)
+{
+    uint32_t msb;
+
+    if (ns < (1ull << SHMRING_LAT_SUB_BITS))
+        return (uint32_t)ns;
+    msb = 63U - (uint32_t)__builtin_clzll(ns);
+    return ((msb - SHMRING_LAT_SUB_BITS + 1U) << SHMRING_LAT_SUB_BITS) |
+           (uint32_t)((ns >> (msb - SHMRING_LAT_SUB_BITS)) & ((1ull << SHMRING_LAT_SUB_BITS) - 1));
+}
+
+/* Smallest value that lands in bucket `b`. */
+static inline uint64_t
+shmring_lat_bucket_floor(uint32_t b)
+{
+    uint32_t e = b >> SHMRING_LAT_SUB_BITS, m = b & ((1U << SHMRING_LAT_SUB_BITS) - 1);
+
+    if (e == 0)
+        return m;
+    return ((1ull << SHMRING_LAT_SUB_BITS) | m) << (e - 1);
+}
+
+/*
+ * Live metrics kept in the ring header, for monitors such as shm_ring_top.
+ * The wait counters and the high-water mark are updated under the ring
+ * lock; the histogram is updated by consumers after they drop it, with
+ * relaxed atomic adds. Readers take relaxed snapshots (shmring_metrics())
+ * and diff successive ones for rates.
+ */
+typedef struct {
+    uint64_t lat_hist[SHMRING_LAT_BUCKETS] __attribute__((aligned(64))); /* stamp-to-pop ns */
+    uint64_t full_waits;    /* pushes that had to wait for space */
+    uint64_t full_wait_ns;  /* total time producers spent blocked on a full ring */
+    uint64_t empty_waits;   /* pops that had to wait for data */
+    uint64_t empty_wait_ns; /* total time consumers spent blocked on an empty ring */
+    uint32_t count_hwm;     /* highest occupancy ever observed */
+    uint32_t reserved;
+} shmring_metrics_t;
+
 /*
  * Control block mapped at the start of the shared memory segment.
  *
@@ -59,40 +151,77 @@ typedef struct {
  *
  *   +--------------------------------------------------+
  *   | shmring_hdr_t (fixed-size header fields)          |
- *   |  magic, capacity, max_payload, slot_stride         |
+ *   |  magic, layout_version                              |
+ *   |  capacity, max_payload, slot_stride                |
+ *   |  flags, numa_node, boot_id, gen, latest_gen        |
+ *   |  ts_mode, tsc_mult, tsc_base, tsc_base_ns          |
  *   |  lock, not_full, not_empty                         |
- *   |  head, tail, count, closed                         |
- *   |  next_seq, total_pushed, total_popped              |
+ *   |  tail, next_seq, total_pushed   (producer line)    |
+ *   |  head, total_popped             (consumer line)    |
+ *   |  closed, notify, ckpt, pending, committed_seq      |
+ *   |  metrics (latency histogram, wait counters, hwm)   |
  *   +--------------------------------------------------+
- *   | slots[0]  = shmring_slot_t (seq/ts/len/payload)    |
+ *   | slots[0]  = shmring_slot_t (seq/stamp/len/payload) |
  *   | slots[1]  = shmring_slot_t                         |
  *   | ...                                                |
  *   | slots[capacity-1]                                  |
  *   +--------------------------------------------------+
  *
- * head/tail/count implement a classic bounded-buffer: producers block on
- * not_full while count == capacity, consumers block on not_empty while
- * count == 0. Both sides advance their index modulo capacity.
+ * capacity is a power of two. head and tail are free-running 64-bit
+ * cursors that never wrap in practice: occupancy is tail - head and a
+ * cursor's slot is cursor & (capacity - 1). Producers block on not_full
+ * while the ring is full, consumers on not_empty while tail == head.
+ * Producer- and consumer-side fields live on separate cache lines, so
+ * the two sides no longer write a shared count on every message.
+ *
+ * shmring_resize() migrates the ring to a new segment "<name>.g<gen>".
+ * The segment under `name` (generation 0) stays as the directory: its
+ * latest_gen always names the live generation, for new attachers and for
+ * processes still mapping a superseded segment.
+ *
+ * Persistent rings (SHMRING_F_PERSIST) keep popped slots reserved until the
+ * consumer commits them: the slots from ckpt up to head hold `pending`
+ * popped-but-uncommitted messages, and producers block while
+ * tail - ckpt == capacity. committed_seq is the seq of the slot at ckpt.
  */
 typedef struct {
     uint32_t magic;
-    uint32_t capacity;      /* number of slots, fixed at creation time */
+    uint32_t layout_version; /* SHMRING_LAYOUT_VERSION of the writer that created it */
+    uint32_t capacity;      /* number of slots (power of two), fixed at creation time */
     uint32_t max_payload;   /* max payload bytes per slot, fixed at creation */
     uint32_t slot_stride;   /* bytes per slot = align8(sizeof(shmring_slot_t) + max_payload) */
+    uint32_t flags;         /* SHMRING_F_*, fixed at creation */
+    int32_t numa_node;      /* node the segment is bound to, or SHMRING_NUMA_ANY */
+    char boot_id[SHMRING_BOOT_ID_LEN]; /* persistent rings: boot that last initialised lock/conds */
+    uint32_t gen;           /* generation of this segment (0 = the one under `name`) */
+    uint32_t latest_gen;    /* != gen once shmring_resize() migrated the ring away */
+    uint32_t ts_mode;       /* SHMRING_TS_*, fixed at creation */
+    uint32_t tsc_shift;     /* SHMRING_TS_TSC: ns = tsc_base_ns + ((tsc - tsc_base) * tsc_mult) >> tsc_shift */
+    uint64_t tsc_mult;
+    uint64_t tsc_base;
+    uint64_t tsc_base_ns;   /* CLOCK_MONOTONIC ns at tsc_base */
 
     pthread_mutex_t lock;    /* PTHREAD_PROCESS_SHARED + PTHREAD_MUTEX_ROBUST */
     pthread_cond_t not_full;  /* signaled by consumers, waited on by producers */
     pthread_cond_t not_empty; /* signaled by producers, waited on by consumers */
 
-    uint32_t head;   /* index of next slot to pop */
-    uint32_t tail;   /* index of next slot to push */
-    uint32_t count;  /* number of occupied slots, 0..capacity */
-    uint32_t closed; /* set by shmring_shutdown(); wakes all waiters */
-
+    /* Written by producers (under lock). */
+    uint64_t tail __attribute__((aligned(64))); /* cursor of next slot to push */
     uint64_t next_seq;      /* next sequence number handed out by push() */
     uint64_t total_pushed;  /* lifetime counters, protected by lock */
+
+    /* Written by consumers (under lock). */
+    uint64_t head __attribute__((aligned(64))); /* cursor of next slot to pop */
     uint64_t total_popped;
 
+    uint32_t closed __attribute__((aligned(64))); /* set by shmring_shutdown(); wakes all waiters */
+    uint32_t notify;  /* non-zero once a reader armed the readiness FIFO */
+    uint32_t pending; /* persistent rings: popped but not yet committed (head - ckpt) */
+    uint64_t ckpt;    /* persistent rings: cursor of the oldest uncommitted slot */
+    uint64_t committed_seq; /* persistent rings: next seq a restarted reader resumes at */
+
+    shmring_metrics_t metrics;
+
     uint8_t slots[]; /* capacity * slot_stride bytes */
 } shmring_hdr_t;
 
@@ -100,12 +229,36 @@ typedef struct {
 typedef struct {
     shmring_hdr_t *hdr;
     size_t map_size;
+    int notify_fd; /* readiness FIFO, -1 until first needed */
+    int persist;   /* name is SHMRING_FILE_PREFIX + path */
+    int readonly;  /* from shmring_attach_readonly(): PROT_READ mapping */
+    uint64_t window_stamp; /* stamp for the open shmring_write_begin() window */
+    uint32_t window;       /* slots in the open write/read window, 0 if none */
     char name[SHMRING_NAME_MAX];
 } shmring_t;
 
+/*
+ * Creation-time options for shmring_create_ex(). Initialise with
+ * shmring_opts_init() so fields added later get their defaults.
+ */
+typedef struct {
+    uint32_t capacity;    /* number of slots, rounded up to a power of two */
+    uint32_t max_payload; /* max payload bytes per slot */
+    int numa_node;        /* bind the segment's pages to this node (mbind
+                           * MPOL_BIND), or SHMRING_NUMA_ANY. Ignored for
+                           * file-backed rings: the page cache does not
+                           * follow mapping policies. */
+    uint32_t ts_mode;     /* SHMRING_TS_*; default SHMRING_TS_REALTIME.
+                           * SHMRING_TS_TSC calibrates for ~10ms at creation. */
+} shmring_opts_t;
+
+void shmring_opts_init(shmring_opts_t *opts, uint32_t capacity, uint32_t max_payload);
+
 /*
  * Create a new ring buffer named `name` with `capacity` slots, each able to
- * hold up to `max_payload` bytes of user data.
+ * hold up to `max_payload` bytes of user data. capacity is rounded up to
+ * the next power of two (at most SHMRING_MAX_CAPACITY); shmring_capacity()
+ * reports the actual value.
  *
  * If the shared memory object already exists (e.g. another writer process
  * created it first), this call transparently falls back to attaching to
@@ -114,19 +267,39 @@ typedef struct {
  */
 int shmring_create(const char *name, uint32_t capacity, uint32_t max_payload, shmring_t **out);
 
+/* shmring_create() with explicit options. If the ring already exists its
+ * original options win, as with shmring_create(). */
+int shmring_create_ex(const char *name, const shmring_opts_t *opts, shmring_t **out);
+
 /*
  * Attach to an existing ring buffer named `name`. Fails with
  * SHMRING_ERR_SYS/ENOENT if no writer has created it yet.
+ *
+ * For a persistent ring, create/attach is serialised by flock() on the
+ * file. The first opener after a reboot re-initialises the (stale)
+ * lock/condvars and runs the same recovery as shmring_recover(). A creator
+ * reopening an existing persistent ring also clears `closed`, so a
+ * restarted producer can resume after a previous shmring_shutdown().
  */
 int shmring_attach(const char *name, shmring_t **out);
 
+/*
+ * Attach with a read-only mapping, for monitoring tools. Such a handle can
+ * only be used with shmring_count(), shmring_stats(), shmring_metrics(),
+ * shmring_capacity() and shmring_close(); everything that would write the
+ * segment returns SHMRING_ERR_INVAL. Works for "file:" rings too, without
+ * taking the file lock or running recovery.
+ */
+int shmring_attach_readonly(const char *name, shmring_t **out);
+
 /* Unmap and free the local handle. Does not affect the shared memory object
  * itself, so other attached processes are unaffected. */
 void shmring_close(shmring_t *ring);
 
-/* Remove the underlying shared memory object (shm_unlink). Should be called
- * exactly once, by whichever process owns the ring's lifecycle, after all
- * other processes have stopped using it. */
+/* Remove the underlying shared memory object (shm_unlink), and the
+ * readiness FIFO if one was created. Should be called exactly once, by
+ * whichever process owns the ring's lifecycle, after all other processes
+ * have stopped using it. */
 int shmring_destroy(const char *name);
 
 /*
@@ -141,17 +314,82 @@ int shmring_destroy(const char *name);
  */
 int shmring_push(shmring_t *ring, const void *data, uint32_t len, uint64_t *out_seq, int block);
 
+/*
+ * shmring_push() of the concatenation of iov[0..iovcnt), gathered straight
+ * into the slot: a message assembled from a header, a key and a body
+ * needs no staging buffer. SHMRING_ERR_TOOBIG if the total exceeds
+ * max_payload.
+ */
+int shmring_pushv(shmring_t *ring, const struct iovec *iov, int iovcnt, uint64_t *out_seq, int block);
+
+/*
+ * Push `n` messages (data[i], lens[i]) with one timestamp for the whole
+ * batch and, as long as there is room, a single lock round trip. The
+ * messages get consecutive seqs unless another producer interleaves while
+ * this one waits for space. `out_pushed` (optional) receives how many were
+ * pushed, `out_first_seq` (optional) the seq of the first one. Returns
+ * SHMRING_OK once all n are in; otherwise the code of the push that
+ * stopped the batch (FULL when non-blocking, CLOSED, ...).
+ */
+int shmring_push_batch(shmring_t *ring, const void *const *data, const uint32_t *lens, uint32_t n,
+                       uint32_t *out_pushed, uint64_t *out_first_seq, int block);
+
 /*
  * Pop one message from the ring into `buf` (capacity `buf_cap` bytes).
  * `out_len`, `out_seq` and `out_ts` are optional (may be NULL): they receive
  * the message's actual length, sequence number, and producer-side
- * timestamp (useful for measuring end-to-end latency), respectively.
+ * timestamp (useful for measuring end-to-end latency against
+ * shmring_now()), respectively.
  *
  * Blocking semantics mirror shmring_push().
  */
 int shmring_pop(shmring_t *ring, void *buf, uint32_t buf_cap, uint32_t *out_len, uint64_t *out_seq,
                  struct timespec *out_ts, int block);
 
+/*
+ * shmring_pop() scattering the payload across iov[0..iovcnt) in order,
+ * e.g. a fixed-size header into a struct and the rest into a body buffer.
+ * As with shmring_pop(), `out_len` is the full message length; bytes
+ * beyond the iovecs' total capacity are dropped.
+ */
+int shmring_popv(shmring_t *ring, const struct iovec *iov, int iovcnt, uint32_t *out_len, uint64_t *out_seq,
+                 struct timespec *out_ts, int block);
+
+/*
+ * Zero-copy slot windows, for callers that build or read messages in place
+ * (the C++ wrapper in shm_ring.hpp is the main user).
+ *
+ * shmring_write_begin() takes the ring lock, waits (per `block`, same
+ * errors as shmring_push()) until at least one slot is free, and reports
+ * the tail cursor `*out_pos` and how many slots `*out_n` (1..want) may be
+ * filled. Slot i of the window lives at
+ *
+ *     hdr->slots + ((*out_pos + i) & (hdr->capacity - 1)) * hdr->slot_stride
+ *
+ * (*out_pos is the free-running cursor). The caller writes len and
+ * payload of the first k slots, then shmring_write_end(ring, k) assigns
+ * seq and timestamp, publishes them and drops the lock. k may be 0.
+ *
+ * shmring_read_begin()/shmring_read_end() do the same from the head: the
+ * window holds `*out_n` queued messages to read in place, and
+ * shmring_read_end(ring, k) releases the first k of them.
+ *
+ * k must not exceed the window: shmring_write_end()/shmring_read_end()
+ * with k > *out_n commit nothing, close the window anyway and return
+ * SHMRING_ERR_INVAL, as does an end call with no window open.
+ *
+ * The lock is held between begin and end, so keep the window short and
+ * never call another shmring_* function on the same ring inside it.
+ */
+int shmring_write_begin(shmring_t *ring, uint32_t want, uint64_t *out_pos, uint32_t *out_n, int block);
+int shmring_write_end(shmring_t *ring, uint32_t n);
+int shmring_read_begin(shmring_t *ring, uint32_t want, uint64_t *out_pos, uint32_t *out_n, int block);
+int shmring_read_end(shmring_t *ring, uint32_t n);
+
+/* Convert a raw slot stamp (e.g. read in place through a read window)
+ * into the out_ts form shmring_pop() reports. */
+void shmring_stamp_to_ts(shmring_t *ring, uint64_t stamp, struct timespec *out_ts);
+
 /*
  * Mark the ring as closed and wake every thread/process currently blocked
  * in shmring_push()/shmring_pop(). Safe to call from a signal handler's
@@ -160,12 +398,102 @@ int shmring_pop(shmring_t *ring, void *buf, uint32_t buf_cap, uint32_t *out_len,
  */
 void shmring_shutdown(shmring_t *ring);
 
+/*
+ * Readiness notification for event-loop readers.
+ *
+ * shmring_notify_open() returns a file descriptor that becomes readable
+ * (EPOLLIN/POLLIN) whenever a push takes the ring from empty to non-empty,
+ * and on shmring_shutdown(). The fd is a named FIFO next to the shm object
+ * (see SHMRING_NOTIFY_DIR), so unrelated processes share it by name and no
+ * fd passing is needed. Writers only pay for it once a reader has armed it,
+ * and then only on the empty->non-empty edge.
+ *
+ * The fd is owned by `ring` (closed by shmring_close()). Usage pattern:
+ *
+ *   shmring_notify_open(ring, &fd);  add fd to epoll
+ *   loop: epoll_wait() -> shmring_notify_ack(ring)
+ *         -> shmring_pop(..., block=0) until SHMRING_ERR_EMPTY/CLOSED
+ *
+ * Always ack before draining, and drain once right after arming: a wakeup
+ * is only sent when the ring was empty, so a reader that goes back to sleep
+ * with messages still queued will not be woken for them.
+ */
+int shmring_notify_open(shmring_t *ring, int *out_fd);
+
+/* Consume pending wakeups on the notify fd. Never blocks. */
+void shmring_notify_ack(shmring_t *ring);
+
+/*
+ * Persistent rings only (no-ops returning SHMRING_OK on shm rings).
+ *
+ * shmring_commit() marks every popped message with sequence number <= seq
+ * as processed: their slots are released to producers and committed_seq is
+ * flushed to disk (msync of the header) before they are, so a checkpoint
+ * never points at a slot that has already been reused. Commit in batches;
+ * each call costs a synchronous header write.
+ *
+ * shmring_sync() flushes the whole mapping (slots included), making every
+ * message pushed so far durable.
+ *
+ * shmring_recover() is for a consumer restarting after a crash: it rewinds
+ * the read cursor to the last committed seq so uncommitted messages are
+ * re-delivered straight from the mapping, and truncates the ring at the
+ * first slot whose seq/checksum does not continue the sequence (a slot
+ * torn by power loss). `out_resume_seq` (optional) receives the seq the
+ * next pop will return. Only meaningful with one consumer (group): any
+ * other live reader's uncommitted messages are re-delivered too.
+ */
+int shmring_commit(shmring_t *ring, uint64_t seq);
+int shmring_sync(shmring_t *ring);
+int shmring_recover(shmring_t *ring, uint64_t *out_resume_seq);
+
+/*
+ * Move the calling thread next to the ring's memory: restrict its CPU
+ * affinity to the CPUs of the ring's NUMA node and prefer that node for
+ * its own allocations (set_mempolicy MPOL_PREFERRED). For rings created
+ * without a node, the node currently holding the header page is used.
+ * `out_node` (optional) receives the node chosen.
+ */
+int shmring_bind_near(shmring_t *ring, int *out_node);
+
+/*
+ * Change the ring's capacity while other processes stay attached.
+ *
+ * Under the current segment's lock, a new segment with `new_capacity`
+ * slots (same max_payload, NUMA node and flags) is created, every queued
+ * message is copied into it in order, and the old segment is marked
+ * superseded. Every push/pop/shutdown re-checks the generation after
+ * taking the lock (and after each condvar wakeup), so an attached process
+ * that hits the old segment drops it, remaps the live one and retries:
+ * no message is lost or reordered and nobody has to re-attach. Blocked
+ * producers are woken and find the larger ring.
+ *
+ * new_capacity is rounded up to a power of two, as at creation, and must
+ * hold every queued message. Not supported on
+ * persistent (file-backed) rings: SHMRING_ERR_INVAL.
+ */
+int shmring_resize(shmring_t *ring, uint32_t new_capacity);
+
+/* Capacity of the live generation. */
+uint32_t shmring_capacity(shmring_t *ring);
+
+/*
+ * Current time in the ring's timestamp clock (see SHMRING_TS_*), i.e. the
+ * clock out_ts of shmring_pop() is expressed in. SHMRING_ERR_INVAL for
+ * rings created with SHMRING_TS_NONE.
+ */
+int shmring_now(shmring_t *ring, struct timespec *out);
+
 /* Current number of occupied slots (best-effort snapshot). */
 uint32_t shmring_count(shmring_t *ring);
 
 /* Lifetime push/pop counters, for monitoring/demo purposes. */
 void shmring_stats(shmring_t *ring, uint64_t *out_total_pushed, uint64_t *out_total_popped);
 
+/* Relaxed snapshot of the header metrics (see shmring_metrics_t). The
+ * latency histogram stays empty on SHMRING_TS_NONE rings. */
+void shmring_metrics(shmring_t *ring, shmring_metrics_t *out);
+
 #ifdef __cplusplus
 }
 #endif
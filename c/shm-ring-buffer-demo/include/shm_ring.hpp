@@ -0,0 +1,336 @@
+/*
+ * shm_ring.hpp
+ *
+ * Typed, header-only C++ wrapper over shm_ring.h.
+ *
+ * shm_ring<T, Capacity> carries one trivially copyable T per slot. The
+ * slot stride and index mask are compile-time constants, messages are
+ * constructed directly in their slot (no staging copy, no per-call size
+ * checks), and batches are exposed as views over the slots themselves.
+ *
+ * The segment is an ordinary shm_ring: the wrapper creates/attaches it
+ * through the C API with capacity = Capacity and max_payload = sizeof(T),
+ * and goes through the same lock, cursors and seq/stamp assignment (the
+ * shmring_write_begin()/shmring_read_begin() windows). C and C++ processes
+ * can therefore share one ring; a C reader simply sees len == sizeof(T).
+ *
+ * Errors are the library's SHMRING_* codes, as in the C API.
+ */
+
+#ifndef SHM_RING_HPP
+#define SHM_RING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <shm_ring.h>
+
+template <typename T, uint32_t Capacity>
+class shm_ring {
+    static_assert(std::is_trivially_copyable<T>::value, "slots are shared between processes byte for byte");
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    static_assert(alignof(T) <= 8, "slot payloads are only 8-byte aligned");
+    static_assert(sizeof(T) <= UINT32_MAX - sizeof(shmring_slot_t), "T too large for a slot");
+
+public:
+    static constexpr uint32_t capacity = Capacity;
+    static constexpr uint32_t mask = Capacity - 1;
+    static constexpr uint32_t max_payload = static_cast<uint32_t>(sizeof(T));
+    /* Must match shm_ring.c: align8(sizeof(shmring_slot_t) + max_payload). */
+    static constexpr uint32_t stride = (static_cast<uint32_t>(sizeof(shmring_slot_t)) + max_payload + 7U) & ~7U;
+
+    /* Strided, wrapping view of n consecutive slots starting at cursor pos. */
+    template <typename V>
+    class slot_span {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = V *;
+            using reference = V &;
+
+            iterator(uint8_t *base, uint64_t pos) : base_(base), pos_(pos) {}
+            reference operator*() const { return *payload_at(base_, pos_); }
+            pointer operator->() const { return payload_at(base_, pos_); }
+            iterator &operator++() { ++pos_; return *this; }
+            iterator operator++(int) { iterator it = *this; ++pos_; return it; }
+            bool operator==(const iterator &o) const { return pos_ == o.pos_; }
+            bool operator!=(const iterator &o) const { return pos_ != o.pos_; }
+
+        private:
+            uint8_t *base_;
+            uint64_t pos_;
+        };
+
+        slot_span() = default;
+        slot_span(uint8_t *base, uint64_t pos, uint32_t n) : base_(base), pos_(pos), n_(n) {}
+
+        uint32_t size() const { return n_; }
+        bool empty() const { return n_ == 0; }
+        V &operator[](uint32_t i) const { return *payload_at(base_, pos_ + i); }
+        iterator begin() const { return iterator(base_, pos_); }
+        iterator end() const { return iterator(base_, pos_ + n_); }
+        /* Slot metadata; in a write window only valid once published. */
+        uint64_t seq(uint32_t i) const { return slot_at(base_, pos_ + i)->seq; }
+
+    private:
+        uint8_t *base_ = nullptr;
+        uint64_t pos_ = 0;
+        uint32_t n_ = 0;
+    };
+
+    /*
+     * Write window from write(): up to size() slots to fill in order with
+     * emplace_back(), which returns nullptr once all of them are filled.
+     * Destruction (or publish()) assigns seqs/stamps to the filled ones
+     * and releases the ring lock.
+     */
+    class write_batch {
+    public:
+        write_batch(write_batch &&o) noexcept
+            : ring_(o.ring_), base_(o.base_), pos_(o.pos_), n_(o.n_), filled_(o.filled_), rc_(o.rc_)
+        {
+            o.ring_ = nullptr;
+        }
+        write_batch(const write_batch &) = delete;
+        write_batch &operator=(const write_batch &) = delete;
+        write_batch &operator=(write_batch &&) = delete;
+        ~write_batch() { publish(); }
+
+        int status() const { return rc_; }
+        explicit operator bool() const { return rc_ == SHMRING_OK; }
+        uint32_t size() const { return n_; }
+        uint32_t filled() const { return filled_; }
+
+        template <typename... Args>
+        T *emplace_back(Args &&...args)
+        {
+            if (ring_ == nullptr || filled_ == n_)
+                return nullptr; /* the next slot is not ours */
+
+            shmring_slot_t *slot = slot_at(base_, pos_ + filled_);
+            T *obj = ::new (static_cast<void *>(slot->payload)) T(std::forward<Args>(args)...);
+
+            slot->len = max_payload;
+            filled_++;
+            return obj;
+        }
+
+        /* The slots filled so far, e.g. to read back seqs after publish(). */
+        slot_span<T> span() const { return slot_span<T>(base_, pos_, filled_); }
+
+        int publish()
+        {
+            int rc = SHMRING_OK;
+
+            if (ring_ != nullptr) {
+                rc = shmring_write_end(ring_, filled_);
+                ring_ = nullptr;
+            }
+            return rc;
+        }
+
+    private:
+        friend class shm_ring;
+        write_batch(shmring_t *ring, uint32_t want, int block) : ring_(nullptr)
+        {
+            rc_ = shm_ring::begin(ring, &shmring_write_begin, want, block, &base_, &pos_, &n_);
+            if (rc_ == SHMRING_OK)
+                ring_ = ring;
+        }
+
+        shmring_t *ring_;
+        uint8_t *base_ = nullptr;
+        uint64_t pos_ = 0;
+        uint32_t n_ = 0;
+        uint32_t filled_ = 0;
+        int rc_;
+    };
+
+    /*
+     * Read window from read(): size() queued messages, readable in place
+     * through the span. Destruction releases them all unless release(k)
+     * was called first.
+     */
+    class read_batch {
+    public:
+        read_batch(read_batch &&o) noexcept : ring_(o.ring_), span_(o.span_), rc_(o.rc_) { o.ring_ = nullptr; }
+        read_batch(const read_batch &) = delete;
+        read_batch &operator=(const read_batch &) = delete;
+        read_batch &operator=(read_batch &&) = delete;
+        ~read_batch() { release(span_.size()); }
+
+        int status() const { return rc_; }
+        explicit operator bool() const { return rc_ == SHMRING_OK; }
+        uint32_t size() const { return span_.size(); }
+        const T &operator[](uint32_t i) const { return span_[i]; }
+        typename slot_span<const T>::iterator begin() const { return span_.begin(); }
+        typename slot_span<const T>::iterator end() const { return span_.end(); }
+        const slot_span<const T> &span() const { return span_; }
+
+        /* Consume the first k messages and drop the lock. k > size()
+         * consumes nothing and returns SHMRING_ERR_INVAL. */
+        int release(uint32_t k)
+        {
+            int rc = SHMRING_OK;
+
+            if (ring_ != nullptr) {
+                rc = shmring_read_end(ring_, k); /* checks k against the window */
+                ring_ = nullptr;
+            }
+            return rc;
+        }
+
+    private:
+        friend class shm_ring;
+        read_batch(shmring_t *ring, uint32_t want, int block) : ring_(nullptr)
+        {
+            uint8_t *base = nullptr;
+            uint64_t pos = 0;
+            uint32_t n = 0;
+
+            rc_ = shm_ring::begin(ring, &shmring_read_begin, want, block, &base, &pos, &n);
+            if (rc_ == SHMRING_OK) {
+                ring_ = ring;
+                span_ = slot_span<const T>(base, pos, n);
+            }
+        }
+
+        shmring_t *ring_;
+        slot_span<const T> span_;
+        int rc_;
+    };
+
+    shm_ring() = default;
+    shm_ring(const shm_ring &) = delete;
+    shm_ring &operator=(const shm_ring &) = delete;
+    shm_ring(shm_ring &&o) noexcept : ring_(o.ring_) { o.ring_ = nullptr; }
+    shm_ring &operator=(shm_ring &&o) noexcept
+    {
+        if (this != &o) {
+            close();
+            ring_ = o.ring_;
+            o.ring_ = nullptr;
+        }
+        return *this;
+    }
+    ~shm_ring() { close(); }
+
+    /* Create (or join) ring `name`. `opts` may tune NUMA/timestamps; its
+     * capacity and max_payload are overridden. */
+    int create(const char *name, const shmring_opts_t *opts = nullptr)
+    {
+        shmring_opts_t o;
+
+        if (opts != nullptr)
+            o = *opts;
+        else
+            shmring_opts_init(&o, Capacity, max_payload);
+        o.capacity = Capacity;
+        o.max_payload = max_payload;
+        close();
+        return adopt(shmring_create_ex(name, &o, &ring_));
+    }
+
+    int attach(const char *name)
+    {
+        close();
+        return adopt(shmring_attach(name, &ring_));
+    }
+
+    void close()
+    {
+        shmring_close(ring_);
+        ring_ = nullptr;
+    }
+
+    shmring_t *handle() const { return ring_; }
+
+    /* Construct one T in the tail slot. */
+    template <typename... Args>
+    int emplace(int block, Args &&...args)
+    {
+        write_batch w(ring_, 1, block);
+
+        if (w)
+            w.emplace_back(std::forward<Args>(args)...);
+        return w.status();
+    }
+
+    int push(const T &v, int block = 1) { return emplace(block, v); }
+    bool try_push(const T &v) { return emplace(0, v) == SHMRING_OK; }
+
+    int pop(T &out, int block = 1)
+    {
+        read_batch r(ring_, 1, block);
+
+        if (r)
+            std::memcpy(static_cast<void *>(&out), &r[0], sizeof(T));
+        return r.status();
+    }
+
+    bool try_pop(T &out) { return pop(out, 0) == SHMRING_OK; }
+
+    /* Windows of up to `want` slots; the ring lock is held while they
+     * live, so fill/read them and let them go. */
+    write_batch write(uint32_t want, int block = 1) { return write_batch(ring_, want, block); }
+    read_batch read(uint32_t want, int block = 1) { return read_batch(ring_, want, block); }
+
+private:
+    static shmring_slot_t *slot_at(uint8_t *base, uint64_t pos)
+    {
+        return reinterpret_cast<shmring_slot_t *>(base + (pos & mask) * stride);
+    }
+
+    static T *payload_at(uint8_t *base, uint64_t pos)
+    {
+        return std::launder(reinterpret_cast<T *>(slot_at(base, pos)->payload));
+    }
+
+    /* Open a window and check the live generation still has our layout
+     * (shmring_resize() may have changed the capacity). */
+    static int begin(shmring_t *ring, int (*fn)(shmring_t *, uint32_t, uint64_t *, uint32_t *, int), uint32_t want,
+                     int block, uint8_t **base, uint64_t *pos, uint32_t *n)
+    {
+        int rc;
+
+        if (ring == nullptr)
+            return SHMRING_ERR_INVAL;
+        rc = fn(ring, want, pos, n, block);
+        if (rc != SHMRING_OK)
+            return rc;
+        if (ring->hdr->capacity != Capacity || ring->hdr->slot_stride != stride) {
+            if (fn == &shmring_write_begin)
+                (void)shmring_write_end(ring, 0);
+            else
+                (void)shmring_read_end(ring, 0);
+            return SHMRING_ERR_INVAL;
+        }
+        *base = ring->hdr->slots;
+        return SHMRING_OK;
+    }
+
+    /* A ring that already existed keeps its own geometry: refuse it
+     * unless it matches T and Capacity exactly. */
+    int adopt(int rc)
+    {
+        if (rc == SHMRING_OK &&
+            (ring_->hdr->capacity != Capacity || ring_->hdr->max_payload != max_payload ||
+             ring_->hdr->slot_stride != stride)) {
+            close();
+            return SHMRING_ERR_INVAL;
+        }
+        return rc;
+    }
+
+    shmring_t *ring_ = nullptr;
+};
+
+#endif /* SHM_RING_HPP */
@@ -0,0 +1,140 @@
+/*
+ * shm_shard.h
+ *
+ * A sharded multi-producer ring: one lock-free SPSC sub-ring per producer,
+ * all inside a single POSIX shm segment, drained by one consumer that
+ * merges the sub-rings back into a single stream.
+ *
+ * With shm_ring every push from every writer serialises on the same
+ * mutex, tail and next_seq. Here a producer only ever writes its own
+ * sub-ring's tail and slots, and the consumer only its heads, so
+ * producers never contend with each other. Ordering across producers
+ * comes from one of:
+ *
+ *   SHMSHARD_ORDER_SEQ  one fetch-add on a shared next_seq per push (the
+ *                       only shared write). The consumer pops in seq
+ *                       order; in strict mode it waits for a claimed but
+ *                       not yet published seq instead of skipping ahead,
+ *                       unless the producer that claimed it died.
+ *   SHMSHARD_ORDER_TS   no shared write at all. Slots are merged by their
+ *                       timestamp; seq numbers are per producer.
+ *
+ * See docs/SHM_RING_BUFFER.md, section "分片多生产者环".
+ */
+
+#ifndef SHM_SHARD_H
+#define SHM_SHARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <shm_ring.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHMSHARD_MAGIC         0x53484D54u /* "SHMT"; bumped with the header layout */
+#define SHMSHARD_MAX_PRODUCERS 64U
+#define SHMSHARD_GAP_POLL_MS   10U /* strict consumer: liveness re-check period on a gap */
+
+#define SHMSHARD_ORDER_SEQ 0U
+#define SHMSHARD_ORDER_TS  1U
+
+/*
+ * One SPSC sub-ring. head and tail are free-running counters (slot index
+ * = counter & (capacity - 1)), each on its own cache line: tail is written only
+ * by the owning producer, head only by the consumer. The *_gen words are
+ * futex words, bumped only when the other side announced it is sleeping.
+ */
+typedef struct {
+    uint64_t tail __attribute__((aligned(64)));
+    uint64_t next_local;     /* ORDER_TS: per-producer seq */
+    uint32_t prod_waiting;   /* producer sleeps on space_gen (ring full) */
+    uint32_t space_gen;
+    uint32_t claiming;       /* ORDER_SEQ: set from before next_seq is taken until published */
+    uint64_t head __attribute__((aligned(64)));
+    pid_t owner __attribute__((aligned(64))); /* producer pid, 0 = free */
+    uint64_t slots_off;      /* segment offset of slot 0 */
+} shmshard_sub_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t nshards;
+    uint32_t capacity;       /* slots per sub-ring, a power of two */
+    uint32_t max_payload;
+    uint32_t slot_stride;
+    uint32_t order;          /* SHMSHARD_ORDER_* */
+    uint64_t map_size;
+    uint64_t next_seq __attribute__((aligned(64))); /* ORDER_SEQ only */
+    uint32_t closed __attribute__((aligned(64)));
+    pid_t consumer;          /* pid of the merging consumer, 0 = none */
+    uint32_t cons_waiting;   /* consumer sleeps on data_gen (nothing to pop) */
+    uint32_t data_gen;
+    uint64_t cons_seq;       /* strict mode: next seq the consumer returns */
+    uint64_t gaps_skipped;   /* strict mode: seqs given up on, their producer died */
+    uint64_t total_popped;
+    shmshard_sub_t subs[SHMSHARD_MAX_PRODUCERS];
+    /* sub-ring slots follow, each region cache-line aligned */
+} shmshard_hdr_t;
+
+/* Process-local handle: either a producer (sub >= 0) or the consumer. */
+typedef struct {
+    shmshard_hdr_t *hdr;
+    size_t map_size;
+    int sub;                 /* claimed sub-ring, -1 if not a producer */
+    int consumer;            /* 1 once shmshard_consumer() succeeded */
+    int strict;
+    char name[SHMRING_NAME_MAX];
+} shmshard_t;
+
+/*
+ * Create (or, like shmring_create(), attach to an existing) sharded ring
+ * with `nshards` sub-rings of `capacity` slots each, rounded up to a power
+ * of two like shmring_create(). Returns SHMRING_OK
+ * or a SHMRING_ERR_* code, as everywhere in this library.
+ */
+int shmshard_create(const char *name, uint32_t nshards, uint32_t capacity, uint32_t max_payload, uint32_t order,
+                    shmshard_t **out);
+int shmshard_attach(const char *name, shmshard_t **out);
+
+/* Releases any producer/consumer role held by this handle. */
+void shmshard_close(shmshard_t *s);
+int shmshard_destroy(const char *name);
+
+/*
+ * Claim a free sub-ring for this handle (one per producer process or
+ * thread). A sub-ring whose owner died is reclaimed, together with any
+ * messages still in it. SHMRING_ERR_FULL if every sub-ring is taken.
+ */
+int shmshard_producer(shmshard_t *s);
+
+/*
+ * Become the (single) consumer. `strict` requests total seq order with no
+ * skipping (ORDER_SEQ only; SHMRING_ERR_INVAL otherwise). SHMRING_ERR_FULL
+ * if another live process is already consuming.
+ *
+ * A producer that dies between taking a seq and publishing it leaves a
+ * gap no one will fill. A strict consumer facing a gap re-checks every
+ * SHMSHARD_GAP_POLL_MS whether any live producer is still between those
+ * two steps; once none is, the missing seqs are skipped and added to
+ * hdr->gaps_skipped.
+ */
+int shmshard_consumer(shmshard_t *s, int strict);
+
+/* Same contracts as shmring_push()/shmring_pop(); the handle must hold the
+ * matching role (claimed lazily on first use with strict = 0). */
+int shmshard_push(shmshard_t *s, const void *data, uint32_t len, uint64_t *out_seq, int block);
+int shmshard_pop(shmshard_t *s, void *buf, uint32_t buf_cap, uint32_t *out_len, uint64_t *out_seq,
+                 struct timespec *out_ts, int block);
+
+/* Wake everyone; pushes fail with SHMRING_ERR_CLOSED, pops drain first. */
+void shmshard_shutdown(shmshard_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHM_SHARD_H */
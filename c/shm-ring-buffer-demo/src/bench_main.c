@@ -0,0 +1,826 @@
+/*
+ * bench_main.c
+ *
+ * Throughput and latency harness for the shm_ring library. For every
+ * (payload size, capacity) pair in the sweep it forks the requested number
+ * of producer and consumer processes, optionally pins each to a CPU,
+ * releases them all at once, and reports msgs/s, GB/s and end-to-end
+ * latency percentiles derived from the producer timestamp carried in each
+ * slot.
+ *
+ * Output is one CSV row (or one JSON object per line) per run, so results
+ * from different ring variants/builds can be diffed or plotted directly.
+ *
+ * Usage:
+ *   shm_bench [-p producers] [-c consumers] [-P cpus] [-C cpus]
+ *             [-s sizes] [-q capacities] [-n msgs] [-N node] [-L]
+ *             [-v variant] [-t clock] [-o csv|json]
+ *
+ * Local vs remote NUMA placement on a two-node box, for example:
+ *   shm_bench -N 0 -P 0 -C 1      # ring and both sides on node 0
+ *   shm_bench -N 0 -P 0 -C 16     # consumer on node 1 (CPU 16 there)
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <shm_pool.h>
+#include <shm_shard.h>
+#include <shm_ring.h>
+
+#define BENCH_MAX_PROCS  64
+#define BENCH_MAX_SWEEP  16
+#define BENCH_MAX_CPUS   64
+
+/*
+ * Log-linear latency histogram (HDR-style): values below 2^HIST_SUB_BITS ns
+ * get one bucket each, above that every power of two is split into
+ * 2^HIST_SUB_BITS linear sub-buckets, i.e. ~3% relative error at 5 bits.
+ */
+#define HIST_SUB_BITS    5
+#define HIST_SUB_COUNT   (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS     ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t max_ns;
+} bench_hist_t;
+
+/* Per-consumer results, written by the child into the shared result area. */
+typedef struct {
+    uint64_t msgs;
+    uint64_t bytes;
+    uint64_t end_ns; /* CLOCK_MONOTONIC when the consumer saw CLOSED */
+    bench_hist_t hist;
+} bench_consumer_result_t;
+
+/* MAP_SHARED|MAP_ANONYMOUS area inherited by every forked child. */
+typedef struct {
+    uint32_t ready;    /* children that finished setup */
+    uint32_t go;       /* set by the parent once everybody is ready */
+    uint64_t start_ns; /* CLOCK_MONOTONIC at release */
+    bench_consumer_result_t consumers[BENCH_MAX_PROCS];
+} bench_shared_t;
+
+typedef struct {
+    int producers;
+    int consumers;
+    int prod_cpus[BENCH_MAX_CPUS];
+    int n_prod_cpus;
+    int cons_cpus[BENCH_MAX_CPUS];
+    int n_cons_cpus;
+    uint32_t sizes[BENCH_MAX_SWEEP];
+    int n_sizes;
+    uint32_t capacities[BENCH_MAX_SWEEP];
+    int n_capacities;
+    uint64_t msgs_per_producer;
+    int numa_node;   /* ring placement, SHMRING_NUMA_ANY = first touch */
+    int bind_near;   /* children call shmring_bind_near() instead of -P/-C */
+    const char *variant;
+    int ts_mode;     /* SHMRING_TS_* for shmring_t-based variants */
+    int json;
+} bench_cfg_t;
+
+/* Per-process state of a ring under test. */
+typedef struct {
+    shmring_t *ring;
+    shmpool_t *pool;   /* "pool" variant only */
+    shmshard_t *shard; /* "shard*" variants only */
+} bench_ring_t;
+
+#define BENCH_V_SINGLE_CONSUMER 0x1u /* layout supports exactly one consumer */
+#define BENCH_V_TS_MODES        0x2u /* honours shmring_opts_t.ts_mode (-t) */
+
+/*
+ * A ring variant under test. Everything the harness does to a ring goes
+ * through this table so that alternative ring layouts can be benchmarked
+ * with identical producer/consumer loops and identical output.
+ */
+typedef struct {
+    const char *name;
+    unsigned flags;      /* BENCH_V_* */
+    int (*create)(const char *name, const shmring_opts_t *opts, int producers, bench_ring_t *r);
+    int (*attach)(const char *name, bench_ring_t *r);
+    int (*push)(bench_ring_t *r, const void *data, uint32_t len);
+    /* Returns SHMRING_OK/SHMRING_ERR_CLOSED; *out_ts is the producer stamp. */
+    int (*pop)(bench_ring_t *r, void *buf, uint32_t cap, uint32_t *out_len, struct timespec *out_ts);
+    void (*shutdown)(bench_ring_t *r);
+    void (*close)(bench_ring_t *r);
+    int (*destroy)(const char *name);
+    /* Messages the ring really buffers, after any rounding of -q. */
+    uint32_t (*capacity)(bench_ring_t *r);
+} bench_variant_t;
+
+static int
+mutex_create(const char *name, const shmring_opts_t *opts, int producers, bench_ring_t *r)
+{
+    (void)producers;
+    return shmring_create_ex(name, opts, &r->ring);
+}
+
+static int
+mutex_attach(const char *name, bench_ring_t *r)
+{
+    return shmring_attach(name, &r->ring);
+}
+
+static int
+mutex_push(bench_ring_t *r, const void *data, uint32_t len)
+{
+    return shmring_push(r->ring, data, len, NULL, /*block=*/1);
+}
+
+static int
+mutex_pop(bench_ring_t *r, void *buf, uint32_t cap, uint32_t *out_len, struct timespec *out_ts)
+{
+    return shmring_pop(r->ring, buf, cap, out_len, NULL, out_ts, /*block=*/1);
+}
+
+static void
+mutex_shutdown(bench_ring_t *r)
+{
+    shmring_shutdown(r->ring);
+}
+
+static uint32_t
+mutex_capacity(bench_ring_t *r)
+{
+    return shmring_capacity(r->ring);
+}
+
+static void
+mutex_close(bench_ring_t *r)
+{
+    shmring_close(r->ring);
+    shmpool_close(r->pool);
+    shmshard_close(r->shard);
+}
+
+/*
+ * "pool": the ring carries shmpool_desc_t descriptors, payloads live in a
+ * companion buffer pool named "<ring>.pool" sized for every slot plus one
+ * buffer per possible process. Producers copy into a pool buffer (the one
+ * unavoidable write), consumers copy out and release it, so the measured
+ * work matches "mutex" byte for byte.
+ */
+static void
+pool_name(const char *name, char *out, size_t cap)
+{
+    (void)snprintf(out, cap, "%s.pool", name);
+}
+
+static int
+pool_create(const char *name, const shmring_opts_t *opts, int producers, bench_ring_t *r)
+{
+    char pname[SHMRING_NAME_MAX];
+    shmring_opts_t ropts = *opts;
+    uint32_t slots = 1, count;
+    int rc;
+
+    (void)producers;
+    while (slots < opts->capacity) /* the ring rounds capacity up to a power of two */
+        slots <<= 1;
+    count = slots + 2 * BENCH_MAX_PROCS;
+    pool_name(name, pname, sizeof(pname));
+    rc = shmpool_create(pname, &opts->max_payload, &count, 1, &r->pool);
+    if (rc != SHMRING_OK)
+        return rc;
+    ropts.max_payload = sizeof(shmpool_desc_t);
+    return shmring_create_ex(name, &ropts, &r->ring);
+}
+
+static int
+pool_attach(const char *name, bench_ring_t *r)
+{
+    char pname[SHMRING_NAME_MAX];
+    int rc;
+
+    pool_name(name, pname, sizeof(pname));
+    rc = shmpool_attach(pname, &r->pool);
+    if (rc != SHMRING_OK)
+        return rc;
+    return shmring_attach(name, &r->ring);
+}
+
+static int
+pool_push(bench_ring_t *r, const void *data, uint32_t len)
+{
+    uint64_t off;
+    void *buf;
+    int rc;
+
+    while ((buf = shmpool_alloc(r->pool, len, &off)) == NULL)
+        sched_yield(); /* pool sized above capacity: only transient */
+    memcpy(buf, data, len);
+    rc = shmpool_send(r->ring, r->pool, off, len, NULL, /*block=*/1);
+    if (rc != SHMRING_OK)
+        (void)shmpool_free(r->pool, off);
+    return rc;
+}
+
+static int
+pool_pop(bench_ring_t *r, void *buf, uint32_t cap, uint32_t *out_len, struct timespec *out_ts)
+{
+    shmpool_desc_t desc;
+    void *ptr;
+    int rc;
+
+    rc = shmpool_recv(r->ring, r->pool, &desc, &ptr, NULL, out_ts, /*block=*/1);
+    if (rc != SHMRING_OK)
+        return rc;
+    memcpy(buf, ptr, desc.len < cap ? desc.len : cap);
+    *out_len = desc.len;
+    return shmpool_free(r->pool, desc.off);
+}
+
+static int
+pool_destroy(const char *name)
+{
+    char pname[SHMRING_NAME_MAX];
+
+    pool_name(name, pname, sizeof(pname));
+    (void)shmpool_destroy(pname);
+    return shmring_destroy(name);
+}
+
+/*
+ * "shard" / "shard-ts": one SPSC sub-ring per producer, merged by the
+ * single consumer in global seq order or in timestamp order. The -q
+ * capacity is split across the sub-rings so every variant buffers about
+ * the same number of messages in total (each sub-ring rounds its share up
+ * to a power of two; the capacity column shows the result).
+ */
+static int
+shard_create(const char *name, const shmring_opts_t *opts, int producers, uint32_t order, bench_ring_t *r)
+{
+    uint32_t per = opts->capacity / (uint32_t)producers;
+
+    return shmshard_create(name, (uint32_t)producers, per ? per : 1, opts->max_payload, order, &r->shard);
+}
+
+static int
+shard_seq_create(const char *name, const shmring_opts_t *opts, int producers, bench_ring_t *r)
+{
+    return shard_create(name, opts, producers, SHMSHARD_ORDER_SEQ, r);
+}
+
+static int
+shard_ts_create(const char *name, const shmring_opts_t *opts, int producers, bench_ring_t *r)
+{
+    return shard_create(name, opts, producers, SHMSHARD_ORDER_TS, r);
+}
+
+static int
+shard_attach(const char *name, bench_ring_t *r)
+{
+    return shmshard_attach(name, &r->shard);
+}
+
+static int
+shard_push(bench_ring_t *r, const void *data, uint32_t len)
+{
+    return shmshard_push(r->shard, data, len, NULL, /*block=*/1);
+}
+
+static int
+shard_pop(bench_ring_t *r, void *buf, uint32_t cap, uint32_t *out_len, struct timespec *out_ts)
+{
+    return shmshard_pop(r->shard, buf, cap, out_len, NULL, out_ts, /*block=*/1);
+}
+
+static void
+shard_shutdown(bench_ring_t *r)
+{
+    shmshard_shutdown(r->shard);
+}
+
+static uint32_t
+shard_capacity(bench_ring_t *r)
+{
+    return r->shard->hdr->nshards * r->shard->hdr->capacity;
+}
+
+static const bench_variant_t g_variants[] = {
+    { "mutex", BENCH_V_TS_MODES, mutex_create, mutex_attach, mutex_push, mutex_pop, mutex_shutdown, mutex_close,
+      shmring_destroy, mutex_capacity },
+    { "pool", BENCH_V_TS_MODES, pool_create, pool_attach, pool_push, pool_pop, mutex_shutdown, mutex_close,
+      pool_destroy, mutex_capacity },
+    { "shard", BENCH_V_SINGLE_CONSUMER, shard_seq_create, shard_attach, shard_push, shard_pop, shard_shutdown,
+      mutex_close, shmshard_destroy, shard_capacity },
+    { "shard-ts", BENCH_V_SINGLE_CONSUMER, shard_ts_create, shard_attach, shard_push, shard_pop, shard_shutdown,
+      mutex_close, shmshard_destroy, shard_capacity },
+};
+
+/* Indexed by SHMRING_TS_*. */
+static const char *const g_ts_names[] = { "realtime", "none", "monotonic", "tsc" };
+
+static uint64_t
+now_ns(clockid_t clk)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned
+hist_bucket(uint64_t v)
+{
+    unsigned msb;
+
+    if (v < HIST_SUB_COUNT)
+        return (unsigned)v;
+    msb = 63u - (unsigned)__builtin_clzll(v);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB_COUNT +
+           (unsigned)((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1));
+}
+
+/* Upper bound (inclusive) of the values that land in bucket `b`. */
+static uint64_t
+hist_bucket_high(unsigned b)
+{
+    unsigned group = b / HIST_SUB_COUNT, sub = b % HIST_SUB_COUNT, shift;
+
+    if (group == 0)
+        return b;
+    shift = group - 1;
+    return (((uint64_t)(HIST_SUB_COUNT + sub + 1)) << shift) - 1;
+}
+
+static void
+hist_record(bench_hist_t *h, uint64_t v)
+{
+    h->counts[hist_bucket(v)]++;
+    h->total++;
+    if (v > h->max_ns)
+        h->max_ns = v;
+}
+
+static void
+hist_merge(bench_hist_t *dst, const bench_hist_t *src)
+{
+    for (unsigned i = 0; i < HIST_BUCKETS; i++)
+        dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    if (src->max_ns > dst->max_ns)
+        dst->max_ns = src->max_ns;
+}
+
+static uint64_t
+hist_percentile(const bench_hist_t *h, double pct)
+{
+    uint64_t want, seen = 0;
+
+    if (h->total == 0)
+        return 0;
+    want = (uint64_t)((double)h->total * pct / 100.0 + 0.5);
+    if (want == 0)
+        want = 1;
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= want) {
+            uint64_t hi = hist_bucket_high(i);
+            return hi < h->max_ns ? hi : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+static void
+pin_self(const bench_cfg_t *cfg, shmring_t *ring, const int *cpus, int n, int idx)
+{
+    cpu_set_t set;
+
+    if (cfg->bind_near) {
+        if (ring == NULL)
+            fprintf(stderr, "[bench] -L needs a shmring_t; variant %s has none\n", cfg->variant);
+        else if (shmring_bind_near(ring, NULL) != SHMRING_OK)
+            fprintf(stderr, "[bench] shmring_bind_near: %s\n", strerror(errno));
+        return;
+    }
+    if (n == 0)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[idx % n], &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        fprintf(stderr, "[bench] sched_setaffinity(cpu %d): %s\n", cpus[idx % n], strerror(errno));
+}
+
+static void
+wait_for_go(bench_shared_t *sh)
+{
+    __atomic_add_fetch(&sh->ready, 1, __ATOMIC_ACQ_REL);
+    while (!__atomic_load_n(&sh->go, __ATOMIC_ACQUIRE))
+        sched_yield();
+}
+
+static int
+run_producer(const bench_cfg_t *cfg, const bench_variant_t *v, const char *name, uint32_t size,
+             bench_shared_t *sh, int idx)
+{
+    bench_ring_t ring = { NULL, NULL, NULL };
+    uint8_t *payload;
+    int rc = 0;
+
+    if (v->attach(name, &ring) != SHMRING_OK) {
+        v->close(&ring);
+        return 1;
+    }
+    pin_self(cfg, ring.ring, cfg->prod_cpus, cfg->n_prod_cpus, idx);
+    payload = malloc(size);
+    if (payload == NULL) {
+        v->close(&ring);
+        return 1;
+    }
+    memset(payload, 0xa5, size);
+
+    wait_for_go(sh);
+    for (uint64_t i = 0; i < cfg->msgs_per_producer; i++) {
+        if (v->push(&ring, payload, size) != SHMRING_OK) {
+            rc = 1;
+            break;
+        }
+    }
+    free(payload);
+    v->close(&ring);
+    return rc;
+}
+
+static int
+run_consumer(const bench_cfg_t *cfg, const bench_variant_t *v, const char *name, uint32_t size,
+             bench_shared_t *sh, int idx)
+{
+    bench_consumer_result_t *res = &sh->consumers[idx];
+    bench_ring_t ring = { NULL, NULL, NULL };
+    uint8_t *buf;
+
+    if (v->attach(name, &ring) != SHMRING_OK) {
+        v->close(&ring);
+        return 1;
+    }
+    pin_self(cfg, ring.ring, cfg->cons_cpus, cfg->n_cons_cpus, idx);
+    buf = malloc(size);
+    if (buf == NULL) {
+        v->close(&ring);
+        return 1;
+    }
+
+    wait_for_go(sh);
+    for (;;) {
+        uint32_t len = 0;
+        struct timespec ts, now_ts;
+        uint64_t sent, now;
+
+        if (v->pop(&ring, buf, size, &len, &ts) != SHMRING_OK)
+            break;
+        /* shm_ring variants stamp in the ring's own clock (-t), the
+         * others always with CLOCK_REALTIME. */
+        if (ring.ring == NULL) {
+            now = now_ns(CLOCK_REALTIME);
+        } else if (shmring_now(ring.ring, &now_ts) == SHMRING_OK) {
+            now = (uint64_t)now_ts.tv_sec * 1000000000ull + (uint64_t)now_ts.tv_nsec;
+        } else {
+            now = 0; /* -t none: throughput only */
+        }
+        sent = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+        if (now != 0)
+            hist_record(&res->hist, now > sent ? now - sent : 0);
+        res->msgs++;
+        res->bytes += len;
+    }
+    res->end_ns = now_ns(CLOCK_MONOTONIC);
+    free(buf);
+    v->close(&ring);
+    return 0;
+}
+
+static pid_t
+spawn(int (*fn)(const bench_cfg_t *, const bench_variant_t *, const char *, uint32_t, bench_shared_t *, int),
+      const bench_cfg_t *cfg, const bench_variant_t *v, const char *name, uint32_t size, bench_shared_t *sh,
+      int idx)
+{
+    pid_t pid = fork();
+
+    if (pid == 0)
+        _exit(fn(cfg, v, name, size, sh, idx));
+    return pid;
+}
+
+static void
+print_header(const bench_cfg_t *cfg)
+{
+    if (cfg->json)
+        return;
+    printf("variant,ts,numa_node,producers,consumers,capacity,payload,msgs,seconds,msgs_per_sec,gb_per_sec,"
+           "p50_ns,p90_ns,p99_ns,p999_ns,p9999_ns,max_ns\n");
+}
+
+static void
+print_row(const bench_cfg_t *cfg, uint32_t capacity, uint32_t size, uint64_t msgs, uint64_t bytes,
+          double secs, const bench_hist_t *h)
+{
+    double mps = secs > 0 ? (double)msgs / secs : 0.0;
+    double gbps = secs > 0 ? (double)bytes / secs / 1e9 : 0.0;
+
+    if (cfg->json) {
+        printf("{\"variant\":\"%s\",\"ts\":\"%s\",\"numa_node\":%d,\"producers\":%d,\"consumers\":%d,"
+               "\"capacity\":%u,\"payload\":%u,"
+               "\"msgs\":%" PRIu64 ",\"seconds\":%.6f,\"msgs_per_sec\":%.0f,\"gb_per_sec\":%.4f,"
+               "\"p50_ns\":%" PRIu64 ",\"p90_ns\":%" PRIu64 ",\"p99_ns\":%" PRIu64 ",\"p999_ns\":%" PRIu64
+               ",\"p9999_ns\":%" PRIu64 ",\"max_ns\":%" PRIu64 "}\n",
+               cfg->variant, g_ts_names[cfg->ts_mode], cfg->numa_node, cfg->producers, cfg->consumers, capacity,
+               size, msgs, secs, mps, gbps,
+               hist_percentile(h, 50), hist_percentile(h, 90), hist_percentile(h, 99), hist_percentile(h, 99.9),
+               hist_percentile(h, 99.99), h->max_ns);
+    } else {
+        printf("%s,%s,%d,%d,%d,%u,%u,%" PRIu64 ",%.6f,%.0f,%.4f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+               ",%" PRIu64 "\n",
+               cfg->variant, g_ts_names[cfg->ts_mode], cfg->numa_node, cfg->producers, cfg->consumers, capacity,
+               size, msgs, secs, mps, gbps,
+               hist_percentile(h, 50), hist_percentile(h, 90), hist_percentile(h, 99), hist_percentile(h, 99.9),
+               hist_percentile(h, 99.99), h->max_ns);
+    }
+    fflush(stdout);
+}
+
+/*
+ * Setup failed: kill and reap every child still alive. They may be
+ * spinning in wait_for_go() or blocked on a ring whose peers are gone,
+ * so nothing else is guaranteed to make them exit.
+ */
+static void
+kill_children(pid_t *pids, int n)
+{
+    for (int i = 0; i < n; i++)
+        if (pids[i] > 0)
+            (void)kill(pids[i], SIGKILL);
+    for (int i = 0; i < n; i++)
+        if (pids[i] > 0)
+            (void)waitpid(pids[i], NULL, 0);
+}
+
+static int
+run_one(const bench_cfg_t *cfg, const bench_variant_t *v, uint32_t capacity, uint32_t size)
+{
+    char name[SHMRING_NAME_MAX];
+    pid_t pids[2 * BENCH_MAX_PROCS], *cons = pids, *prod = pids + cfg->consumers;
+    shmring_opts_t opts;
+    bench_shared_t *sh;
+    bench_ring_t ring = { NULL, NULL, NULL };
+    bench_hist_t all;
+    uint64_t msgs = 0, bytes = 0, end_ns = 0;
+    int nprocs = cfg->producers + cfg->consumers;
+    int status, failed = 0;
+
+    (void)snprintf(name, sizeof(name), "/shm_bench.%d", (int)getpid());
+    (void)v->destroy(name); /* leftovers from a killed run */
+    shmring_opts_init(&opts, capacity, size);
+    opts.numa_node = cfg->numa_node;
+    opts.ts_mode = (uint32_t)cfg->ts_mode;
+    if (v->create(name, &opts, cfg->producers, &ring) != SHMRING_OK) {
+        fprintf(stderr, "[bench] create(%s, cap=%u, payload=%u) failed: %s\n", name, capacity, size,
+                strerror(errno));
+        v->close(&ring);
+        (void)v->destroy(name);
+        return 1;
+    }
+
+    sh = mmap(NULL, sizeof(*sh), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sh == MAP_FAILED) {
+        v->close(&ring);
+        (void)v->destroy(name);
+        return 1;
+    }
+
+    for (int i = 0; i < cfg->consumers; i++)
+        cons[i] = spawn(run_consumer, cfg, v, name, size, sh, i);
+    for (int i = 0; i < cfg->producers; i++)
+        prod[i] = spawn(run_producer, cfg, v, name, size, sh, i);
+    for (int i = 0; i < nprocs; i++)
+        if (pids[i] < 0)
+            failed = 1; /* fork failed: that child will never be ready */
+
+    while (!failed && __atomic_load_n(&sh->ready, __ATOMIC_ACQUIRE) < (uint32_t)nprocs) {
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+
+        if (pid > 0) {
+            fprintf(stderr, "[bench] a child exited during setup\n");
+            for (int i = 0; i < nprocs; i++)
+                if (pids[i] == pid)
+                    pids[i] = 0; /* reaped: its pid may be reused */
+            failed = 1;
+        }
+        sched_yield();
+    }
+    if (failed) {
+        v->shutdown(&ring);
+        kill_children(pids, nprocs);
+        fprintf(stderr, "[bench] run cap=%u payload=%u failed during setup\n", capacity, size);
+        goto out;
+    }
+    sh->start_ns = now_ns(CLOCK_MONOTONIC);
+    __atomic_store_n(&sh->go, 1, __ATOMIC_RELEASE);
+
+    /* Producers finish first; closing the ring then lets consumers drain
+     * what is left and return SHMRING_ERR_CLOSED on an empty ring. Reap
+     * in exit order: a child failing mid-run (or a consumer leaving before
+     * the shutdown) can leave its peers blocked on the ring for good, so
+     * the run is then cut short like a failed setup. */
+    for (int left = nprocs, producers_left = cfg->producers; left > 0; left--) {
+        pid_t pid = waitpid(-1, &status, 0);
+        int i = 0;
+
+        if (pid < 0) {
+            if (errno == EINTR) {
+                left++;
+                continue;
+            }
+            failed = 1;
+            break;
+        }
+        while (i < nprocs && pids[i] != pid)
+            i++;
+        if (i == nprocs) {
+            left++; /* not one of this run's children */
+            continue;
+        }
+        pids[i] = 0;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || (i < cfg->consumers && producers_left > 0)) {
+            fprintf(stderr, "[bench] a %s exited abnormally during the run\n",
+                    i < cfg->consumers ? "consumer" : "producer");
+            v->shutdown(&ring);
+            kill_children(pids, nprocs);
+            failed = 1;
+            break;
+        }
+        if (i >= cfg->consumers && --producers_left == 0)
+            v->shutdown(&ring);
+    }
+
+    memset(&all, 0, sizeof(all));
+    for (int i = 0; i < cfg->consumers; i++) {
+        msgs += sh->consumers[i].msgs;
+        bytes += sh->consumers[i].bytes;
+        if (sh->consumers[i].end_ns > end_ns)
+            end_ns = sh->consumers[i].end_ns;
+        hist_merge(&all, &sh->consumers[i].hist);
+    }
+    if (failed)
+        fprintf(stderr, "[bench] run cap=%u payload=%u had failing children\n", capacity, size);
+    else
+        print_row(cfg, v->capacity(&ring), size, msgs, bytes, (double)(end_ns - sh->start_ns) / 1e9, &all);
+
+out:
+    (void)munmap(sh, sizeof(*sh));
+    v->close(&ring);
+    (void)v->destroy(name);
+    return failed;
+}
+
+/* Parse "0,2,4-7" into cpus[]; returns the count or -1. */
+static int
+parse_cpus(const char *s, int *cpus, int max)
+{
+    int n = 0;
+
+    while (*s != '\0') {
+        char *end;
+        long lo = strtol(s, &end, 10), hi;
+
+        if (end == s)
+            return -1;
+        hi = lo;
+        if (*end == '-')
+            hi = strtol(end + 1, &end, 10);
+        for (long c = lo; c <= hi; c++) {
+            if (n == max)
+                return -1;
+            cpus[n++] = (int)c;
+        }
+        if (*end == ',')
+            end++;
+        s = end;
+    }
+    return n;
+}
+
+static int
+parse_u32_list(const char *s, uint32_t *out, int max)
+{
+    int n = 0;
+
+    while (*s != '\0') {
+        char *end;
+        unsigned long v = strtoul(s, &end, 10);
+
+        if (end == s || n == max)
+            return -1;
+        if (*end == 'k' || *end == 'K') {
+            v *= 1024;
+            end++;
+        }
+        out[n++] = (uint32_t)v;
+        if (*end == ',')
+            end++;
+        s = end;
+    }
+    return n;
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options]\n", prog);
+    fprintf(stderr, "  -p N       producer processes (default 1)\n");
+    fprintf(stderr, "  -c N       consumer processes (default 1)\n");
+    fprintf(stderr, "  -P cpus    CPUs for producers, e.g. 0,2 or 0-3 (round-robin; default unpinned)\n");
+    fprintf(stderr, "  -C cpus    CPUs for consumers\n");
+    fprintf(stderr, "  -s sizes   payload sizes to sweep, e.g. 16,64,1k (default 64)\n");
+    fprintf(stderr, "  -q caps    ring capacities to sweep (default 1024)\n");
+    fprintf(stderr, "  -n msgs    messages per producer per run (default 1000000)\n");
+    fprintf(stderr, "  -N node    bind the ring to this NUMA node (default: first touch)\n");
+    fprintf(stderr, "  -L         pin every child next to the ring (shmring_bind_near), overrides -P/-C\n");
+    fprintf(stderr, "  -v variant ring variant:");
+    for (size_t i = 0; i < sizeof(g_variants) / sizeof(g_variants[0]); i++)
+        fprintf(stderr, " %s", g_variants[i].name);
+    fprintf(stderr, " (default %s)\n", g_variants[0].name);
+    fprintf(stderr, "  -t clock   slot timestamps: realtime (default), none, monotonic, tsc\n");
+    fprintf(stderr, "  -o fmt     csv (default) or json (one object per line)\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    bench_cfg_t cfg;
+    const bench_variant_t *v = NULL;
+    int opt, failed = 0;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.producers = 1;
+    cfg.consumers = 1;
+    cfg.sizes[0] = 64;
+    cfg.n_sizes = 1;
+    cfg.capacities[0] = 1024;
+    cfg.n_capacities = 1;
+    cfg.msgs_per_producer = 1000000;
+    cfg.numa_node = SHMRING_NUMA_ANY;
+    cfg.variant = g_variants[0].name;
+
+    while ((opt = getopt(argc, argv, "p:c:P:C:s:q:n:N:Lv:t:o:h")) != -1) {
+        switch (opt) {
+        case 'p': cfg.producers = atoi(optarg); break;
+        case 'c': cfg.consumers = atoi(optarg); break;
+        case 'P': cfg.n_prod_cpus = parse_cpus(optarg, cfg.prod_cpus, BENCH_MAX_CPUS); break;
+        case 'C': cfg.n_cons_cpus = parse_cpus(optarg, cfg.cons_cpus, BENCH_MAX_CPUS); break;
+        case 's': cfg.n_sizes = parse_u32_list(optarg, cfg.sizes, BENCH_MAX_SWEEP); break;
+        case 'q': cfg.n_capacities = parse_u32_list(optarg, cfg.capacities, BENCH_MAX_SWEEP); break;
+        case 'n': cfg.msgs_per_producer = strtoull(optarg, NULL, 10); break;
+        case 'N': cfg.numa_node = atoi(optarg); break;
+        case 'L': cfg.bind_near = 1; break;
+        case 'v': cfg.variant = optarg; break;
+        case 't':
+            cfg.ts_mode = -1;
+            for (size_t i = 0; i < sizeof(g_ts_names) / sizeof(g_ts_names[0]); i++)
+                if (strcmp(optarg, g_ts_names[i]) == 0)
+                    cfg.ts_mode = (int)i;
+            break;
+        case 'o': cfg.json = strcmp(optarg, "json") == 0; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    for (size_t i = 0; i < sizeof(g_variants) / sizeof(g_variants[0]); i++)
+        if (strcmp(cfg.variant, g_variants[i].name) == 0)
+            v = &g_variants[i];
+    if (v == NULL || cfg.ts_mode < 0 || cfg.producers < 1 || cfg.consumers < 1 || cfg.producers > BENCH_MAX_PROCS ||
+        cfg.consumers > BENCH_MAX_PROCS || cfg.n_prod_cpus < 0 || cfg.n_cons_cpus < 0 || cfg.n_sizes <= 0 ||
+        cfg.n_capacities <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if ((v->flags & BENCH_V_SINGLE_CONSUMER) && cfg.consumers != 1) {
+        fprintf(stderr, "[bench] variant %s supports exactly one consumer\n", v->name);
+        return 1;
+    }
+    if (!(v->flags & BENCH_V_TS_MODES) && cfg.ts_mode != SHMRING_TS_REALTIME) {
+        fprintf(stderr, "[bench] variant %s always stamps with CLOCK_REALTIME\n", v->name);
+        return 1;
+    }
+
+    print_header(&cfg);
+    for (int q = 0; q < cfg.n_capacities; q++)
+        for (int s = 0; s < cfg.n_sizes; s++)
+            failed |= run_one(&cfg, v, cfg.capacities[q], cfg.sizes[s]);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,623 @@
+/*
+ * forward_main.c
+ *
+ * Cross-host fan-out for shm_ring. The sender drains a local ring in
+ * batches and streams the messages over TCP; the receiver re-publishes
+ * them into a ring on its own host, where local readers pop them as
+ * usual. Both sides are single-threaded epoll loops built on the helpers
+ * in c/epoll/network_utils.c.
+ *
+ * Usage:
+ *   shm_forward send <ring> <host> <port> [batch]
+ *   shm_forward recv <port> <ring> <capacity> <max_payload>
+ *
+ * Wire format: a byte stream of frames, each a 24-byte big-endian
+ * fwd_frame_t (payload length, flags, seq and timestamp from the source
+ * ring) followed by the payload.
+ *
+ * Flow control is the rings' own backpressure: the sender only drains
+ * its ring while its socket buffer has room, and a receiver connection
+ * whose frames do not fit into the destination ring stops reading until
+ * they do, so TCP's window closes and the source ring fills until its
+ * producers block. The receiver never blocks in the ring itself: one full
+ * ring must not stall the event loop (or Ctrl-C).
+ */
+
+#define _GNU_SOURCE /* accept4 */
+
+#include <endian.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <network_utils.h>
+#include <shm_ring.h>
+
+#define FWD_BATCH_DEFAULT 64U
+#define FWD_BUF_SIZE      (256U * 1024U) /* per-socket staging buffer */
+#define FWD_MAX_CONNS     64
+#define FWD_MAX_EVENTS    64
+#define FWD_CONNECT_RETRY_US 500000
+#define FWD_FULL_RETRY_MS 1 /* epoll timeout while a connection waits for ring space */
+
+#define FWD_F_REALTIME 0x1U /* ts_ns is CLOCK_REALTIME: comparable across hosts */
+
+typedef struct {
+    uint32_t len;   /* payload bytes that follow */
+    uint32_t flags; /* FWD_F_* */
+    uint64_t seq;   /* seq in the source ring */
+    uint64_t ts_ns; /* producer timestamp in the source ring's clock, 0 if none */
+} fwd_frame_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t off; /* sender: first unsent byte */
+    size_t len; /* bytes staged (sender) or received (receiver) */
+} fwd_buf_t;
+
+typedef struct {
+    int fd;
+    fwd_buf_t in;
+    int stalled; /* complete frames in `in` wait for ring space; not polled */
+    int have_seq;
+    uint64_t next_seq;
+    uint64_t frames, gaps, dropped;
+    uint64_t lag_ns, lag_samples;
+} fwd_conn_t;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void
+on_signal(int signo)
+{
+    (void)signo;
+    g_stop++;
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s send <ring> <host> <port> [batch]\n", prog);
+    fprintf(stderr, "       %s recv <port> <ring> <capacity> <max_payload>\n", prog);
+    fprintf(stderr, "  send  drain <ring> in batches of up to <batch> messages (default %u)\n", FWD_BATCH_DEFAULT);
+    fprintf(stderr, "        and stream them to <host>:<port>\n");
+    fprintf(stderr, "  recv  accept senders on <port> and re-publish into <ring>,\n");
+    fprintf(stderr, "        creating it with <capacity>/<max_payload> if needed\n");
+}
+
+static uint64_t
+realtime_ns(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int
+buf_init(fwd_buf_t *b, size_t cap)
+{
+    b->buf = malloc(cap);
+    b->cap = cap;
+    b->off = 0;
+    b->len = 0;
+    return b->buf == NULL ? -1 : 0;
+}
+
+/* Staging buffer size: holds at least one maximal frame. */
+static size_t
+buf_size(uint32_t max_payload)
+{
+    size_t frame_max = sizeof(fwd_frame_t) + max_payload;
+
+    return frame_max > FWD_BUF_SIZE ? frame_max : FWD_BUF_SIZE;
+}
+
+static int
+epoll_set(int efd, int op, int fd, uint32_t events, void *ptr)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = ptr };
+
+    return epoll_ctl(efd, op, fd, &ev);
+}
+
+/* ---- sender ---- */
+
+static int
+connect_to(const char *host, const char *port)
+{
+    struct addrinfo hints, *res, *rp;
+    int fd = -1, one = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &res) != 0)
+        return -1;
+    for (rp = res; rp != NULL; rp = rp->ai_next) {
+        fd = socket(rp->ai_family, rp->ai_socktype | SOCK_CLOEXEC, rp->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, rp->ai_addr, rp->ai_addrlen) == 0)
+            break;
+        (void)close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0)
+        return -1;
+    /* Batching is done here, per drain; don't let Nagle add its own delay. */
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (make_socket_non_blocking(fd) != 0) {
+        (void)close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Copy up to `batch` messages at a time out of the ring into `out` as
+ * frames, while it has room for a maximal one. The ring lock is only held
+ * for the copy, never across a socket call. Returns SHMRING_OK when `out`
+ * is full, else the code that stopped the drain (EMPTY, CLOSED, ...).
+ */
+static int
+stage(shmring_t *ring, fwd_buf_t *out, uint32_t batch, uint64_t *frames)
+{
+    size_t frame_max = sizeof(fwd_frame_t) + ring->hdr->max_payload;
+    uint32_t flags = ring->hdr->ts_mode == SHMRING_TS_REALTIME ? FWD_F_REALTIME : 0;
+
+    while (out->cap - out->len >= frame_max) {
+        size_t fit = (out->cap - out->len) / frame_max;
+        uint32_t want = fit < batch ? (uint32_t)fit : batch;
+        shmring_hdr_t *hdr;
+        uint64_t pos;
+        uint32_t n;
+        int rc;
+
+        rc = shmring_read_begin(ring, want, &pos, &n, /*block=*/0);
+        if (rc != SHMRING_OK)
+            return rc;
+        hdr = ring->hdr;
+        for (uint32_t i = 0; i < n; i++) {
+            const shmring_slot_t *slot =
+                (const shmring_slot_t *)(hdr->slots + ((pos + i) & (hdr->capacity - 1)) * hdr->slot_stride);
+            struct timespec ts = { 0, 0 };
+            fwd_frame_t f;
+
+            if (hdr->ts_mode != SHMRING_TS_NONE)
+                shmring_stamp_to_ts(ring, slot->stamp, &ts);
+            f.len = htobe32(slot->len);
+            f.flags = htobe32(flags);
+            f.seq = htobe64(slot->seq);
+            f.ts_ns = htobe64((uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec);
+            memcpy(out->buf + out->len, &f, sizeof(f));
+            memcpy(out->buf + out->len + sizeof(f), slot->payload, slot->len);
+            out->len += sizeof(f) + slot->len;
+        }
+        (void)shmring_read_end(ring, n);
+        *frames += n;
+    }
+    return SHMRING_OK;
+}
+
+/* Send what is staged. 1 = all sent, 0 = socket full, -1 = error. */
+static int
+flush(int fd, fwd_buf_t *out, uint64_t *bytes)
+{
+    while (out->off < out->len) {
+        ssize_t n = send(fd, out->buf + out->off, out->len - out->off, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        out->off += (size_t)n;
+        *bytes += (uint64_t)n;
+    }
+    out->off = out->len = 0;
+    return 1;
+}
+
+static int
+run_send(const char *name, const char *host, const char *port, uint32_t batch)
+{
+    shmring_t *ring = NULL;
+    fwd_buf_t out;
+    uint64_t frames = 0, bytes = 0;
+    uint32_t sock_events = EPOLLRDHUP;
+    int efd, nfd, sock = -1, rc, ret = 1;
+    int ring_ready = 1, draining = 1;
+
+    /* Like shm_reader: the producers may not have created the ring yet. */
+    while ((rc = shmring_attach(name, &ring)) != SHMRING_OK) {
+        if (g_stop || !(rc == SHMRING_ERR_SYS && errno == ENOENT)) {
+            fprintf(stderr, "[forward] shmring_attach(%s) failed: rc=%d errno=%s\n", name, rc, strerror(errno));
+            return 1;
+        }
+        (void)usleep(FWD_CONNECT_RETRY_US);
+    }
+    if (buf_init(&out, buf_size(ring->hdr->max_payload)) != 0) {
+        shmring_close(ring);
+        return 1;
+    }
+    while (!g_stop && (sock = connect_to(host, port)) < 0)
+        (void)usleep(FWD_CONNECT_RETRY_US);
+    if (sock < 0)
+        goto out;
+    printf("[forward] %s -> %s:%s, batch %u\n", name, host, port, batch);
+
+    efd = epoll_create1(EPOLL_CLOEXEC);
+    if (efd < 0 || shmring_notify_open(ring, &nfd) != SHMRING_OK ||
+        epoll_set(efd, EPOLL_CTL_ADD, nfd, EPOLLIN, &nfd) != 0 ||
+        epoll_set(efd, EPOLL_CTL_ADD, sock, sock_events, &sock) != 0) {
+        perror("[forward] epoll setup");
+        goto out;
+    }
+
+    for (;;) {
+        struct epoll_event evs[2];
+        uint32_t want;
+        int sent, n;
+
+        /* First Ctrl-C: stop draining and send what is staged; second: quit. */
+        if (g_stop > 1)
+            break;
+        if (g_stop)
+            draining = 0;
+
+        if (draining && ring_ready) {
+            rc = stage(ring, &out, batch, &frames);
+            if (rc == SHMRING_ERR_EMPTY) {
+                ring_ready = 0;
+            } else if (rc == SHMRING_ERR_CLOSED) {
+                printf("[forward] ring was shut down, flushing\n");
+                draining = 0;
+            } else if (rc != SHMRING_OK) {
+                fprintf(stderr, "[forward] drain failed: rc=%d\n", rc);
+                break;
+            }
+        }
+
+        sent = flush(sock, &out, &bytes);
+        if (sent < 0) {
+            perror("[forward] send");
+            break;
+        }
+        if (sent && !draining) {
+            ret = 0;
+            break;
+        }
+
+        want = EPOLLRDHUP | (sent ? 0 : EPOLLOUT);
+        if (want != sock_events) {
+            if (epoll_set(efd, EPOLL_CTL_MOD, sock, want, &sock) != 0)
+                break;
+            sock_events = want;
+        }
+        if (sent && ring_ready && draining)
+            continue;
+
+        n = epoll_wait(efd, evs, 2, 1000);
+        for (int i = 0; i < n; i++) {
+            if (evs[i].data.ptr == &nfd) {
+                /* Ack before draining (see shmring_notify_open()). */
+                shmring_notify_ack(ring);
+                ring_ready = 1;
+            } else if (evs[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                fprintf(stderr, "[forward] receiver closed the connection\n");
+                goto out;
+            }
+        }
+        if (n < 0 && errno != EINTR) {
+            perror("[forward] epoll_wait");
+            break;
+        }
+    }
+
+out:
+    printf("[forward] stopping: %" PRIu64 " frames, %" PRIu64 " bytes sent, %zu bytes unsent\n", frames, bytes,
+           out.len - out.off);
+    if (sock >= 0)
+        (void)close(sock);
+    free(out.buf);
+    shmring_close(ring);
+    return ret;
+}
+
+/* ---- receiver ---- */
+
+static void
+conn_close(fwd_conn_t *c)
+{
+    printf("[forward] fd %d closed: %" PRIu64 " frames, %" PRIu64 " seq gaps, %" PRIu64 " dropped (too big)", c->fd,
+           c->frames, c->gaps, c->dropped);
+    if (c->lag_samples != 0)
+        printf(", avg transit %.1fus", (double)c->lag_ns / (double)c->lag_samples / 1000.0);
+    printf("\n");
+    (void)close(c->fd);
+    free(c->in.buf);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+/* Per-connection stats for a frame that has left `in` (published or dropped). */
+static void
+conn_account(fwd_conn_t *c, const uint8_t *frame)
+{
+    fwd_frame_t f;
+    uint64_t seq;
+
+    memcpy(&f, frame, sizeof(f));
+    seq = be64toh(f.seq);
+    if (c->have_seq && seq > c->next_seq)
+        c->gaps += seq - c->next_seq;
+    c->next_seq = seq + 1;
+    c->have_seq = 1;
+    if (be32toh(f.flags) & FWD_F_REALTIME) {
+        uint64_t now = realtime_ns(), ts = be64toh(f.ts_ns);
+
+        if (now > ts) {
+            c->lag_ns += now - ts;
+            c->lag_samples++;
+        }
+    }
+    c->frames++;
+}
+
+/*
+ * Re-publish every complete frame in `c->in`, without blocking, and drop
+ * them from the buffer. Returns 0 when all were published, -1 to close
+ * the connection, or a SHMRING_ERR_* code (> 0): SHMRING_ERR_FULL leaves
+ * the frames that did not fit at the front of the buffer for a retry.
+ */
+static int
+conn_publish(shmring_t *ring, fwd_conn_t *c)
+{
+    const void *data[FWD_BATCH_DEFAULT];
+    uint32_t lens[FWD_BATCH_DEFAULT], nb = 0, pushed;
+    size_t offs[FWD_BATCH_DEFAULT];
+    uint32_t max_payload = ring->hdr->max_payload;
+    size_t off = 0, done = 0;
+    int rc = SHMRING_OK;
+
+    for (;;) {
+        fwd_frame_t f;
+        uint32_t len = 0;
+        int whole = 0;
+
+        if (c->in.len - off >= sizeof(f)) {
+            memcpy(&f, c->in.buf + off, sizeof(f));
+            len = be32toh(f.len);
+            if (len > c->in.cap - sizeof(f)) {
+                fprintf(stderr, "[forward] fd %d: bad frame length %u\n", c->fd, len);
+                return -1;
+            }
+            whole = c->in.len - off >= sizeof(f) + len;
+        }
+
+        /* Push the batch when it is full, at the last complete frame, or
+         * before a frame it cannot carry, so frames are accounted in order. */
+        if (nb != 0 && (nb == FWD_BATCH_DEFAULT || !whole || len > max_payload)) {
+            rc = shmring_push_batch(ring, data, lens, nb, &pushed, NULL, /*block=*/0);
+            for (uint32_t i = 0; i < pushed; i++) {
+                conn_account(c, c->in.buf + offs[i]);
+                done = offs[i] + sizeof(f) + lens[i];
+            }
+            if (rc != SHMRING_OK)
+                break;
+            nb = 0;
+        }
+        if (!whole)
+            break;
+
+        if (len > max_payload) {
+            c->dropped++;
+            conn_account(c, c->in.buf + off);
+            done = off + sizeof(f) + len;
+        } else {
+            offs[nb] = off;
+            data[nb] = c->in.buf + off + sizeof(f);
+            lens[nb++] = len;
+        }
+        off += sizeof(f) + len;
+    }
+    memmove(c->in.buf, c->in.buf + done, c->in.len - done);
+    c->in.len -= done;
+    return rc;
+}
+
+/*
+ * Read once from `c` and re-publish every complete frame. Returns as
+ * conn_publish().
+ */
+static int
+conn_read(shmring_t *ring, fwd_conn_t *c)
+{
+    ssize_t n;
+
+    n = read(c->fd, c->in.buf + c->in.len, c->in.cap - c->in.len);
+    if (n == 0)
+        return -1;
+    if (n < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    c->in.len += (size_t)n;
+    return conn_publish(ring, c);
+}
+
+/*
+ * Stop polling a connection whose frames wait for ring space (its unread
+ * bytes stay in the socket, closing the TCP window), or resume it.
+ */
+static int
+conn_stall(int efd, fwd_conn_t *c, int stalled)
+{
+    int rc;
+
+    if (stalled)
+        rc = epoll_ctl(efd, EPOLL_CTL_DEL, c->fd, NULL);
+    else
+        rc = epoll_set(efd, EPOLL_CTL_ADD, c->fd, EPOLLIN | EPOLLRDHUP, c);
+    if (rc == 0)
+        c->stalled = stalled;
+    return rc;
+}
+
+static void
+accept_all(int efd, int lfd, fwd_conn_t *conns, size_t buf_cap)
+{
+    for (;;) {
+        int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        fwd_conn_t *c = NULL;
+
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("[forward] accept");
+            return;
+        }
+        for (int i = 0; i < FWD_MAX_CONNS; i++) {
+            if (conns[i].fd < 0) {
+                c = &conns[i];
+                break;
+            }
+        }
+        if (c == NULL || buf_init(&c->in, buf_cap) != 0) {
+            fprintf(stderr, "[forward] rejecting connection: no free slot\n");
+            (void)close(fd);
+            continue;
+        }
+        c->fd = fd;
+        if (epoll_set(efd, EPOLL_CTL_ADD, fd, EPOLLIN | EPOLLRDHUP, c) != 0) {
+            conn_close(c);
+            continue;
+        }
+        printf("[forward] sender connected on fd %d\n", fd);
+    }
+}
+
+static int
+run_recv(const char *port, const char *name, uint32_t capacity, uint32_t max_payload)
+{
+    static fwd_conn_t conns[FWD_MAX_CONNS];
+    struct epoll_event evs[FWD_MAX_EVENTS];
+    shmring_t *ring = NULL;
+    int efd, lfd, rc, ret = 1;
+
+    rc = shmring_create(name, capacity, max_payload, &ring);
+    if (rc != SHMRING_OK) {
+        fprintf(stderr, "[forward] shmring_create(%s) failed: rc=%d errno=%s\n", name, rc, strerror(errno));
+        return 1;
+    }
+    for (int i = 0; i < FWD_MAX_CONNS; i++)
+        conns[i].fd = -1;
+
+    lfd = create_and_bind((char *)port);
+    if (lfd < 0 || make_socket_non_blocking(lfd) != 0 || listen(lfd, SOMAXCONN) != 0) {
+        perror("[forward] listen");
+        shmring_close(ring);
+        return 1;
+    }
+    efd = epoll_create1(EPOLL_CLOEXEC);
+    if (efd < 0 || epoll_set(efd, EPOLL_CTL_ADD, lfd, EPOLLIN, NULL) != 0) {
+        perror("[forward] epoll setup");
+        goto out;
+    }
+    printf("[forward] listening on port %s -> ring '%s' (capacity=%u, max_payload=%u)\n", port, name,
+           shmring_capacity(ring), ring->hdr->max_payload);
+
+    while (!g_stop) {
+        int n, nstalled = 0;
+
+        /* The ring has no "space freed" fd (its notify fd only fires on
+         * empty -> non-empty), so stalled connections retry on a short
+         * epoll timeout instead. */
+        for (int i = 0; i < FWD_MAX_CONNS; i++) {
+            fwd_conn_t *c = &conns[i];
+
+            if (c->fd < 0 || !c->stalled)
+                continue;
+            rc = conn_publish(ring, c);
+            if (rc == SHMRING_ERR_FULL) {
+                nstalled++;
+            } else if (rc > 0) {
+                fprintf(stderr, "[forward] publish into '%s' failed: rc=%d\n", name, rc);
+                goto out;
+            } else if (rc < 0 || conn_stall(efd, c, 0) != 0) {
+                conn_close(c);
+            }
+        }
+
+        n = epoll_wait(efd, evs, FWD_MAX_EVENTS, nstalled ? FWD_FULL_RETRY_MS : 1000);
+        if (n < 0 && errno != EINTR) {
+            perror("[forward] epoll_wait");
+            goto out;
+        }
+        for (int i = 0; i < n; i++) {
+            fwd_conn_t *c = evs[i].data.ptr;
+
+            if (c == NULL) {
+                accept_all(efd, lfd, conns, buf_size(ring->hdr->max_payload));
+                continue;
+            }
+            rc = (evs[i].events & EPOLLIN) ? conn_read(ring, c) : -1;
+            if (rc == SHMRING_ERR_FULL) {
+                if (conn_stall(efd, c, 1) != 0)
+                    conn_close(c);
+                continue;
+            }
+            if (rc > 0) {
+                fprintf(stderr, "[forward] publish into '%s' failed: rc=%d\n", name, rc);
+                goto out;
+            }
+            /* EPOLLRDHUP with data still queued: keep reading until EOF. */
+            if (rc < 0)
+                conn_close(c);
+        }
+    }
+    ret = 0;
+
+out:
+    for (int i = 0; i < FWD_MAX_CONNS; i++) {
+        if (conns[i].fd >= 0)
+            conn_close(&conns[i]);
+    }
+    (void)close(lfd);
+    shmring_close(ring);
+    return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    (void)sigaction(SIGINT, &sa, NULL);
+    (void)sigaction(SIGTERM, &sa, NULL);
+
+    if (argc >= 5 && strcmp(argv[1], "send") == 0) {
+        uint32_t batch = argc > 5 ? (uint32_t)strtoul(argv[5], NULL, 10) : FWD_BATCH_DEFAULT;
+
+        if (batch == 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        return run_send(argv[2], argv[3], argv[4], batch);
+    }
+    if (argc >= 6 && strcmp(argv[1], "recv") == 0)
+        return run_recv(argv[2], argv[3], (uint32_t)strtoul(argv[4], NULL, 10),
+                        (uint32_t)strtoul(argv[5], NULL, 10));
+    usage(argv[0]);
+    return 1;
+}
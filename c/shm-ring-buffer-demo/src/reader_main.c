@@ -5,15 +5,21 @@
  * buffer created by a writer process (retrying until it appears), pops
  * messages, and prints their content plus end-to-end latency.
  *
+ * In "epoll" mode the reader never blocks inside shmring_pop(); it waits
+ * on the ring's readiness fd instead, the way a reader that also serves
+ * sockets and timers from one event loop would.
+ *
  * Usage:
- *   shm_reader <name> [count]
+ *   shm_reader <name> [count] [cond|epoll]
  */
 
+#include <errno.h>
 #include <inttypes.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -31,9 +37,11 @@ on_signal(int signo)
 static void
 usage(const char *prog)
 {
-    fprintf(stderr, "Usage: %s <name> [count]\n", prog);
-    fprintf(stderr, "  name   POSIX shared memory object name (must match the writer)\n");
+    fprintf(stderr, "Usage: %s <name> [count] [cond|epoll]\n", prog);
+    fprintf(stderr, "  name   POSIX shared memory object name, or file:<path> (must match the writer)\n");
     fprintf(stderr, "  count  number of messages to pop (0 or omitted = run until Ctrl-C/closed)\n");
+    fprintf(stderr, "  mode   cond: block in shmring_pop() (default)\n");
+    fprintf(stderr, "         epoll: wait on the ring's readiness fd, pop non-blocking\n");
 }
 
 static double
@@ -45,6 +53,24 @@ ts_diff_ms(const struct timespec *from, const struct timespec *to)
     return ms;
 }
 
+/*
+ * Wait until the ring may have data. Returns 0 to go and drain it, 1 on
+ * timeout/signal (caller re-checks g_stop), -1 on error.
+ */
+static int
+wait_readable(shmring_t *ring, int efd)
+{
+    struct epoll_event ev;
+    int n = epoll_wait(efd, &ev, 1, 1000);
+
+    if (n < 0)
+        return (errno == EINTR) ? 1 : -1;
+    if (n == 0)
+        return 1;
+    shmring_notify_ack(ring);
+    return 0;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -53,6 +79,7 @@ main(int argc, char **argv)
     struct sigaction sa;
     shmring_t *ring = NULL;
     uint8_t buf[4096];
+    int use_epoll, efd = -1;
     int rc;
 
     if (argc < 2) {
@@ -61,6 +88,7 @@ main(int argc, char **argv)
     }
     name = argv[1];
     count = (argc > 2) ? strtoull(argv[2], NULL, 10) : 0;
+    use_epoll = (argc > 3) && strcmp(argv[3], "epoll") == 0;
 
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = on_signal;
@@ -80,12 +108,44 @@ main(int argc, char **argv)
     }
     printf("[reader] attached to '%s'\n", name);
 
+    /* A persistent ring may hold messages a previous run of this reader
+     * popped but never committed (it crashed or was killed); start again
+     * from the last checkpoint. */
+    if (strncmp(name, SHMRING_FILE_PREFIX, sizeof(SHMRING_FILE_PREFIX) - 1) == 0) {
+        uint64_t resume = 0;
+
+        if (shmring_recover(ring, &resume) == SHMRING_OK)
+            printf("[reader] resuming at committed seq=%" PRIu64 " (%u queued)\n", resume, shmring_count(ring));
+    }
+
+    if (use_epoll) {
+        struct epoll_event ev = { .events = EPOLLIN };
+        int nfd;
+
+        efd = epoll_create1(EPOLL_CLOEXEC);
+        if (efd < 0 || shmring_notify_open(ring, &nfd) != SHMRING_OK) {
+            fprintf(stderr, "[reader] cannot set up readiness fd: %s\n", strerror(errno));
+            shmring_close(ring);
+            return 1;
+        }
+        ev.data.fd = nfd;
+        (void)epoll_ctl(efd, EPOLL_CTL_ADD, nfd, &ev);
+        printf("[reader] epoll mode, readiness fd=%d\n", nfd);
+    }
+
     while (!g_stop && (count == 0 || received < count)) {
         uint32_t len = 0;
         uint64_t seq = 0;
         struct timespec produced_ts, now;
 
-        rc = shmring_pop(ring, buf, sizeof(buf) - 1, &len, &seq, &produced_ts, /*block=*/1);
+        rc = shmring_pop(ring, buf, sizeof(buf) - 1, &len, &seq, &produced_ts, /*block=*/!use_epoll);
+        if (rc == SHMRING_ERR_EMPTY) {
+            if (wait_readable(ring, efd) < 0) {
+                perror("[reader] epoll_wait");
+                break;
+            }
+            continue;
+        }
         if (rc == SHMRING_ERR_CLOSED) {
             printf("[reader] ring was shut down by writer, stopping\n");
             break;
@@ -99,10 +159,18 @@ main(int argc, char **argv)
             len = (uint32_t)sizeof(buf) - 1;
         buf[len] = '\0';
 
-        (void)clock_gettime(CLOCK_REALTIME, &now);
-        printf("[reader] popped seq=%" PRIu64 " len=%u \"%s\" latency=%.3fms (ring_count=%u)\n", seq, len, (char *)buf,
-               ts_diff_ms(&produced_ts, &now), shmring_count(ring));
+        /* Latency in the ring's own clock; rings created with
+         * SHMRING_TS_NONE carry no stamp. */
+        if (shmring_now(ring, &now) == SHMRING_OK)
+            printf("[reader] popped seq=%" PRIu64 " len=%u \"%s\" latency=%.3fms (ring_count=%u)\n", seq, len,
+                   (char *)buf, ts_diff_ms(&produced_ts, &now), shmring_count(ring));
+        else
+            printf("[reader] popped seq=%" PRIu64 " len=%u \"%s\" (ring_count=%u)\n", seq, len, (char *)buf,
+                   shmring_count(ring));
         received++;
+
+        /* Message fully handled: checkpoint it (no-op on shm rings). */
+        (void)shmring_commit(ring, seq);
     }
 
     {
@@ -114,6 +182,8 @@ main(int argc, char **argv)
 
     /* Only unmap our local view; the shared memory object itself is left
      * alone so other readers/writers can keep using it. */
+    if (efd >= 0)
+        (void)close(efd);
     shmring_close(ring);
     return 0;
 }
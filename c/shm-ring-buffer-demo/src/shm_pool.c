@@ -0,0 +1,372 @@
+/*
+ * shm_pool.c
+ *
+ * Implementation of the shared-memory buffer pool declared in shm_pool.h.
+ * Segment creation/attach follows shm_ring.c: O_EXCL election, magic
+ * published last with a release store, two-phase mmap on attach.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <shm_pool.h>
+
+#define SHMPOOL_ATTACH_RETRIES  100
+#define SHMPOOL_ATTACH_DELAY_US 10000U /* 10ms */
+
+#define TAGGED_IDX(h)      ((uint32_t)(h))
+#define TAGGED_NEXT(h, i)  ((((h) >> 32) + 1) << 32 | (uint64_t)(i))
+
+static uint64_t
+align_up(uint64_t n, uint64_t a)
+{
+    return (n + a - 1) & ~(a - 1);
+}
+
+static inline uint32_t *
+class_next(shmpool_hdr_t *hdr, shmpool_class_t *c)
+{
+    return (uint32_t *)((uint8_t *)hdr + c->next_off);
+}
+
+/* Lay out classes; returns the total segment size. */
+static size_t
+plan_layout(shmpool_hdr_t *hdr, const uint32_t *sizes, const uint32_t *counts, uint32_t nclasses)
+{
+    uint64_t off = align_up(sizeof(*hdr), SHMPOOL_ALIGN);
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->nclasses = nclasses;
+    for (uint32_t i = 0; i < nclasses; i++) {
+        shmpool_class_t *c = &hdr->classes[i];
+
+        c->buf_size = (uint32_t)align_up(sizes[i], SHMPOOL_ALIGN);
+        c->nbufs = counts[i];
+        c->next_off = off;
+        off = align_up(off + (uint64_t)counts[i] * sizeof(uint32_t), SHMPOOL_ALIGN);
+    }
+    /* Buffers after all link arrays, page aligned so large frames start
+     * on a page boundary. */
+    off = align_up(off, (uint64_t)sysconf(_SC_PAGESIZE));
+    for (uint32_t i = 0; i < nclasses; i++) {
+        shmpool_class_t *c = &hdr->classes[i];
+
+        c->buf_off = off;
+        off += (uint64_t)c->buf_size * c->nbufs;
+    }
+    hdr->map_size = off;
+    return (size_t)off;
+}
+
+static shmpool_t *
+alloc_handle(void *base, size_t map_size, const char *name)
+{
+    shmpool_t *pool = (shmpool_t *)calloc(1, sizeof(*pool));
+
+    if (pool == NULL)
+        return NULL;
+    pool->hdr = (shmpool_hdr_t *)base;
+    pool->map_size = map_size;
+    (void)snprintf(pool->name, sizeof(pool->name), "%s", name);
+    return pool;
+}
+
+static int
+create_and_init(int fd, const char *name, const uint32_t *sizes, const uint32_t *counts, uint32_t nclasses,
+                shmpool_t **out)
+{
+    uint32_t s[SHMPOOL_MAX_CLASSES], n[SHMPOOL_MAX_CLASSES];
+    shmpool_hdr_t plan, *hdr;
+    size_t full_size;
+    void *base;
+
+    /* Keep classes sorted by size so alloc can stop at the first fit
+     * (insertion sort; there are at most SHMPOOL_MAX_CLASSES). */
+    for (uint32_t i = 0; i < nclasses; i++) {
+        uint32_t j = i;
+
+        for (; j > 0 && s[j - 1] > sizes[i]; j--) {
+            s[j] = s[j - 1];
+            n[j] = n[j - 1];
+        }
+        s[j] = sizes[i];
+        n[j] = counts[i];
+    }
+    full_size = plan_layout(&plan, s, n, nclasses);
+
+    if (ftruncate(fd, (off_t)full_size) != 0)
+        return SHMRING_ERR_SYS;
+    base = mmap(NULL, full_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        return SHMRING_ERR_SYS;
+
+    hdr = (shmpool_hdr_t *)base;
+    memcpy(hdr, &plan, sizeof(plan));
+    for (uint32_t i = 0; i < nclasses; i++) {
+        shmpool_class_t *c = &hdr->classes[i];
+        uint32_t *next = class_next(hdr, c);
+
+        /* Thread every buffer onto the free list: i -> i+1 -> ... -> empty. */
+        for (uint32_t b = 0; b < c->nbufs; b++)
+            next[b] = (b + 1 < c->nbufs) ? b + 2 : 0;
+        c->free_head = c->nbufs ? 1 : 0;
+    }
+    __atomic_store_n(&hdr->magic, SHMPOOL_MAGIC, __ATOMIC_RELEASE);
+
+    *out = alloc_handle(base, full_size, name);
+    if (*out == NULL) {
+        (void)munmap(base, full_size);
+        return SHMRING_ERR_SYS;
+    }
+    return SHMRING_OK;
+}
+
+static int
+attach_once(const char *name, shmpool_t **out)
+{
+    struct stat st;
+    shmpool_hdr_t *tmp;
+    size_t full_size;
+    void *map;
+    int fd;
+
+    fd = shm_open(name, O_RDWR, 0660);
+    if (fd < 0)
+        return SHMRING_ERR_SYS;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(shmpool_hdr_t)) {
+        (void)close(fd);
+        errno = EAGAIN;
+        return SHMRING_ERR_SYS;
+    }
+
+    map = mmap(NULL, sizeof(shmpool_hdr_t), PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        (void)close(fd);
+        return SHMRING_ERR_SYS;
+    }
+    tmp = (shmpool_hdr_t *)map;
+    if (__atomic_load_n(&tmp->magic, __ATOMIC_ACQUIRE) != SHMPOOL_MAGIC) {
+        (void)munmap(map, sizeof(shmpool_hdr_t));
+        (void)close(fd);
+        errno = EAGAIN;
+        return SHMRING_ERR_SYS;
+    }
+    full_size = (size_t)tmp->map_size;
+    (void)munmap(map, sizeof(shmpool_hdr_t));
+
+    if ((size_t)st.st_size < full_size) {
+        (void)close(fd);
+        errno = EAGAIN;
+        return SHMRING_ERR_SYS;
+    }
+    map = mmap(NULL, full_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    (void)close(fd);
+    if (map == MAP_FAILED)
+        return SHMRING_ERR_SYS;
+
+    *out = alloc_handle(map, full_size, name);
+    if (*out == NULL) {
+        (void)munmap(map, full_size);
+        return SHMRING_ERR_SYS;
+    }
+    return SHMRING_OK;
+}
+
+int
+shmpool_create(const char *name, const uint32_t *sizes, const uint32_t *counts, uint32_t nclasses,
+               shmpool_t **out)
+{
+    int fd, rc;
+
+    if (name == NULL || out == NULL || sizes == NULL || counts == NULL || nclasses == 0 ||
+        nclasses > SHMPOOL_MAX_CLASSES || strlen(name) >= SHMRING_NAME_MAX)
+        return SHMRING_ERR_INVAL;
+    for (uint32_t i = 0; i < nclasses; i++)
+        if (sizes[i] == 0 || counts[i] == 0)
+            return SHMRING_ERR_INVAL;
+    *out = NULL;
+
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd >= 0) {
+        rc = create_and_init(fd, name, sizes, counts, nclasses, out);
+        (void)close(fd);
+        if (rc != SHMRING_OK)
+            (void)shm_unlink(name);
+        return rc;
+    }
+    if (errno != EEXIST)
+        return SHMRING_ERR_SYS;
+
+    for (int attempt = 0; attempt < SHMPOOL_ATTACH_RETRIES; attempt++) {
+        rc = attach_once(name, out);
+        if (rc == SHMRING_OK)
+            return SHMRING_OK;
+        (void)usleep(SHMPOOL_ATTACH_DELAY_US);
+    }
+    return rc;
+}
+
+int
+shmpool_attach(const char *name, shmpool_t **out)
+{
+    if (name == NULL || out == NULL || strlen(name) >= SHMRING_NAME_MAX)
+        return SHMRING_ERR_INVAL;
+    *out = NULL;
+    return attach_once(name, out);
+}
+
+void
+shmpool_close(shmpool_t *pool)
+{
+    if (pool == NULL)
+        return;
+    if (pool->hdr != NULL)
+        (void)munmap(pool->hdr, pool->map_size);
+    free(pool);
+}
+
+int
+shmpool_destroy(const char *name)
+{
+    if (name == NULL)
+        return SHMRING_ERR_INVAL;
+    return shm_unlink(name) == 0 ? SHMRING_OK : SHMRING_ERR_SYS;
+}
+
+void *
+shmpool_alloc(shmpool_t *pool, uint32_t size, uint64_t *out_off)
+{
+    shmpool_hdr_t *hdr;
+
+    if (pool == NULL || pool->hdr == NULL || out_off == NULL)
+        return NULL;
+    hdr = pool->hdr;
+
+    for (uint32_t i = 0; i < hdr->nclasses; i++) {
+        shmpool_class_t *c = &hdr->classes[i];
+        uint32_t *next = class_next(hdr, c);
+        uint64_t head, want;
+        uint32_t idx;
+
+        if (c->buf_size < size)
+            continue;
+
+        /* Treiber-stack pop. Reading next[idx - 1] of a buffer someone
+         * else just popped is harmless: the tag makes our CAS fail. */
+        head = __atomic_load_n(&c->free_head, __ATOMIC_ACQUIRE);
+        do {
+            idx = TAGGED_IDX(head);
+            if (idx == 0)
+                break;
+            want = TAGGED_NEXT(head, __atomic_load_n(&next[idx - 1], __ATOMIC_RELAXED));
+        } while (!__atomic_compare_exchange_n(&c->free_head, &head, want, /*weak=*/1, __ATOMIC_ACQUIRE,
+                                              __ATOMIC_ACQUIRE));
+        if (idx == 0)
+            continue; /* class exhausted; try the next larger one */
+
+        __atomic_add_fetch(&c->in_use, 1, __ATOMIC_RELAXED);
+        *out_off = c->buf_off + (uint64_t)(idx - 1) * c->buf_size;
+        return (uint8_t *)hdr + *out_off;
+    }
+    return NULL;
+}
+
+static shmpool_class_t *
+class_of(shmpool_hdr_t *hdr, uint64_t off, uint32_t *out_idx)
+{
+    for (uint32_t i = 0; i < hdr->nclasses; i++) {
+        shmpool_class_t *c = &hdr->classes[i];
+        uint64_t end = c->buf_off + (uint64_t)c->buf_size * c->nbufs;
+
+        if (off >= c->buf_off && off < end) {
+            if ((off - c->buf_off) % c->buf_size != 0)
+                return NULL;
+            *out_idx = (uint32_t)((off - c->buf_off) / c->buf_size);
+            return c;
+        }
+    }
+    return NULL;
+}
+
+int
+shmpool_free(shmpool_t *pool, uint64_t off)
+{
+    shmpool_class_t *c;
+    uint32_t *next, idx;
+    uint64_t head, want;
+
+    if (pool == NULL || pool->hdr == NULL)
+        return SHMRING_ERR_INVAL;
+    c = class_of(pool->hdr, off, &idx);
+    if (c == NULL)
+        return SHMRING_ERR_INVAL;
+    next = class_next(pool->hdr, c);
+
+    /* Treiber-stack push; the release CAS publishes next[idx] and every
+     * write the consumer made to the buffer before handing it back. */
+    head = __atomic_load_n(&c->free_head, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(&next[idx], TAGGED_IDX(head), __ATOMIC_RELAXED);
+        want = TAGGED_NEXT(head, idx + 1);
+    } while (!__atomic_compare_exchange_n(&c->free_head, &head, want, /*weak=*/1, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+    __atomic_sub_fetch(&c->in_use, 1, __ATOMIC_RELAXED);
+    return SHMRING_OK;
+}
+
+void *
+shmpool_ptr(shmpool_t *pool, uint64_t off)
+{
+    uint32_t idx;
+
+    if (pool == NULL || pool->hdr == NULL || class_of(pool->hdr, off, &idx) == NULL)
+        return NULL;
+    return (uint8_t *)pool->hdr + off;
+}
+
+int
+shmpool_send(shmring_t *ring, shmpool_t *pool, uint64_t off, uint32_t len, uint64_t *out_seq, int block)
+{
+    shmpool_desc_t desc;
+    uint32_t idx;
+    shmpool_class_t *c;
+
+    if (pool == NULL || pool->hdr == NULL)
+        return SHMRING_ERR_INVAL;
+    c = class_of(pool->hdr, off, &idx);
+    if (c == NULL)
+        return SHMRING_ERR_INVAL;
+    if (len > c->buf_size)
+        return SHMRING_ERR_TOOBIG;
+
+    desc.off = off;
+    desc.len = len;
+    desc.reserved = 0;
+    return shmring_push(ring, &desc, sizeof(desc), out_seq, block);
+}
+
+int
+shmpool_recv(shmring_t *ring, shmpool_t *pool, shmpool_desc_t *desc, void **out_ptr, uint64_t *out_seq,
+             struct timespec *out_ts, int block)
+{
+    uint32_t len = 0;
+    int rc;
+
+    if (desc == NULL || out_ptr == NULL)
+        return SHMRING_ERR_INVAL;
+    rc = shmring_pop(ring, desc, sizeof(*desc), &len, out_seq, out_ts, block);
+    if (rc != SHMRING_OK)
+        return rc;
+    if (len != sizeof(*desc))
+        return SHMRING_ERR_INVAL;
+    *out_ptr = shmpool_ptr(pool, desc->off);
+    return *out_ptr != NULL ? SHMRING_OK : SHMRING_ERR_INVAL;
+}
@@ -12,10 +12,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
 #include <sys/mman.h>
+#include <sched.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
 #include <unistd.h>
 
+#include <linux/mempolicy.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
 #include <shm_ring.h>
 
 /* Number of times shmring_create() retries attaching after losing the
@@ -25,16 +35,277 @@
 #define SHMRING_CREATE_RACE_RETRIES 100
 #define SHMRING_CREATE_RACE_DELAY_US 10000U /* 10ms */
 
+#define SHMRING_BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+#define SHMRING_NODE_CPULIST "/sys/devices/system/node/node%d/cpulist"
+#define SHMRING_MAX_NUMA_NODES 1024
+#define SHMRING_TSC_CALIBRATE_NS 10000000ull /* 10ms */
+#define SHMRING_TSC_SHIFT        32U
+
 static uint32_t
 align_up8(uint32_t n)
 {
     return (n + 7u) & ~7u;
 }
 
+/* Smallest power of two >= n, for 1 <= n <= SHMRING_MAX_CAPACITY. */
+static uint32_t
+round_up_pow2(uint32_t n)
+{
+    return n <= 1 ? 1 : 1U << (32 - __builtin_clz(n - 1));
+}
+
+/*
+ * Validate a published header before trusting its geometry: a ring file
+ * may have been written by a binary with a different header layout, and a
+ * capacity that is not a power of two would break the cursor masks.
+ * Returns 0, or -1 with errno EPROTO (other layout) or EINVAL (geometry
+ * this layout cannot have produced).
+ */
+static int
+check_layout(const shmring_hdr_t *hdr)
+{
+    uint32_t capacity = hdr->capacity;
+
+    if (hdr->magic == SHMRING_MAGIC_V0 || hdr->layout_version != SHMRING_LAYOUT_VERSION) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (capacity < SHMRING_MIN_CAPACITY || capacity > SHMRING_MAX_CAPACITY || (capacity & (capacity - 1)) != 0 ||
+        hdr->max_payload == 0 || hdr->slot_stride != align_up8((uint32_t)sizeof(shmring_slot_t) + hdr->max_payload)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Slot holding free-running cursor `pos`; capacity is a power of two. */
 static inline shmring_slot_t *
-shmring_slot_at(shmring_hdr_t *hdr, uint32_t idx)
+shmring_slot_at(shmring_hdr_t *hdr, uint64_t pos)
+{
+    return (shmring_slot_t *)(hdr->slots + (size_t)(pos & (hdr->capacity - 1)) * hdr->slot_stride);
+}
+
+/* Occupied slots (queued, not counting pending); caller holds the lock. */
+static inline uint32_t
+used_locked(const shmring_hdr_t *hdr)
+{
+    return (uint32_t)(hdr->tail - hdr->head);
+}
+
+static int
+is_file_name(const char *name)
+{
+    return strncmp(name, SHMRING_FILE_PREFIX, sizeof(SHMRING_FILE_PREFIX) - 1) == 0;
+}
+
+static const char *
+file_path(const char *name)
+{
+    return name + sizeof(SHMRING_FILE_PREFIX) - 1;
+}
+
+/*
+ * Checksum stored in each slot of a persistent ring, so recovery can tell
+ * a fully written slot from one torn by power loss (page writeback order
+ * is arbitrary). FNV-1a: cheap, and only needs to catch torn writes.
+ */
+static uint32_t
+slot_checksum(const shmring_slot_t *slot)
+{
+    const uint8_t *p;
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    p = (const uint8_t *)&slot->seq;
+    for (i = 0; i < sizeof(slot->seq); i++)
+        h = (h ^ p[i]) * 16777619u;
+    p = (const uint8_t *)&slot->len;
+    for (i = 0; i < sizeof(slot->len); i++)
+        h = (h ^ p[i]) * 16777619u;
+    for (i = 0; i < slot->len; i++)
+        h = (h ^ slot->payload[i]) * 16777619u;
+    return h;
+}
+
+static inline uint64_t
+clock_ns(clockid_t clk)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t
+read_tsc(void)
+{
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Measure the TSC against CLOCK_MONOTONIC over a short busy window and
+ * store a fixed-point ticks->ns factor in the header. The pair is read
+ * back to back, so the base point is exact to within one clock read.
+ */
+static int
+calibrate_tsc(shmring_hdr_t *hdr)
+{
+#if defined(__x86_64__)
+    uint64_t t0, c0, t1, c1;
+
+    t0 = clock_ns(CLOCK_MONOTONIC);
+    c0 = read_tsc();
+    do {
+        t1 = clock_ns(CLOCK_MONOTONIC);
+        c1 = read_tsc();
+    } while (t1 - t0 < SHMRING_TSC_CALIBRATE_NS);
+    if (c1 <= c0)
+        return -1;
+
+    hdr->tsc_shift = SHMRING_TSC_SHIFT;
+    hdr->tsc_mult = (uint64_t)(((unsigned __int128)(t1 - t0) << SHMRING_TSC_SHIFT) / (c1 - c0));
+    hdr->tsc_base = c1;
+    hdr->tsc_base_ns = t1;
+    return 0;
+#else
+    (void)hdr;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+/* Raw stamp for a new slot, taken outside the ring lock. */
+static inline uint64_t
+take_stamp(const shmring_hdr_t *hdr)
+{
+    switch (hdr->ts_mode) {
+    case SHMRING_TS_NONE:      return 0;
+    case SHMRING_TS_MONOTONIC: return clock_ns(CLOCK_MONOTONIC);
+    case SHMRING_TS_TSC:       return read_tsc();
+    default:                   return clock_ns(CLOCK_REALTIME);
+    }
+}
+
+static void
+stamp_to_ts(const shmring_hdr_t *hdr, uint64_t stamp, struct timespec *out)
+{
+    uint64_t ns = stamp;
+
+    if (hdr->ts_mode == SHMRING_TS_TSC) {
+        /* Signed delta: a stamp from another CPU may be slightly older
+         * than the calibration point. */
+        int64_t d = (int64_t)(stamp - hdr->tsc_base);
+        __int128 off = ((__int128)d * (__int128)hdr->tsc_mult) >> hdr->tsc_shift;
+
+        ns = hdr->tsc_base_ns + (uint64_t)(int64_t)off;
+    }
+    out->tv_sec = (time_t)(ns / 1000000000ull);
+    out->tv_nsec = (long)(ns % 1000000000ull);
+}
+
+/* Current boot id, or all zeroes if unavailable (never treated as a reboot). */
+static void
+read_boot_id(char out[SHMRING_BOOT_ID_LEN])
 {
-    return (shmring_slot_t *)(hdr->slots + (size_t)idx * hdr->slot_stride);
+    ssize_t n = 0;
+    int fd = open(SHMRING_BOOT_ID_PATH, O_RDONLY | O_CLOEXEC);
+
+    memset(out, 0, SHMRING_BOOT_ID_LEN);
+    if (fd < 0)
+        return;
+    n = read(fd, out, SHMRING_BOOT_ID_LEN - 1);
+    (void)close(fd);
+    if (n <= 0)
+        memset(out, 0, SHMRING_BOOT_ID_LEN);
+    else if (out[n - 1] == '\n')
+        out[n - 1] = '\0';
+}
+
+/* Flush the page(s) holding the header of a file-backed mapping. */
+static int
+sync_header(shmring_hdr_t *hdr)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    size_t len = (sizeof(*hdr) + (size_t)page - 1) & ~((size_t)page - 1);
+
+    return msync(hdr, len, MS_SYNC);
+}
+
+/*
+ * NUMA helpers. Raw syscalls rather than libnuma so the library keeps its
+ * -lpthread -lrt only link line; the policy constants come from the
+ * kernel UAPI header.
+ */
+#define NODE_MASK_WORDS (SHMRING_MAX_NUMA_NODES / (8 * sizeof(unsigned long)))
+
+static void
+node_mask(unsigned long mask[NODE_MASK_WORDS], int node)
+{
+    memset(mask, 0, NODE_MASK_WORDS * sizeof(unsigned long));
+    mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+}
+
+static int
+numa_bind_range(void *addr, size_t len, int node)
+{
+    unsigned long mask[NODE_MASK_WORDS];
+
+    if (node < 0 || node >= SHMRING_MAX_NUMA_NODES) {
+        errno = EINVAL;
+        return -1;
+    }
+    node_mask(mask, node);
+    return (int)syscall(SYS_mbind, addr, len, MPOL_BIND, mask, (unsigned long)SHMRING_MAX_NUMA_NODES,
+                        MPOL_MF_STRICT | MPOL_MF_MOVE);
+}
+
+static int
+numa_node_of(void *addr)
+{
+    int node = -1;
+
+    if (syscall(SYS_get_mempolicy, &node, NULL, 0UL, addr, (unsigned long)(MPOL_F_NODE | MPOL_F_ADDR)) != 0)
+        return -1;
+    return node;
+}
+
+/* Parse /sys/.../nodeN/cpulist ("0-3,8-11") into `set`. */
+static int
+numa_node_cpus(int node, cpu_set_t *set)
+{
+    char path[64], buf[1024];
+    char *p;
+    ssize_t n;
+    int fd;
+
+    (void)snprintf(path, sizeof(path), SHMRING_NODE_CPULIST, node);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    n = read(fd, buf, sizeof(buf) - 1);
+    (void)close(fd);
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+
+    CPU_ZERO(set);
+    for (p = buf; *p != '\0' && *p != '\n';) {
+        long lo = strtol(p, &p, 10), hi = lo;
+
+        if (*p == '-')
+            hi = strtol(p + 1, &p, 10);
+        for (long c = lo; c <= hi && c < CPU_SETSIZE; c++)
+            CPU_SET((int)c, set);
+        if (*p == ',')
+            p++;
+        else
+            break;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
 }
 
 /*
@@ -56,21 +327,111 @@ lock_ring(shmring_hdr_t *hdr)
     return rc;
 }
 
+static shmring_t *
+alloc_handle(void *base, size_t map_size, const char *name)
+{
+    shmring_t *ring = (shmring_t *)calloc(1, sizeof(*ring));
+
+    if (ring == NULL)
+        return NULL;
+    ring->hdr = (shmring_hdr_t *)base;
+    ring->map_size = map_size;
+    ring->notify_fd = -1;
+    ring->persist = is_file_name(name);
+    (void)snprintf(ring->name, sizeof(ring->name), "%s", name);
+    return ring;
+}
+
+/* Handle usable for operations that write the segment. */
+static inline int
+writable(const shmring_t *ring)
+{
+    return ring != NULL && ring->hdr != NULL && !ring->readonly;
+}
+
+/* shm object holding generation `gen` of ring `name`. */
+static int
+seg_name(const char *name, uint32_t gen, char *out, size_t cap)
+{
+    int n = gen == 0 ? snprintf(out, cap, "%s", name) : snprintf(out, cap, "%s.g%u", name, gen);
+
+    return (n < 0 || (size_t)n >= cap) ? -1 : 0;
+}
+
+static inline int
+seg_moved(shmring_hdr_t *hdr)
+{
+    return __atomic_load_n(&hdr->latest_gen, __ATOMIC_ACQUIRE) != hdr->gen;
+}
+
+/* The FIFO of a shm ring lives in SHMRING_NOTIFY_DIR; that of a file-backed
+ * ring sits next to the file. */
+static int
+notify_path(const char *name, char *path, size_t cap)
+{
+    int n;
+
+    if (is_file_name(name))
+        n = snprintf(path, cap, "%s%s", file_path(name), SHMRING_NOTIFY_SUFFIX);
+    else
+        n = snprintf(path, cap, "%s%s%s%s", SHMRING_NOTIFY_DIR, name[0] == '/' ? "" : "/", name,
+                     SHMRING_NOTIFY_SUFFIX);
+
+    return (n < 0 || (size_t)n >= cap) ? -1 : 0;
+}
+
+/*
+ * Open (creating if needed) the readiness FIFO for this ring. O_RDWR on a
+ * FIFO is Linux-specific but exactly what we want here: the open never
+ * blocks waiting for a peer, and because every opener also holds a write
+ * end, readers never see EOF/POLLHUP when the last writer goes away.
+ */
+static int
+notify_fd_get(shmring_t *ring)
+{
+    char path[sizeof(SHMRING_NOTIFY_DIR) + SHMRING_NAME_MAX + sizeof(SHMRING_NOTIFY_SUFFIX)];
+    int fd;
+
+    if (ring->notify_fd >= 0)
+        return ring->notify_fd;
+    if (notify_path(ring->name, path, sizeof(path)) != 0) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (mkfifo(path, 0660) != 0 && errno != EEXIST)
+        return -1;
+    fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ring->notify_fd = fd;
+    return fd;
+}
+
+/*
+ * Post one wakeup. Called outside the ring lock. A full pipe (EAGAIN)
+ * means readers already have a wakeup pending, so it is not an error.
+ */
+static void
+notify_signal(shmring_t *ring)
+{
+    static const uint8_t one = 1;
+    int fd;
+
+    if (!__atomic_load_n(&ring->hdr->notify, __ATOMIC_ACQUIRE))
+        return;
+    fd = notify_fd_get(ring);
+    if (fd >= 0)
+        (void)write(fd, &one, sizeof(one));
+}
+
+/* (Re)initialise the process-shared lock and condvars in place. */
 static int
-init_shared_header(shmring_hdr_t *hdr, uint32_t capacity, uint32_t max_payload)
+init_sync(shmring_hdr_t *hdr)
 {
     pthread_mutexattr_t mattr;
     pthread_condattr_t cattr;
     int rc;
 
-    /* Zero everything first; the magic is published last (with a release
-     * store) so that any process observing magic == SHMRING_MAGIC via an
-     * acquire load is guaranteed to see every field written below it. */
-    memset(hdr, 0, sizeof(*hdr));
-    hdr->capacity = capacity;
-    hdr->max_payload = max_payload;
-    hdr->slot_stride = align_up8((uint32_t)sizeof(shmring_slot_t) + max_payload);
-
     rc = pthread_mutexattr_init(&mattr);
     if (rc != 0)
         return rc;
@@ -92,6 +453,32 @@ init_shared_header(shmring_hdr_t *hdr, uint32_t capacity, uint32_t max_payload)
     if (rc == 0)
         rc = pthread_cond_init(&hdr->not_empty, &cattr);
     (void)pthread_condattr_destroy(&cattr);
+    return rc;
+}
+
+static int
+init_shared_header(shmring_hdr_t *hdr, const shmring_opts_t *opts, uint32_t flags)
+{
+    uint32_t capacity = opts->capacity, max_payload = opts->max_payload;
+    int rc;
+
+    /* Zero everything first; the magic is published last (with a release
+     * store) so that any process observing magic == SHMRING_MAGIC via an
+     * acquire load is guaranteed to see every field written below it. */
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->layout_version = SHMRING_LAYOUT_VERSION;
+    hdr->capacity = capacity;
+    hdr->max_payload = max_payload;
+    hdr->slot_stride = align_up8((uint32_t)sizeof(shmring_slot_t) + max_payload);
+    hdr->flags = flags;
+    hdr->numa_node = opts->numa_node;
+    hdr->ts_mode = opts->ts_mode;
+    if (flags & SHMRING_F_PERSIST)
+        read_boot_id(hdr->boot_id);
+    if (hdr->ts_mode == SHMRING_TS_TSC && calibrate_tsc(hdr) != 0)
+        return -1;
+
+    rc = init_sync(hdr);
     if (rc != 0)
         return rc;
 
@@ -99,11 +486,40 @@ init_shared_header(shmring_hdr_t *hdr, uint32_t capacity, uint32_t max_payload)
     return 0;
 }
 
+/*
+ * Persistent-ring recovery; caller holds the lock (or exclusive access).
+ * Re-queues every popped-but-uncommitted message, then walks forward from
+ * ckpt and keeps only the prefix whose seqs continue committed_seq and
+ * whose checksums match. Returns the seq the next pop will see.
+ */
+static uint64_t
+recover_locked(shmring_hdr_t *hdr)
+{
+    uint64_t live = hdr->tail - hdr->ckpt;
+    uint32_t valid;
+
+    if (live > hdr->capacity)
+        live = hdr->capacity;
+    for (valid = 0; valid < live; valid++) {
+        shmring_slot_t *slot = shmring_slot_at(hdr, hdr->ckpt + valid);
+
+        if (slot->seq != hdr->committed_seq + valid || slot->len > hdr->max_payload ||
+            slot->crc != slot_checksum(slot))
+            break;
+    }
+
+    hdr->head = hdr->ckpt;
+    hdr->tail = hdr->ckpt + valid;
+    hdr->pending = 0;
+    hdr->next_seq = hdr->committed_seq + valid;
+    return hdr->committed_seq;
+}
+
 static int
-create_and_init(int fd, const char *name, uint32_t capacity, uint32_t max_payload, shmring_t **out)
+create_and_init(int fd, const char *name, const shmring_opts_t *opts, shmring_t **out)
 {
-    uint32_t slot_stride = align_up8((uint32_t)sizeof(shmring_slot_t) + max_payload);
-    size_t full_size = sizeof(shmring_hdr_t) + (size_t)capacity * (size_t)slot_stride;
+    uint32_t slot_stride = align_up8((uint32_t)sizeof(shmring_slot_t) + opts->max_payload);
+    size_t full_size = sizeof(shmring_hdr_t) + (size_t)opts->capacity * (size_t)slot_stride;
     void *base;
     shmring_hdr_t *hdr;
     shmring_t *ring;
@@ -115,20 +531,25 @@ create_and_init(int fd, const char *name, uint32_t capacity, uint32_t max_payloa
     if (base == MAP_FAILED)
         return SHMRING_ERR_SYS;
 
+    /* Bind before the first touch: for a shm object the policy is stored
+     * on the object itself, so every later mapper's page faults land on
+     * the same node, whichever CPU they run on. */
+    if (opts->numa_node != SHMRING_NUMA_ANY && numa_bind_range(base, full_size, opts->numa_node) != 0) {
+        (void)munmap(base, full_size);
+        return SHMRING_ERR_SYS;
+    }
+
     hdr = (shmring_hdr_t *)base;
-    if (init_shared_header(hdr, capacity, max_payload) != 0) {
+    if (init_shared_header(hdr, opts, 0) != 0) {
         (void)munmap(base, full_size);
         return SHMRING_ERR_SYS;
     }
 
-    ring = (shmring_t *)calloc(1, sizeof(*ring));
+    ring = alloc_handle(base, full_size, name);
     if (ring == NULL) {
         (void)munmap(base, full_size);
         return SHMRING_ERR_SYS;
     }
-    ring->hdr = hdr;
-    ring->map_size = full_size;
-    (void)snprintf(ring->name, sizeof(ring->name), "%s", name);
 
     *out = ring;
     return SHMRING_OK;
@@ -141,18 +562,24 @@ create_and_init(int fd, const char *name, uint32_t capacity, uint32_t max_payloa
  * remap the whole segment once we know its real size.
  */
 static int
-attach_once(const char *name, shmring_t **out)
+attach_once(const char *name, const char *seg, int readonly, shmring_t **out)
 {
+    int prot = readonly ? PROT_READ : PROT_READ | PROT_WRITE;
     int fd;
     struct stat st;
     void *hdr_map;
     shmring_hdr_t *tmp_hdr;
-    uint32_t capacity, slot_stride;
+    uint32_t magic, capacity, slot_stride;
     size_t full_size;
     void *full_map;
     shmring_t *ring;
 
-    fd = shm_open(name, O_RDWR, 0660);
+    /* File-backed rings only come through here read-only; writers go
+     * through file_open() for its locking and recovery. */
+    if (is_file_name(name))
+        fd = open(file_path(name), O_RDONLY | O_CLOEXEC);
+    else
+        fd = shm_open(seg, readonly ? O_RDONLY : O_RDWR, 0660);
     if (fd < 0)
         return SHMRING_ERR_SYS;
 
@@ -162,17 +589,22 @@ attach_once(const char *name, shmring_t **out)
         return SHMRING_ERR_SYS;
     }
 
-    hdr_map = mmap(NULL, sizeof(shmring_hdr_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    hdr_map = mmap(NULL, sizeof(shmring_hdr_t), PROT_READ, MAP_SHARED, fd, 0);
     if (hdr_map == MAP_FAILED) {
         (void)close(fd);
         return SHMRING_ERR_SYS;
     }
 
     tmp_hdr = (shmring_hdr_t *)hdr_map;
-    if (__atomic_load_n(&tmp_hdr->magic, __ATOMIC_ACQUIRE) != SHMRING_MAGIC) {
+    magic = __atomic_load_n(&tmp_hdr->magic, __ATOMIC_ACQUIRE);
+    if (magic != SHMRING_MAGIC || check_layout(tmp_hdr) != 0) {
+        /* No magic yet: the creator is still initialising, try again.
+         * Anything else is a header we must not map with this layout. */
+        int err = magic == 0 ? EAGAIN : magic == SHMRING_MAGIC ? errno : EPROTO;
+
         (void)munmap(hdr_map, sizeof(shmring_hdr_t));
         (void)close(fd);
-        errno = EAGAIN;
+        errno = err;
         return SHMRING_ERR_SYS;
     }
 
@@ -187,133 +619,674 @@ attach_once(const char *name, shmring_t **out)
         return SHMRING_ERR_SYS;
     }
 
-    full_map = mmap(NULL, full_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    full_map = mmap(NULL, full_size, prot, MAP_SHARED, fd, 0);
     (void)close(fd);
     if (full_map == MAP_FAILED)
         return SHMRING_ERR_SYS;
 
-    ring = (shmring_t *)calloc(1, sizeof(*ring));
+    ring = alloc_handle(full_map, full_size, name);
     if (ring == NULL) {
         (void)munmap(full_map, full_size);
         return SHMRING_ERR_SYS;
     }
-    ring->hdr = (shmring_hdr_t *)full_map;
-    ring->map_size = full_size;
-    (void)snprintf(ring->name, sizeof(ring->name), "%s", name);
+    ring->readonly = readonly;
 
     *out = ring;
     return SHMRING_OK;
 }
 
-int
-shmring_create(const char *name, uint32_t capacity, uint32_t max_payload, shmring_t **out)
+/* latest_gen as recorded in the generation-0 segment, or -1. */
+static int64_t
+root_latest_gen(const char *name)
 {
-    int fd, rc;
-
-    if (name == NULL || out == NULL || capacity < SHMRING_MIN_CAPACITY || max_payload == 0)
-        return SHMRING_ERR_INVAL;
-    *out = NULL;
+    shmring_hdr_t *root;
+    int64_t gen = -1;
+    int fd;
 
-    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0660);
-    if (fd >= 0) {
-        rc = create_and_init(fd, name, capacity, max_payload, out);
-        (void)close(fd);
-        if (rc != SHMRING_OK)
-            (void)shm_unlink(name);
-        return rc;
-    }
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return -1;
+    root = mmap(NULL, sizeof(*root), PROT_READ, MAP_SHARED, fd, 0);
+    (void)close(fd);
+    if (root == MAP_FAILED)
+        return -1;
+    gen = __atomic_load_n(&root->latest_gen, __ATOMIC_ACQUIRE);
+    (void)munmap(root, sizeof(*root));
+    return gen;
+}
 
-    if (errno != EEXIST)
-        return SHMRING_ERR_SYS;
+/*
+ * Swap the handle over to the live generation. Called without any ring
+ * lock held. The generation read from the root can be superseded (and
+ * its segment unlinked) before we open it; ENOENT just means "look again".
+ */
+static int
+follow(shmring_t *ring)
+{
+    char seg[SHMRING_NAME_MAX + 16];
+    shmring_t *live = NULL;
+    int64_t gen;
+    int rc = SHMRING_ERR_SYS;
 
-    /* Another writer won the race to create the object. It may still be
-     * between shm_open() and finishing ftruncate()+init, so retry attach
-     * briefly instead of failing immediately. */
     for (int attempt = 0; attempt < SHMRING_CREATE_RACE_RETRIES; attempt++) {
-        rc = attach_once(name, out);
+        gen = root_latest_gen(ring->name);
+        if (gen < 0 || seg_name(ring->name, (uint32_t)gen, seg, sizeof(seg)) != 0)
+            return SHMRING_ERR_SYS;
+        rc = attach_once(ring->name, seg, ring->readonly, &live);
         if (rc == SHMRING_OK)
-            return SHMRING_OK;
-        (void)usleep(SHMRING_CREATE_RACE_DELAY_US);
+            break;
+        if (errno != ENOENT && errno != EAGAIN)
+            return rc;
     }
-    return rc;
-}
+    if (rc != SHMRING_OK)
+        return rc;
 
-int
-shmring_attach(const char *name, shmring_t **out)
-{
-    if (name == NULL || out == NULL)
-        return SHMRING_ERR_INVAL;
-    *out = NULL;
-    return attach_once(name, out);
+    (void)munmap(ring->hdr, ring->map_size);
+    ring->hdr = live->hdr;
+    ring->map_size = live->map_size;
+    free(live);
+    return SHMRING_OK;
 }
 
-void
-shmring_close(shmring_t *ring)
+/* Attach to the generation-0 segment, then to the live one if resized. */
+static int
+attach_live(const char *name, int readonly, shmring_t **out)
 {
-    if (ring == NULL)
-        return;
-    if (ring->hdr != NULL)
-        (void)munmap(ring->hdr, ring->map_size);
-    free(ring);
+    int rc = attach_once(name, name, readonly, out);
+
+    if (rc == SHMRING_OK && seg_moved((*out)->hdr) && follow(*out) != SHMRING_OK) {
+        shmring_close(*out);
+        *out = NULL;
+        return SHMRING_ERR_SYS;
+    }
+    return rc;
 }
 
-int
-shmring_destroy(const char *name)
+/*
+ * Lock the live generation of the ring, following resizes as needed.
+ * Returns with ring->hdr locked and current.
+ */
+static int
+lock_live(shmring_t *ring)
 {
-    if (name == NULL)
-        return SHMRING_ERR_INVAL;
-    if (shm_unlink(name) != 0)
-        return SHMRING_ERR_SYS;
-    return SHMRING_OK;
+    for (;;) {
+        shmring_hdr_t *hdr = ring->hdr;
+
+        if (lock_ring(hdr) != 0)
+            return -1;
+        if (!seg_moved(hdr))
+            return 0;
+        (void)pthread_mutex_unlock(&hdr->lock);
+        if (follow(ring) != SHMRING_OK)
+            return -1;
+    }
 }
 
-int
-shmring_push(shmring_t *ring, const void *data, uint32_t len, uint64_t *out_seq, int block)
+/*
+ * Open (and with `create`, create) a file-backed persistent ring. Unlike
+ * shm objects, a ring file outlives reboots and crashes, so every opener
+ * takes flock(LOCK_EX) for the duration of the open; that replaces the
+ * O_EXCL election and magic polling of the shm path, and lets the first
+ * opener after a reboot safely re-initialise lock/condvars whose futex
+ * words still reference threads of the previous boot.
+ */
+static int
+file_open(const char *name, const shmring_opts_t *opts, shmring_t **out)
 {
+    const char *path = file_path(name);
+    char boot_id[SHMRING_BOOT_ID_LEN];
+    int create = (opts != NULL);
+    uint32_t capacity = create ? opts->capacity : 0, max_payload = create ? opts->max_payload : 0;
+    struct stat st;
     shmring_hdr_t *hdr;
-    int rc = SHMRING_OK;
+    shmring_t *ring;
+    size_t full_size;
+    void *base;
+    uint32_t magic;
+    int fd, fresh = 1;
 
-    if (ring == NULL || ring->hdr == NULL || (len != 0 && data == NULL))
-        return SHMRING_ERR_INVAL;
+    fd = open(path, O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0660);
+    if (fd < 0)
+        return SHMRING_ERR_SYS;
+    if (flock(fd, LOCK_EX) != 0 || fstat(fd, &st) != 0)
+        goto fail;
 
-    hdr = ring->hdr;
-    if (len > hdr->max_payload)
-        return SHMRING_ERR_TOOBIG;
+    /* A file shorter than a header, or whose magic was never published
+     * (creator died mid-init), is treated as not yet created. */
+    if ((size_t)st.st_size >= sizeof(shmring_hdr_t)) {
+        base = mmap(NULL, sizeof(shmring_hdr_t), PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED)
+            goto fail;
+        hdr = (shmring_hdr_t *)base;
+        magic = __atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE);
+        if (magic == SHMRING_MAGIC_V0 || (magic == SHMRING_MAGIC && (hdr->flags & SHMRING_F_PERSIST))) {
+            /* A ring written with another layout is refused, never
+             * re-created: truncating it would throw its messages away. */
+            if (check_layout(hdr) != 0) {
+                (void)munmap(base, sizeof(shmring_hdr_t));
+                goto fail;
+            }
+            fresh = 0;
+            capacity = hdr->capacity;
+            max_payload = hdr->max_payload;
+        }
+        (void)munmap(base, sizeof(shmring_hdr_t));
+    }
+    if (fresh && !create) {
+        errno = ENOENT;
+        goto fail;
+    }
 
-    if (lock_ring(hdr) != 0)
+    full_size = sizeof(shmring_hdr_t) +
+                (size_t)capacity * align_up8((uint32_t)sizeof(shmring_slot_t) + max_payload);
+    if (fresh) {
+        /* Truncate to zero first so no stale slot survives a re-create. */
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)full_size) != 0)
+            goto fail;
+    } else if ((size_t)st.st_size < full_size) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    base = mmap(NULL, full_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        goto fail;
+    hdr = (shmring_hdr_t *)base;
+
+    if (fresh) {
+        if (init_shared_header(hdr, opts, SHMRING_F_PERSIST) != 0)
+            goto fail_unmap;
+    } else {
+        read_boot_id(boot_id);
+        if (boot_id[0] != '\0' && memcmp(boot_id, hdr->boot_id, sizeof(boot_id)) != 0) {
+            /* Nobody from this boot has the ring mapped (we hold the file
+             * lock and are the first to see the new boot id), so it is safe
+             * to rebuild the sync objects and recover without locking. */
+            if (init_sync(hdr) != 0)
+                goto fail_unmap;
+            (void)recover_locked(hdr);
+            hdr->notify = 0;
+            memcpy(hdr->boot_id, boot_id, sizeof(boot_id));
+        }
+        if (create && lock_ring(hdr) == 0) {
+            hdr->closed = 0;
+            (void)pthread_mutex_unlock(&hdr->lock);
+        }
+    }
+    (void)sync_header(hdr);
+
+    ring = alloc_handle(base, full_size, name);
+    if (ring == NULL)
+        goto fail_unmap;
+    (void)close(fd); /* also drops the flock */
+    *out = ring;
+    return SHMRING_OK;
+
+fail_unmap:
+    (void)munmap(base, full_size);
+fail:
+    {
+        int saved = errno;
+
+        (void)close(fd);
+        errno = saved;
+    }
+    return SHMRING_ERR_SYS;
+}
+
+void
+shmring_opts_init(shmring_opts_t *opts, uint32_t capacity, uint32_t max_payload)
+{
+    memset(opts, 0, sizeof(*opts));
+    opts->capacity = capacity;
+    opts->max_payload = max_payload;
+    opts->numa_node = SHMRING_NUMA_ANY;
+}
+
+int
+shmring_create(const char *name, uint32_t capacity, uint32_t max_payload, shmring_t **out)
+{
+    shmring_opts_t opts;
+
+    shmring_opts_init(&opts, capacity, max_payload);
+    return shmring_create_ex(name, &opts, out);
+}
+
+int
+shmring_create_ex(const char *name, const shmring_opts_t *opts, shmring_t **out)
+{
+    shmring_opts_t o;
+    int fd, rc;
+
+    if (name == NULL || out == NULL || opts == NULL || opts->capacity < SHMRING_MIN_CAPACITY ||
+        opts->capacity > SHMRING_MAX_CAPACITY || opts->max_payload == 0 || opts->ts_mode > SHMRING_TS_TSC ||
+        strlen(name) >= SHMRING_NAME_MAX)
+        return SHMRING_ERR_INVAL;
+#if !defined(__x86_64__)
+    if (opts->ts_mode == SHMRING_TS_TSC)
+        return SHMRING_ERR_INVAL;
+#endif
+    *out = NULL;
+    o = *opts;
+    o.capacity = round_up_pow2(opts->capacity);
+    opts = &o;
+
+    if (is_file_name(name))
+        return file_open(name, opts, out);
+
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd >= 0) {
+        rc = create_and_init(fd, name, opts, out);
+        (void)close(fd);
+        if (rc != SHMRING_OK)
+            (void)shm_unlink(name);
+        return rc;
+    }
+
+    if (errno != EEXIST)
+        return SHMRING_ERR_SYS;
+
+    /* Another writer won the race to create the object. It may still be
+     * between shm_open() and finishing ftruncate()+init, so retry attach
+     * briefly instead of failing immediately. */
+    for (int attempt = 0; attempt < SHMRING_CREATE_RACE_RETRIES; attempt++) {
+        rc = attach_live(name, 0, out);
+        if (rc == SHMRING_OK)
+            return SHMRING_OK;
+        if (rc != SHMRING_ERR_SYS || (errno != EAGAIN && errno != ENOENT))
+            break; /* e.g. EPROTO: waiting will not help */
+        (void)usleep(SHMRING_CREATE_RACE_DELAY_US);
+    }
+    return rc;
+}
+
+int
+shmring_attach(const char *name, shmring_t **out)
+{
+    if (name == NULL || out == NULL || strlen(name) >= SHMRING_NAME_MAX)
+        return SHMRING_ERR_INVAL;
+    *out = NULL;
+    if (is_file_name(name))
+        return file_open(name, NULL, out);
+    return attach_live(name, 0, out);
+}
+
+int
+shmring_attach_readonly(const char *name, shmring_t **out)
+{
+    if (name == NULL || out == NULL || strlen(name) >= SHMRING_NAME_MAX)
+        return SHMRING_ERR_INVAL;
+    *out = NULL;
+    return attach_live(name, 1, out);
+}
+
+void
+shmring_close(shmring_t *ring)
+{
+    if (ring == NULL)
+        return;
+    if (ring->hdr != NULL)
+        (void)munmap(ring->hdr, ring->map_size);
+    if (ring->notify_fd >= 0)
+        (void)close(ring->notify_fd);
+    free(ring);
+}
+
+int
+shmring_destroy(const char *name)
+{
+    char path[sizeof(SHMRING_NOTIFY_DIR) + SHMRING_NAME_MAX + sizeof(SHMRING_NOTIFY_SUFFIX)];
+
+    if (name == NULL || strlen(name) >= SHMRING_NAME_MAX)
+        return SHMRING_ERR_INVAL;
+    if (notify_path(name, path, sizeof(path)) == 0)
+        (void)unlink(path);
+    if (!is_file_name(name)) {
+        int64_t gen = root_latest_gen(name);
+
+        /* Superseded generations were unlinked by shmring_resize(); only
+         * the live one (if not the root itself) is left. */
+        if (gen > 0 && seg_name(name, (uint32_t)gen, path, sizeof(path)) == 0)
+            (void)shm_unlink(path);
+    }
+    if ((is_file_name(name) ? unlink(file_path(name)) : shm_unlink(name)) != 0)
+        return SHMRING_ERR_SYS;
+    return SHMRING_OK;
+}
+
+/* Counter owned by the ring lock, read lock-free by monitors. */
+static inline void
+metric_add(uint64_t *p, uint64_t v)
+{
+    __atomic_store_n(p, *p + v, __ATOMIC_RELAXED);
+}
+
+/* Record stamp-to-`now` (both raw, from take_stamp()) for a popped slot. */
+static void
+record_latency(shmring_hdr_t *hdr, uint64_t stamp, uint64_t now)
+{
+    int64_t d = (int64_t)(now - stamp);
+    uint64_t ns;
+
+    if (hdr->ts_mode == SHMRING_TS_NONE)
+        return;
+    if (d < 0)
+        d = 0; /* clock read on another CPU, or a stepped realtime clock */
+    ns = (uint64_t)d;
+    if (hdr->ts_mode == SHMRING_TS_TSC)
+        ns = (uint64_t)(((unsigned __int128)ns * hdr->tsc_mult) >> hdr->tsc_shift);
+    __atomic_fetch_add(&hdr->metrics.lat_hist[shmring_lat_bucket(ns)], 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Stamp and publish the `n` slots at tail, whose len and payload the
+ * caller already filled; caller holds the lock and checked space.
+ * Returns the seq of the first one.
+ */
+static uint64_t
+publish_locked(shmring_hdr_t *hdr, uint32_t n, uint64_t stamp)
+{
+    uint64_t first = hdr->next_seq;
+
+    for (uint32_t i = 0; i < n; i++) {
+        shmring_slot_t *slot = shmring_slot_at(hdr, hdr->tail + i);
+
+        slot->seq = first + i;
+        slot->stamp = stamp;
+        if (hdr->flags & SHMRING_F_PERSIST)
+            slot->crc = slot_checksum(slot);
+    }
+    hdr->next_seq = first + n;
+    hdr->tail += n;
+    hdr->total_pushed += n;
+    if (used_locked(hdr) > hdr->metrics.count_hwm)
+        __atomic_store_n(&hdr->metrics.count_hwm, used_locked(hdr), __ATOMIC_RELAXED);
+    return first;
+}
+
+/* Fill the tail slot and advance; caller holds the lock and checked space. */
+static uint64_t
+put_locked(shmring_hdr_t *hdr, const void *data, uint32_t len, uint64_t stamp)
+{
+    shmring_slot_t *slot = shmring_slot_at(hdr, hdr->tail);
+
+    slot->len = len;
+    if (len != 0)
+        memcpy(slot->payload, data, len);
+    return publish_locked(hdr, 1, stamp);
+}
+
+/* put_locked() gathering from `iov`; `len` is their checked total. */
+static uint64_t
+putv_locked(shmring_hdr_t *hdr, const struct iovec *iov, int iovcnt, uint32_t len, uint64_t stamp)
+{
+    shmring_slot_t *slot = shmring_slot_at(hdr, hdr->tail);
+    uint8_t *p = slot->payload;
+
+    slot->len = len;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len != 0)
+            memcpy(p, iov[i].iov_base, iov[i].iov_len);
+        p += iov[i].iov_len;
+    }
+    return publish_locked(hdr, 1, stamp);
+}
+
+/*
+ * Total length of `iov`, or -1 with SHMRING_ERR_INVAL/TOOBIG in *rc if
+ * it is malformed or exceeds `limit`.
+ */
+static int64_t
+iov_total(const struct iovec *iov, int iovcnt, uint64_t limit, int *rc)
+{
+    uint64_t total = 0;
+
+    *rc = SHMRING_ERR_INVAL;
+    if (iovcnt < 0 || (iovcnt > 0 && iov == NULL))
+        return -1;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len != 0 && iov[i].iov_base == NULL)
+            return -1;
+        if (iov[i].iov_len > limit - total) {
+            *rc = SHMRING_ERR_TOOBIG;
+            return -1;
+        }
+        total += iov[i].iov_len;
+    }
+    *rc = SHMRING_OK;
+    return (int64_t)total;
+}
+
+/*
+ * Release the `n` slots at head; caller holds the lock. A persistent ring
+ * keeps them reserved until shmring_commit().
+ */
+static void
+consume_locked(shmring_hdr_t *hdr, uint32_t n)
+{
+    hdr->head += n;
+    hdr->total_popped += n;
+    if (hdr->flags & SHMRING_F_PERSIST)
+        hdr->pending += n;
+    else if (n == 1)
+        pthread_cond_signal(&hdr->not_full);
+    else
+        pthread_cond_broadcast(&hdr->not_full);
+}
+
+/*
+ * Lock the live ring and wait (per `block`) until one more message fits.
+ * Returns SHMRING_OK with ring->hdr locked; on any error the lock is not
+ * held.
+ */
+static int
+lock_for_push(shmring_t *ring, int block)
+{
+    shmring_hdr_t *hdr;
+    uint64_t wait_start = 0;
+
+retry:
+    if (lock_live(ring) != 0)
         return SHMRING_ERR_SYS;
+    hdr = ring->hdr;
 
-    while (hdr->count == hdr->capacity && !hdr->closed) {
+    while (used_locked(hdr) + hdr->pending >= hdr->capacity && !hdr->closed) {
         if (!block) {
-            rc = SHMRING_ERR_FULL;
-            goto out;
+            (void)pthread_mutex_unlock(&hdr->lock);
+            return SHMRING_ERR_FULL;
+        }
+        if (wait_start == 0) {
+            wait_start = clock_ns(CLOCK_MONOTONIC);
+            metric_add(&hdr->metrics.full_waits, 1);
         }
         pthread_cond_wait(&hdr->not_full, &hdr->lock);
+        if (seg_moved(hdr)) {
+            (void)pthread_mutex_unlock(&hdr->lock);
+            goto retry;
+        }
     }
+    if (wait_start != 0)
+        metric_add(&hdr->metrics.full_wait_ns, clock_ns(CLOCK_MONOTONIC) - wait_start);
     if (hdr->closed) {
-        rc = SHMRING_ERR_CLOSED;
-        goto out;
+        (void)pthread_mutex_unlock(&hdr->lock);
+        return SHMRING_ERR_CLOSED;
     }
+    return SHMRING_OK;
+}
 
-    {
-        shmring_slot_t *slot = shmring_slot_at(hdr, hdr->tail);
+/* Counterpart of lock_for_push(): wait until a message is available.
+ * SHMRING_ERR_CLOSED only once the ring is closed and drained. */
+static int
+lock_for_pop(shmring_t *ring, int block)
+{
+    shmring_hdr_t *hdr;
+    uint64_t wait_start = 0;
 
-        slot->seq = hdr->next_seq++;
-        (void)clock_gettime(CLOCK_REALTIME, &slot->ts);
-        slot->len = len;
-        if (len != 0)
-            memcpy(slot->payload, data, len);
+retry:
+    if (lock_live(ring) != 0)
+        return SHMRING_ERR_SYS;
+    hdr = ring->hdr;
 
-        hdr->tail = (hdr->tail + 1) % hdr->capacity;
-        hdr->count++;
-        hdr->total_pushed++;
-        if (out_seq != NULL)
-            *out_seq = slot->seq;
+    while (hdr->head == hdr->tail && !hdr->closed) {
+        if (!block) {
+            (void)pthread_mutex_unlock(&hdr->lock);
+            return SHMRING_ERR_EMPTY;
+        }
+        if (wait_start == 0) {
+            wait_start = clock_ns(CLOCK_MONOTONIC);
+            metric_add(&hdr->metrics.empty_waits, 1);
+        }
+        pthread_cond_wait(&hdr->not_empty, &hdr->lock);
+        if (seg_moved(hdr)) {
+            (void)pthread_mutex_unlock(&hdr->lock);
+            goto retry;
+        }
     }
+    if (wait_start != 0)
+        metric_add(&hdr->metrics.empty_wait_ns, clock_ns(CLOCK_MONOTONIC) - wait_start);
+    if (hdr->head == hdr->tail) {
+        (void)pthread_mutex_unlock(&hdr->lock);
+        return SHMRING_ERR_CLOSED;
+    }
+    return SHMRING_OK;
+}
+
+int
+shmring_push(shmring_t *ring, const void *data, uint32_t len, uint64_t *out_seq, int block)
+{
+    shmring_hdr_t *hdr;
+    uint64_t stamp, seq;
+    int was_empty, rc;
+
+    if (!writable(ring) || (len != 0 && data == NULL))
+        return SHMRING_ERR_INVAL;
+
+    /* max_payload and ts_mode are the same in every generation. */
+    if (len > ring->hdr->max_payload)
+        return SHMRING_ERR_TOOBIG;
+    stamp = take_stamp(ring->hdr);
+
+    rc = lock_for_push(ring, block);
+    if (rc != SHMRING_OK)
+        return rc;
+    hdr = ring->hdr;
+
+    was_empty = (hdr->head == hdr->tail);
+    seq = put_locked(hdr, data, len, stamp);
+    if (out_seq != NULL)
+        *out_seq = seq;
     pthread_cond_signal(&hdr->not_empty);
+    (void)pthread_mutex_unlock(&hdr->lock);
+    if (was_empty)
+        notify_signal(ring);
+    return SHMRING_OK;
+}
+
+int
+shmring_pushv(shmring_t *ring, const struct iovec *iov, int iovcnt, uint64_t *out_seq, int block)
+{
+    shmring_hdr_t *hdr;
+    uint64_t stamp, seq;
+    int64_t len;
+    int was_empty, rc;
+
+    if (!writable(ring))
+        return SHMRING_ERR_INVAL;
+    len = iov_total(iov, iovcnt, ring->hdr->max_payload, &rc);
+    if (len < 0)
+        return rc;
+    stamp = take_stamp(ring->hdr);
+
+    rc = lock_for_push(ring, block);
+    if (rc != SHMRING_OK)
+        return rc;
+    hdr = ring->hdr;
+
+    was_empty = (hdr->head == hdr->tail);
+    seq = putv_locked(hdr, iov, iovcnt, (uint32_t)len, stamp);
+    if (out_seq != NULL)
+        *out_seq = seq;
+    pthread_cond_signal(&hdr->not_empty);
+    (void)pthread_mutex_unlock(&hdr->lock);
+    if (was_empty)
+        notify_signal(ring);
+    return SHMRING_OK;
+}
+
+int
+shmring_push_batch(shmring_t *ring, const void *const *data, const uint32_t *lens, uint32_t n,
+                   uint32_t *out_pushed, uint64_t *out_first_seq, int block)
+{
+    shmring_hdr_t *hdr;
+    uint64_t stamp, seq, wait_start = 0;
+    uint32_t i = 0;
+    int rc = SHMRING_OK;
+    int was_empty = 0;
+
+    if (out_pushed != NULL)
+        *out_pushed = 0;
+    if (!writable(ring) || (n != 0 && (data == NULL || lens == NULL)))
+        return SHMRING_ERR_INVAL;
+    for (uint32_t k = 0; k < n; k++) {
+        if (lens[k] != 0 && data[k] == NULL)
+            return SHMRING_ERR_INVAL;
+        if (lens[k] > ring->hdr->max_payload)
+            return SHMRING_ERR_TOOBIG;
+    }
+    if (n == 0)
+        return SHMRING_OK;
+    stamp = take_stamp(ring->hdr);
+
+retry:
+    if (lock_live(ring) != 0) {
+        rc = SHMRING_ERR_SYS;
+        goto done;
+    }
+    hdr = ring->hdr;
+
+    while (i < n) {
+        /* Wake consumers before sleeping on a full ring, not only at the
+         * end: they are the ones who have to make room. */
+        while (used_locked(hdr) + hdr->pending >= hdr->capacity && !hdr->closed) {
+            if (!block) {
+                rc = SHMRING_ERR_FULL;
+                goto out;
+            }
+            if (wait_start == 0) {
+                wait_start = clock_ns(CLOCK_MONOTONIC);
+                metric_add(&hdr->metrics.full_waits, 1);
+            }
+            pthread_cond_broadcast(&hdr->not_empty);
+            pthread_cond_wait(&hdr->not_full, &hdr->lock);
+            if (seg_moved(hdr)) {
+                (void)pthread_mutex_unlock(&hdr->lock);
+                goto retry;
+            }
+        }
+        if (wait_start != 0) {
+            metric_add(&hdr->metrics.full_wait_ns, clock_ns(CLOCK_MONOTONIC) - wait_start);
+            wait_start = 0;
+        }
+        if (hdr->closed) {
+            rc = SHMRING_ERR_CLOSED;
+            goto out;
+        }
+        if (hdr->head == hdr->tail)
+            was_empty = 1;
+        seq = put_locked(hdr, data[i], lens[i], stamp);
+        if (i++ == 0 && out_first_seq != NULL)
+            *out_first_seq = seq;
+    }
 
 out:
+    if (i != 0)
+        pthread_cond_broadcast(&hdr->not_empty);
     (void)pthread_mutex_unlock(&hdr->lock);
+    if (was_empty)
+        notify_signal(ring);
+done:
+    if (out_pushed != NULL)
+        *out_pushed = i;
     return rc;
 }
 
@@ -322,52 +1295,196 @@ shmring_pop(shmring_t *ring, void *buf, uint32_t buf_cap, uint32_t *out_len, uin
             struct timespec *out_ts, int block)
 {
     shmring_hdr_t *hdr;
-    int rc = SHMRING_OK;
+    shmring_slot_t *slot;
+    uint32_t copy_len;
+    uint64_t stamp;
+    int rc;
 
-    if (ring == NULL || ring->hdr == NULL || (buf_cap != 0 && buf == NULL))
+    if (!writable(ring) || (buf_cap != 0 && buf == NULL))
         return SHMRING_ERR_INVAL;
 
+    rc = lock_for_pop(ring, block);
+    if (rc != SHMRING_OK)
+        return rc;
     hdr = ring->hdr;
 
-    if (lock_ring(hdr) != 0)
-        return SHMRING_ERR_SYS;
+    slot = shmring_slot_at(hdr, hdr->head);
+    copy_len = slot->len < buf_cap ? slot->len : buf_cap;
+    if (copy_len != 0)
+        memcpy(buf, slot->payload, copy_len);
+    if (out_len != NULL)
+        *out_len = slot->len;
+    if (out_seq != NULL)
+        *out_seq = slot->seq;
+    if (out_ts != NULL)
+        stamp_to_ts(hdr, slot->stamp, out_ts);
+    stamp = slot->stamp;
+    consume_locked(hdr, 1);
 
-    while (hdr->count == 0 && !hdr->closed) {
-        if (!block) {
-            rc = SHMRING_ERR_EMPTY;
-            goto out;
-        }
-        pthread_cond_wait(&hdr->not_empty, &hdr->lock);
+    (void)pthread_mutex_unlock(&hdr->lock);
+    record_latency(hdr, stamp, take_stamp(hdr));
+    return SHMRING_OK;
+}
+
+int
+shmring_popv(shmring_t *ring, const struct iovec *iov, int iovcnt, uint32_t *out_len, uint64_t *out_seq,
+             struct timespec *out_ts, int block)
+{
+    shmring_hdr_t *hdr;
+    shmring_slot_t *slot;
+    const uint8_t *p;
+    uint32_t left;
+    uint64_t stamp;
+    int rc;
+
+    if (!writable(ring) || iov_total(iov, iovcnt, UINT64_MAX, &rc) < 0)
+        return SHMRING_ERR_INVAL;
+
+    rc = lock_for_pop(ring, block);
+    if (rc != SHMRING_OK)
+        return rc;
+    hdr = ring->hdr;
+
+    slot = shmring_slot_at(hdr, hdr->head);
+    p = slot->payload;
+    left = slot->len;
+    for (int i = 0; i < iovcnt && left != 0; i++) {
+        uint32_t n = iov[i].iov_len < left ? (uint32_t)iov[i].iov_len : left;
+
+        if (n != 0)
+            memcpy(iov[i].iov_base, p, n);
+        p += n;
+        left -= n;
     }
-    if (hdr->count == 0 && hdr->closed) {
-        rc = SHMRING_ERR_CLOSED;
-        goto out;
+    if (out_len != NULL)
+        *out_len = slot->len;
+    if (out_seq != NULL)
+        *out_seq = slot->seq;
+    if (out_ts != NULL)
+        stamp_to_ts(hdr, slot->stamp, out_ts);
+    stamp = slot->stamp;
+    consume_locked(hdr, 1);
+
+    (void)pthread_mutex_unlock(&hdr->lock);
+    record_latency(hdr, stamp, take_stamp(hdr));
+    return SHMRING_OK;
+}
+
+/*
+ * Close the window opened by shmring_write_begin()/shmring_read_begin().
+ * Returns 0 if its first n slots may be committed. Otherwise returns -1;
+ * an open window is then dropped with nothing committed, since slots past
+ * its end were never reserved.
+ */
+static int
+end_window(shmring_t *ring, uint32_t n)
+{
+    uint32_t window;
+
+    if (ring == NULL || ring->window == 0)
+        return -1; /* no window open: the lock is not ours to drop */
+    window = ring->window;
+    ring->window = 0;
+    if (n > window) {
+        (void)pthread_mutex_unlock(&ring->hdr->lock);
+        return -1;
     }
+    return 0;
+}
 
-    {
-        shmring_slot_t *slot = shmring_slot_at(hdr, hdr->head);
-        uint32_t copy_len = slot->len;
-
-        if (copy_len > buf_cap)
-            copy_len = buf_cap;
-        if (copy_len != 0)
-            memcpy(buf, slot->payload, copy_len);
-        if (out_len != NULL)
-            *out_len = slot->len;
-        if (out_seq != NULL)
-            *out_seq = slot->seq;
-        if (out_ts != NULL)
-            *out_ts = slot->ts;
-
-        hdr->head = (hdr->head + 1) % hdr->capacity;
-        hdr->count--;
-        hdr->total_popped++;
-    }
-    pthread_cond_signal(&hdr->not_full);
+int
+shmring_write_begin(shmring_t *ring, uint32_t want, uint64_t *out_pos, uint32_t *out_n, int block)
+{
+    shmring_hdr_t *hdr;
+    uint64_t stamp;
+    uint32_t room;
+    int rc;
 
-out:
+    if (!writable(ring) || want == 0 || out_pos == NULL || out_n == NULL)
+        return SHMRING_ERR_INVAL;
+    stamp = take_stamp(ring->hdr);
+    rc = lock_for_push(ring, block);
+    if (rc != SHMRING_OK)
+        return rc;
+    hdr = ring->hdr;
+
+    room = hdr->capacity - used_locked(hdr) - hdr->pending;
+    ring->window_stamp = stamp; /* only touched while holding the lock */
+    *out_pos = hdr->tail;
+    *out_n = want < room ? want : room;
+    ring->window = *out_n;
+    return SHMRING_OK;
+}
+
+int
+shmring_write_end(shmring_t *ring, uint32_t n)
+{
+    shmring_hdr_t *hdr;
+    int was_empty;
+
+    if (end_window(ring, n) != 0)
+        return SHMRING_ERR_INVAL;
+    hdr = ring->hdr;
+    was_empty = (hdr->head == hdr->tail);
+
+    if (n != 0) {
+        (void)publish_locked(hdr, n, ring->window_stamp);
+        if (n == 1)
+            pthread_cond_signal(&hdr->not_empty);
+        else
+            pthread_cond_broadcast(&hdr->not_empty);
+    }
     (void)pthread_mutex_unlock(&hdr->lock);
-    return rc;
+    if (n != 0 && was_empty)
+        notify_signal(ring);
+    return SHMRING_OK;
+}
+
+int
+shmring_read_begin(shmring_t *ring, uint32_t want, uint64_t *out_pos, uint32_t *out_n, int block)
+{
+    shmring_hdr_t *hdr;
+    int rc;
+
+    if (!writable(ring) || want == 0 || out_pos == NULL || out_n == NULL)
+        return SHMRING_ERR_INVAL;
+    rc = lock_for_pop(ring, block);
+    if (rc != SHMRING_OK)
+        return rc;
+    hdr = ring->hdr;
+
+    *out_pos = hdr->head;
+    *out_n = want < used_locked(hdr) ? want : used_locked(hdr);
+    ring->window = *out_n;
+    return SHMRING_OK;
+}
+
+int
+shmring_read_end(shmring_t *ring, uint32_t n)
+{
+    shmring_hdr_t *hdr;
+    uint64_t now;
+
+    if (end_window(ring, n) != 0)
+        return SHMRING_ERR_INVAL;
+    hdr = ring->hdr;
+    now = take_stamp(hdr);
+
+    /* Latencies are recorded before the slots can be reused. */
+    for (uint32_t i = 0; i < n; i++)
+        record_latency(hdr, shmring_slot_at(hdr, hdr->head + i)->stamp, now);
+    if (n != 0)
+        consume_locked(hdr, n);
+    (void)pthread_mutex_unlock(&hdr->lock);
+    return SHMRING_OK;
+}
+
+void
+shmring_stamp_to_ts(shmring_t *ring, uint64_t stamp, struct timespec *out_ts)
+{
+    if (ring == NULL || ring->hdr == NULL || out_ts == NULL)
+        return;
+    stamp_to_ts(ring->hdr, stamp, out_ts);
 }
 
 void
@@ -375,16 +1492,290 @@ shmring_shutdown(shmring_t *ring)
 {
     shmring_hdr_t *hdr;
 
-    if (ring == NULL || ring->hdr == NULL)
+    if (!writable(ring))
         return;
-    hdr = ring->hdr;
-
-    if (lock_ring(hdr) != 0)
+    if (lock_live(ring) != 0)
         return;
+    hdr = ring->hdr;
     hdr->closed = 1;
     pthread_cond_broadcast(&hdr->not_full);
     pthread_cond_broadcast(&hdr->not_empty);
     (void)pthread_mutex_unlock(&hdr->lock);
+    notify_signal(ring);
+}
+
+int
+shmring_commit(shmring_t *ring, uint64_t seq)
+{
+    shmring_hdr_t *hdr;
+    uint32_t freed = 0;
+    int rc = SHMRING_OK;
+
+    if (!writable(ring))
+        return SHMRING_ERR_INVAL;
+    hdr = ring->hdr;
+    if (!(hdr->flags & SHMRING_F_PERSIST))
+        return SHMRING_OK;
+
+    if (lock_ring(hdr) != 0)
+        return SHMRING_ERR_SYS;
+    while (hdr->pending > 0 && hdr->committed_seq <= seq) {
+        hdr->ckpt++;
+        hdr->pending--;
+        hdr->committed_seq++;
+        freed++;
+    }
+    /* The checkpoint must be on disk before producers may overwrite the
+     * slots it releases, or a crash could leave an on-disk ckpt pointing
+     * at a reused slot. Hence the msync under the lock. */
+    if (freed != 0) {
+        if (sync_header(hdr) != 0)
+            rc = SHMRING_ERR_SYS;
+        pthread_cond_broadcast(&hdr->not_full);
+    }
+    (void)pthread_mutex_unlock(&hdr->lock);
+    return rc;
+}
+
+int
+shmring_sync(shmring_t *ring)
+{
+    if (ring == NULL || ring->hdr == NULL)
+        return SHMRING_ERR_INVAL;
+    if (!(ring->hdr->flags & SHMRING_F_PERSIST))
+        return SHMRING_OK;
+    return msync(ring->hdr, ring->map_size, MS_SYNC) == 0 ? SHMRING_OK : SHMRING_ERR_SYS;
+}
+
+int
+shmring_recover(shmring_t *ring, uint64_t *out_resume_seq)
+{
+    shmring_hdr_t *hdr;
+    uint64_t resume;
+
+    if (!writable(ring))
+        return SHMRING_ERR_INVAL;
+    hdr = ring->hdr;
+    if (!(hdr->flags & SHMRING_F_PERSIST))
+        return SHMRING_OK;
+
+    if (lock_ring(hdr) != 0)
+        return SHMRING_ERR_SYS;
+    resume = recover_locked(hdr);
+    if (hdr->head != hdr->tail)
+        pthread_cond_broadcast(&hdr->not_empty);
+    (void)pthread_mutex_unlock(&hdr->lock);
+    if (out_resume_seq != NULL)
+        *out_resume_seq = resume;
+    return SHMRING_OK;
+}
+
+int
+shmring_notify_open(shmring_t *ring, int *out_fd)
+{
+    int fd;
+
+    if (!writable(ring) || out_fd == NULL)
+        return SHMRING_ERR_INVAL;
+
+    fd = notify_fd_get(ring);
+    if (fd < 0)
+        return SHMRING_ERR_SYS;
+    __atomic_store_n(&ring->hdr->notify, 1, __ATOMIC_RELEASE);
+    *out_fd = fd;
+    return SHMRING_OK;
+}
+
+void
+shmring_notify_ack(shmring_t *ring)
+{
+    uint8_t buf[64];
+
+    if (ring == NULL || ring->notify_fd < 0)
+        return;
+    while (read(ring->notify_fd, buf, sizeof(buf)) > 0)
+        ;
+}
+
+/* Carry everything but geometry and slots over to a new generation. */
+static void
+copy_ring_state(shmring_hdr_t *dst, const shmring_hdr_t *src)
+{
+    dst->closed = src->closed;
+    dst->notify = src->notify;
+    dst->next_seq = src->next_seq;
+    dst->total_pushed = src->total_pushed;
+    dst->total_popped = src->total_popped;
+    dst->metrics = src->metrics;
+}
+
+int
+shmring_resize(shmring_t *ring, uint32_t new_capacity)
+{
+    char seg[SHMRING_NAME_MAX + 16], old_seg[SHMRING_NAME_MAX + 16];
+    shmring_opts_t opts;
+    shmring_t *next = NULL;
+    shmring_hdr_t *old, *hdr;
+    uint32_t gen;
+    int fd, rc;
+
+    if (!writable(ring) || ring->persist || new_capacity < SHMRING_MIN_CAPACITY ||
+        new_capacity > SHMRING_MAX_CAPACITY)
+        return SHMRING_ERR_INVAL;
+    new_capacity = round_up_pow2(new_capacity);
+
+    if (lock_live(ring) != 0)
+        return SHMRING_ERR_SYS;
+    old = ring->hdr;
+    gen = old->gen + 1;
+    if (new_capacity < used_locked(old) || seg_name(ring->name, gen, seg, sizeof(seg)) != 0 ||
+        seg_name(ring->name, old->gen, old_seg, sizeof(old_seg)) != 0) {
+        rc = SHMRING_ERR_INVAL;
+        goto out;
+    }
+
+    /* A segment with this name can only be debris from a resizer that
+     * died before publishing it. */
+    (void)shm_unlink(seg);
+    fd = shm_open(seg, O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd < 0) {
+        rc = SHMRING_ERR_SYS;
+        goto out;
+    }
+    shmring_opts_init(&opts, new_capacity, old->max_payload);
+    opts.numa_node = old->numa_node;
+    opts.ts_mode = old->ts_mode == SHMRING_TS_TSC ? SHMRING_TS_NONE : old->ts_mode; /* calibration copied below */
+    rc = create_and_init(fd, ring->name, &opts, &next);
+    (void)close(fd);
+    if (rc != SHMRING_OK) {
+        (void)shm_unlink(seg);
+        goto out;
+    }
+
+    hdr = next->hdr;
+    hdr->gen = gen;
+    hdr->latest_gen = gen;
+    /* Carried-over stamps must keep converting the same way. */
+    hdr->ts_mode = old->ts_mode;
+    hdr->tsc_shift = old->tsc_shift;
+    hdr->tsc_mult = old->tsc_mult;
+    hdr->tsc_base = old->tsc_base;
+    hdr->tsc_base_ns = old->tsc_base_ns;
+    /* Cursors carry over unchanged; only their slot mapping differs. */
+    for (uint64_t pos = old->head; pos != old->tail; pos++) {
+        shmring_slot_t *from = shmring_slot_at(old, pos);
+
+        memcpy(shmring_slot_at(hdr, pos), from, sizeof(*from) + from->len);
+    }
+    hdr->head = old->head;
+    hdr->tail = old->tail;
+    copy_ring_state(hdr, old);
+
+    /* Publish: root first, so that whoever sees the old segment marked
+     * superseded (the store below) is guaranteed to find `gen` there. */
+    if (old->gen != 0) {
+        shmring_hdr_t *root;
+
+        fd = shm_open(ring->name, O_RDWR, 0);
+        root = fd < 0 ? MAP_FAILED : mmap(NULL, sizeof(*root), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (fd >= 0)
+            (void)close(fd);
+        if (root == MAP_FAILED) {
+            shmring_close(next);
+            (void)shm_unlink(seg);
+            rc = SHMRING_ERR_SYS;
+            goto out;
+        }
+        __atomic_store_n(&root->latest_gen, gen, __ATOMIC_RELEASE);
+        (void)munmap(root, sizeof(*root));
+    }
+    __atomic_store_n(&old->latest_gen, gen, __ATOMIC_RELEASE);
+
+    /* Waiters on the old segment re-check, see it moved, and follow. */
+    pthread_cond_broadcast(&old->not_full);
+    pthread_cond_broadcast(&old->not_empty);
+    (void)pthread_mutex_unlock(&old->lock);
+
+    /* The generation-0 segment is the directory and must stay. Others can
+     * go now: attached processes keep their mapping until they follow. */
+    if (old->gen != 0)
+        (void)shm_unlink(old_seg);
+
+    (void)munmap(ring->hdr, ring->map_size);
+    ring->hdr = next->hdr;
+    ring->map_size = next->map_size;
+    free(next);
+    return SHMRING_OK;
+
+out:
+    (void)pthread_mutex_unlock(&old->lock);
+    return rc;
+}
+
+int
+shmring_now(shmring_t *ring, struct timespec *out)
+{
+    if (ring == NULL || ring->hdr == NULL || out == NULL || ring->hdr->ts_mode == SHMRING_TS_NONE)
+        return SHMRING_ERR_INVAL;
+    stamp_to_ts(ring->hdr, take_stamp(ring->hdr), out);
+    return SHMRING_OK;
+}
+
+uint32_t
+shmring_capacity(shmring_t *ring)
+{
+    if (ring == NULL || ring->hdr == NULL)
+        return 0;
+    if (seg_moved(ring->hdr))
+        (void)follow(ring);
+    return ring->hdr->capacity;
+}
+
+int
+shmring_bind_near(shmring_t *ring, int *out_node)
+{
+    unsigned long mask[NODE_MASK_WORDS];
+    cpu_set_t cpus;
+    int node;
+
+    if (ring == NULL || ring->hdr == NULL)
+        return SHMRING_ERR_INVAL;
+
+    node = ring->hdr->numa_node;
+    if (node == SHMRING_NUMA_ANY)
+        node = numa_node_of(ring->hdr);
+    if (node < 0 || node >= SHMRING_MAX_NUMA_NODES || numa_node_cpus(node, &cpus) != 0)
+        return SHMRING_ERR_SYS;
+
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+        return SHMRING_ERR_SYS;
+    node_mask(mask, node);
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, (unsigned long)SHMRING_MAX_NUMA_NODES) != 0)
+        return SHMRING_ERR_SYS;
+
+    if (out_node != NULL)
+        *out_node = node;
+    return SHMRING_OK;
+}
+
+void
+shmring_metrics(shmring_t *ring, shmring_metrics_t *out)
+{
+    const shmring_metrics_t *m;
+
+    if (ring == NULL || ring->hdr == NULL || out == NULL)
+        return;
+    if (seg_moved(ring->hdr))
+        (void)follow(ring);
+    m = &ring->hdr->metrics;
+    for (uint32_t i = 0; i < SHMRING_LAT_BUCKETS; i++)
+        out->lat_hist[i] = __atomic_load_n(&m->lat_hist[i], __ATOMIC_RELAXED);
+    out->full_waits = __atomic_load_n(&m->full_waits, __ATOMIC_RELAXED);
+    out->full_wait_ns = __atomic_load_n(&m->full_wait_ns, __ATOMIC_RELAXED);
+    out->empty_waits = __atomic_load_n(&m->empty_waits, __ATOMIC_RELAXED);
+    out->empty_wait_ns = __atomic_load_n(&m->empty_wait_ns, __ATOMIC_RELAXED);
+    out->count_hwm = __atomic_load_n(&m->count_hwm, __ATOMIC_RELAXED);
+    out->reserved = 0;
 }
 
 uint32_t
@@ -392,7 +1783,16 @@ shmring_count(shmring_t *ring)
 {
     if (ring == NULL || ring->hdr == NULL)
         return 0;
-    return __atomic_load_n(&ring->hdr->count, __ATOMIC_RELAXED);
+    if (seg_moved(ring->hdr))
+        (void)follow(ring);
+    {
+        shmring_hdr_t *hdr = ring->hdr;
+        /* head first: tail only grows, so the difference is never negative. */
+        uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+        uint64_t used = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE) - head;
+
+        return used > hdr->capacity ? hdr->capacity : (uint32_t)used;
+    }
 }
 
 void
@@ -400,6 +1800,8 @@ shmring_stats(shmring_t *ring, uint64_t *out_total_pushed, uint64_t *out_total_p
 {
     if (ring == NULL || ring->hdr == NULL)
         return;
+    if (seg_moved(ring->hdr))
+        (void)follow(ring);
     if (out_total_pushed != NULL)
         *out_total_pushed = __atomic_load_n(&ring->hdr->total_pushed, __ATOMIC_RELAXED);
     if (out_total_popped != NULL)
@@ -0,0 +1,518 @@
+/*
+ * shm_shard.c
+ *
+ * Implementation of the sharded multi-producer ring declared in
+ * shm_shard.h. Segment creation/attach follows shm_ring.c and shm_pool.c:
+ * O_EXCL election, magic published last with a release store, two-phase
+ * mmap on attach.
+ *
+ * Sub-rings are plain SPSC queues: the producer fills a slot and then
+ * publishes it with a release store of tail; the consumer acquires tail,
+ * copies the slot and hands it back with a release store of head. Blocking
+ * uses process-shared futexes instead of the pthread condvars of shm_ring,
+ * because there is no lock to wait under. Each side announces that it is
+ * about to sleep (cons_waiting / prod_waiting), re-checks, then sleeps on a
+ * generation word; the other side only bumps that word and calls
+ * FUTEX_WAKE when the announcement is set, so the fast path is syscall-free.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <shm_shard.h>
+
+#define SHMSHARD_ATTACH_RETRIES  100
+#define SHMSHARD_ATTACH_DELAY_US 10000U /* 10ms */
+
+static uint64_t
+align_up(uint64_t n, uint64_t a)
+{
+    return (n + a - 1) & ~(a - 1);
+}
+
+static inline shmring_slot_t *
+sub_slot(shmshard_hdr_t *hdr, shmshard_sub_t *sub, uint64_t pos)
+{
+    return (shmring_slot_t *)((uint8_t *)hdr + sub->slots_off + (pos & (hdr->capacity - 1)) * hdr->slot_stride);
+}
+
+static uint32_t
+round_up_pow2(uint32_t n)
+{
+    return n <= 1 ? 1 : 1U << (32 - __builtin_clz(n - 1));
+}
+
+static void
+futex_wait(uint32_t *word, uint32_t expected, const struct timespec *timeout)
+{
+    /* EAGAIN (word already changed), EINTR and ETIMEDOUT all mean "re-check". */
+    (void)syscall(SYS_futex, word, FUTEX_WAIT, expected, timeout, NULL, 0);
+}
+
+static void
+futex_bump(uint32_t *word)
+{
+    __atomic_add_fetch(word, 1, __ATOMIC_RELEASE);
+    (void)syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/* An owner pid that no longer exists; its role can be taken over. */
+static int
+owner_dead(pid_t pid)
+{
+    return pid != 0 && kill(pid, 0) != 0 && errno == ESRCH;
+}
+
+/* CAS *owner from free (or dead) to our pid. */
+static int
+claim(pid_t *owner)
+{
+    pid_t self = getpid(), cur = __atomic_load_n(owner, __ATOMIC_ACQUIRE);
+
+    if (cur != 0 && !owner_dead(cur))
+        return 0;
+    return __atomic_compare_exchange_n(owner, &cur, self, /*weak=*/0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+static void
+release(pid_t *owner)
+{
+    pid_t self = getpid();
+
+    (void)__atomic_compare_exchange_n(owner, &self, 0, /*weak=*/0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+static shmshard_t *
+alloc_handle(void *base, size_t map_size, const char *name)
+{
+    shmshard_t *s = (shmshard_t *)calloc(1, sizeof(*s));
+
+    if (s == NULL)
+        return NULL;
+    s->hdr = (shmshard_hdr_t *)base;
+    s->map_size = map_size;
+    s->sub = -1;
+    (void)snprintf(s->name, sizeof(s->name), "%s", name);
+    return s;
+}
+
+static int
+create_and_init(int fd, const char *name, uint32_t nshards, uint32_t capacity, uint32_t max_payload,
+                uint32_t order, shmshard_t **out)
+{
+    uint32_t slot_stride = (uint32_t)align_up(sizeof(shmring_slot_t) + max_payload, 8);
+    uint64_t region = align_up((uint64_t)capacity * slot_stride, 64);
+    uint64_t off = align_up(sizeof(shmshard_hdr_t), 64);
+    size_t full_size = (size_t)(off + region * nshards);
+    shmshard_hdr_t *hdr;
+    void *base;
+
+    if (ftruncate(fd, (off_t)full_size) != 0)
+        return SHMRING_ERR_SYS;
+    base = mmap(NULL, full_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        return SHMRING_ERR_SYS;
+
+    /* ftruncate() zero-fills; only the geometry needs writing. */
+    hdr = (shmshard_hdr_t *)base;
+    hdr->nshards = nshards;
+    hdr->capacity = capacity;
+    hdr->max_payload = max_payload;
+    hdr->slot_stride = slot_stride;
+    hdr->order = order;
+    hdr->map_size = full_size;
+    for (uint32_t i = 0; i < nshards; i++)
+        hdr->subs[i].slots_off = off + region * i;
+    __atomic_store_n(&hdr->magic, SHMSHARD_MAGIC, __ATOMIC_RELEASE);
+
+    *out = alloc_handle(base, full_size, name);
+    if (*out == NULL) {
+        (void)munmap(base, full_size);
+        return SHMRING_ERR_SYS;
+    }
+    return SHMRING_OK;
+}
+
+static int
+attach_once(const char *name, shmshard_t **out)
+{
+    struct stat st;
+    shmshard_hdr_t *tmp;
+    size_t full_size;
+    void *map;
+    int fd;
+
+    fd = shm_open(name, O_RDWR, 0660);
+    if (fd < 0)
+        return SHMRING_ERR_SYS;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(shmshard_hdr_t)) {
+        (void)close(fd);
+        errno = EAGAIN;
+        return SHMRING_ERR_SYS;
+    }
+
+    map = mmap(NULL, sizeof(shmshard_hdr_t), PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        (void)close(fd);
+        return SHMRING_ERR_SYS;
+    }
+    tmp = (shmshard_hdr_t *)map;
+    if (__atomic_load_n(&tmp->magic, __ATOMIC_ACQUIRE) != SHMSHARD_MAGIC) {
+        (void)munmap(map, sizeof(shmshard_hdr_t));
+        (void)close(fd);
+        errno = EAGAIN;
+        return SHMRING_ERR_SYS;
+    }
+    full_size = (size_t)tmp->map_size;
+    if (tmp->capacity == 0 || (tmp->capacity & (tmp->capacity - 1)) != 0) {
+        (void)munmap(map, sizeof(shmshard_hdr_t));
+        (void)close(fd);
+        errno = EINVAL;
+        return SHMRING_ERR_SYS;
+    }
+    (void)munmap(map, sizeof(shmshard_hdr_t));
+
+    if ((size_t)st.st_size < full_size) {
+        (void)close(fd);
+        errno = EAGAIN;
+        return SHMRING_ERR_SYS;
+    }
+    map = mmap(NULL, full_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    (void)close(fd);
+    if (map == MAP_FAILED)
+        return SHMRING_ERR_SYS;
+
+    *out = alloc_handle(map, full_size, name);
+    if (*out == NULL) {
+        (void)munmap(map, full_size);
+        return SHMRING_ERR_SYS;
+    }
+    return SHMRING_OK;
+}
+
+int
+shmshard_create(const char *name, uint32_t nshards, uint32_t capacity, uint32_t max_payload, uint32_t order,
+                shmshard_t **out)
+{
+    int fd, rc;
+
+    if (name == NULL || out == NULL || strlen(name) >= SHMRING_NAME_MAX || nshards == 0 ||
+        nshards > SHMSHARD_MAX_PRODUCERS || capacity < SHMRING_MIN_CAPACITY || capacity > SHMRING_MAX_CAPACITY ||
+        max_payload == 0 || (order != SHMSHARD_ORDER_SEQ && order != SHMSHARD_ORDER_TS))
+        return SHMRING_ERR_INVAL;
+    *out = NULL;
+    capacity = round_up_pow2(capacity); /* slot index is a mask, as in shm_ring */
+
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd >= 0) {
+        rc = create_and_init(fd, name, nshards, capacity, max_payload, order, out);
+        (void)close(fd);
+        if (rc != SHMRING_OK)
+            (void)shm_unlink(name);
+        return rc;
+    }
+    if (errno != EEXIST)
+        return SHMRING_ERR_SYS;
+
+    for (int attempt = 0; attempt < SHMSHARD_ATTACH_RETRIES; attempt++) {
+        rc = attach_once(name, out);
+        if (rc == SHMRING_OK)
+            return SHMRING_OK;
+        (void)usleep(SHMSHARD_ATTACH_DELAY_US);
+    }
+    return rc;
+}
+
+int
+shmshard_attach(const char *name, shmshard_t **out)
+{
+    if (name == NULL || out == NULL || strlen(name) >= SHMRING_NAME_MAX)
+        return SHMRING_ERR_INVAL;
+    *out = NULL;
+    return attach_once(name, out);
+}
+
+void
+shmshard_close(shmshard_t *s)
+{
+    if (s == NULL)
+        return;
+    if (s->hdr != NULL) {
+        if (s->sub >= 0)
+            release(&s->hdr->subs[s->sub].owner);
+        if (s->consumer)
+            release(&s->hdr->consumer);
+        (void)munmap(s->hdr, s->map_size);
+    }
+    free(s);
+}
+
+int
+shmshard_destroy(const char *name)
+{
+    if (name == NULL)
+        return SHMRING_ERR_INVAL;
+    return shm_unlink(name) == 0 ? SHMRING_OK : SHMRING_ERR_SYS;
+}
+
+int
+shmshard_producer(shmshard_t *s)
+{
+    if (s == NULL || s->hdr == NULL)
+        return SHMRING_ERR_INVAL;
+    if (s->sub >= 0)
+        return SHMRING_OK;
+    for (uint32_t i = 0; i < s->hdr->nshards; i++) {
+        if (claim(&s->hdr->subs[i].owner)) {
+            /* A dead previous owner may have left its claim flag set. */
+            __atomic_store_n(&s->hdr->subs[i].claiming, 0, __ATOMIC_RELEASE);
+            s->sub = (int)i;
+            return SHMRING_OK;
+        }
+    }
+    return SHMRING_ERR_FULL;
+}
+
+int
+shmshard_consumer(shmshard_t *s, int strict)
+{
+    if (s == NULL || s->hdr == NULL || (strict && s->hdr->order != SHMSHARD_ORDER_SEQ))
+        return SHMRING_ERR_INVAL;
+    if (!s->consumer) {
+        if (!claim(&s->hdr->consumer))
+            return SHMRING_ERR_FULL;
+        s->consumer = 1;
+    }
+    s->strict = strict;
+    return SHMRING_OK;
+}
+
+int
+shmshard_push(shmshard_t *s, const void *data, uint32_t len, uint64_t *out_seq, int block)
+{
+    shmshard_hdr_t *hdr;
+    shmshard_sub_t *sub;
+    shmring_slot_t *slot;
+    struct timespec ts;
+    uint64_t tail;
+    int rc;
+
+    if (s == NULL || s->hdr == NULL || (len != 0 && data == NULL))
+        return SHMRING_ERR_INVAL;
+    hdr = s->hdr;
+    if (len > hdr->max_payload)
+        return SHMRING_ERR_TOOBIG;
+    if (s->sub < 0 && (rc = shmshard_producer(s)) != SHMRING_OK)
+        return rc;
+    sub = &hdr->subs[s->sub];
+    tail = sub->tail; /* only we write it */
+
+    for (;;) {
+        uint32_t gen;
+
+        if (__atomic_load_n(&hdr->closed, __ATOMIC_ACQUIRE))
+            return SHMRING_ERR_CLOSED;
+        if (tail - __atomic_load_n(&sub->head, __ATOMIC_ACQUIRE) < hdr->capacity)
+            break;
+        if (!block)
+            return SHMRING_ERR_FULL;
+
+        gen = __atomic_load_n(&sub->space_gen, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&sub->prod_waiting, 1, __ATOMIC_SEQ_CST);
+        if (tail - __atomic_load_n(&sub->head, __ATOMIC_SEQ_CST) >= hdr->capacity &&
+            !__atomic_load_n(&hdr->closed, __ATOMIC_SEQ_CST))
+            futex_wait(&sub->space_gen, gen, NULL);
+        __atomic_store_n(&sub->prod_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    /* Claim the seq only once the slot is guaranteed: a strict consumer
+     * waits for every claimed seq, so claiming and then blocking on a
+     * full sub-ring could stall it behind us. `claiming` goes up before
+     * the seq is taken, so the consumer can tell a seq still on its way
+     * from one whose producer died (see gap_abandoned()). */
+    slot = sub_slot(hdr, sub, tail);
+    if (hdr->order == SHMSHARD_ORDER_SEQ) {
+        __atomic_store_n(&sub->claiming, 1, __ATOMIC_SEQ_CST);
+        slot->seq = __atomic_fetch_add(&hdr->next_seq, 1, __ATOMIC_SEQ_CST);
+    } else {
+        slot->seq = sub->next_local++;
+    }
+    (void)clock_gettime(CLOCK_REALTIME, &ts);
+    slot->stamp = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    slot->len = len;
+    slot->crc = 0;
+    if (len != 0)
+        memcpy(slot->payload, data, len);
+    if (out_seq != NULL)
+        *out_seq = slot->seq;
+
+    __atomic_store_n(&sub->tail, tail + 1, __ATOMIC_RELEASE);
+    if (hdr->order == SHMSHARD_ORDER_SEQ)
+        __atomic_store_n(&sub->claiming, 0, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&hdr->cons_waiting, __ATOMIC_RELAXED))
+        futex_bump(&hdr->data_gen);
+    return SHMRING_OK;
+}
+
+static inline uint64_t
+merge_key(const shmshard_hdr_t *hdr, const shmring_slot_t *slot)
+{
+    if (hdr->order == SHMSHARD_ORDER_SEQ)
+        return slot->seq;
+    return slot->stamp;
+}
+
+/* Sub-ring whose oldest slot has the smallest merge key, or -1 if all are
+ * empty. O(nshards) per pop; the price of producers sharing nothing. */
+static int
+pick(shmshard_hdr_t *hdr, uint64_t *out_key)
+{
+    int best = -1;
+
+    for (uint32_t i = 0; i < hdr->nshards; i++) {
+        shmshard_sub_t *sub = &hdr->subs[i];
+        uint64_t head = sub->head, key;
+
+        if (__atomic_load_n(&sub->tail, __ATOMIC_ACQUIRE) == head)
+            continue;
+        key = merge_key(hdr, sub_slot(hdr, sub, head));
+        if (best < 0 || key < *out_key) {
+            best = (int)i;
+            *out_key = key;
+        }
+    }
+    return best;
+}
+
+/*
+ * Strict mode, oldest published seq past cons_seq: is any live producer
+ * between taking a seq and publishing it? Each sets `claiming` before the
+ * fetch-add and clears it (release) only after publishing, so when this
+ * returns 1, every seq taken before the scan by a live producer is
+ * visible to a fresh pick(). It says nothing about the pick() made before
+ * the scan: a producer may have published cons_seq in between. The caller
+ * must pick() again and skip only what is still missing then.
+ */
+static int
+gap_abandoned(shmshard_hdr_t *hdr)
+{
+    for (uint32_t i = 0; i < hdr->nshards; i++) {
+        shmshard_sub_t *sub = &hdr->subs[i];
+        pid_t owner;
+
+        if (!__atomic_load_n(&sub->claiming, __ATOMIC_SEQ_CST))
+            continue;
+        owner = __atomic_load_n(&sub->owner, __ATOMIC_ACQUIRE);
+        if (owner != 0 && !owner_dead(owner))
+            return 0;
+    }
+    return 1;
+}
+
+int
+shmshard_pop(shmshard_t *s, void *buf, uint32_t buf_cap, uint32_t *out_len, uint64_t *out_seq,
+             struct timespec *out_ts, int block)
+{
+    shmshard_hdr_t *hdr;
+    shmshard_sub_t *sub;
+    shmring_slot_t *slot;
+    uint32_t copy_len;
+    uint64_t key = 0;
+    int idx, rc, waited = 0;
+    struct timespec gap_poll = { 0, (long)SHMSHARD_GAP_POLL_MS * 1000000L };
+
+    if (s == NULL || s->hdr == NULL || (buf_cap != 0 && buf == NULL))
+        return SHMRING_ERR_INVAL;
+    hdr = s->hdr;
+    if (!s->consumer && (rc = shmshard_consumer(s, 0)) != SHMRING_OK)
+        return rc;
+
+    for (;;) {
+        /* Load closed before scanning: everything pushed before the
+         * shutdown is then visible to the scan. */
+        uint32_t closed = __atomic_load_n(&hdr->closed, __ATOMIC_ACQUIRE), gen;
+
+        idx = pick(hdr, &key);
+        /* Strict: the next seq may be claimed by a producer that has not
+         * published it yet; wait rather than skip it. After shutdown
+         * nobody will publish it any more, so take what is there. */
+        if (idx >= 0 && (!s->strict || key <= hdr->cons_seq || closed))
+            break;
+        /* Unless its producer died: the liveness scan costs a kill() per
+         * claiming producer, so blocking pops only run it once a bounded
+         * wait for the gap to fill has passed. After a clean scan, the
+         * seqs below the key of a new pick() were all taken before it, and
+         * any live producer's are published by now: what is still missing
+         * belongs to dead ones. */
+        if (idx >= 0 && (waited || !block) && gap_abandoned(hdr)) {
+            idx = pick(hdr, &key);
+            if (key > hdr->cons_seq)
+                hdr->gaps_skipped += key - hdr->cons_seq;
+            break;
+        }
+        if (idx < 0 && closed)
+            return SHMRING_ERR_CLOSED;
+        if (!block)
+            return SHMRING_ERR_EMPTY;
+
+        gen = __atomic_load_n(&hdr->data_gen, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&hdr->cons_waiting, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        idx = pick(hdr, &key);
+        if ((idx < 0 || (s->strict && key > hdr->cons_seq)) && !__atomic_load_n(&hdr->closed, __ATOMIC_SEQ_CST)) {
+            futex_wait(&hdr->data_gen, gen, idx >= 0 ? &gap_poll : NULL);
+            waited = idx >= 0;
+        }
+        __atomic_store_n(&hdr->cons_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    sub = &hdr->subs[idx];
+    slot = sub_slot(hdr, sub, sub->head);
+    copy_len = slot->len < buf_cap ? slot->len : buf_cap;
+    if (copy_len != 0)
+        memcpy(buf, slot->payload, copy_len);
+    if (out_len != NULL)
+        *out_len = slot->len;
+    if (out_seq != NULL)
+        *out_seq = slot->seq;
+    if (out_ts != NULL) {
+        out_ts->tv_sec = (time_t)(slot->stamp / 1000000000ull);
+        out_ts->tv_nsec = (long)(slot->stamp % 1000000000ull);
+    }
+    if (hdr->order == SHMSHARD_ORDER_SEQ && slot->seq >= hdr->cons_seq)
+        hdr->cons_seq = slot->seq + 1;
+    hdr->total_popped++;
+
+    __atomic_store_n(&sub->head, sub->head + 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sub->prod_waiting, __ATOMIC_RELAXED))
+        futex_bump(&sub->space_gen);
+    return SHMRING_OK;
+}
+
+void
+shmshard_shutdown(shmshard_t *s)
+{
+    shmshard_hdr_t *hdr;
+
+    if (s == NULL || s->hdr == NULL)
+        return;
+    hdr = s->hdr;
+    __atomic_store_n(&hdr->closed, 1, __ATOMIC_SEQ_CST);
+    futex_bump(&hdr->data_gen);
+    for (uint32_t i = 0; i < hdr->nshards; i++)
+        futex_bump(&hdr->subs[i].space_gen);
+}
@@ -0,0 +1,157 @@
+/*
+ * top_main.c
+ *
+ * Live monitor for a shm_ring: attaches read-only (the data path is never
+ * touched, not even the lock) and prints one line per interval with push
+ * and pop rates, occupancy, how long producers/consumers spent blocked,
+ * and pop latency percentiles from the header's histogram.
+ *
+ * Usage:
+ *   shm_ring_top <name> [interval_ms] [iterations]
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <shm_ring.h>
+
+#define TOP_HEADER_EVERY 20
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void
+on_signal(int signo)
+{
+    (void)signo;
+    g_stop = 1;
+}
+
+static uint64_t
+mono_ns(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* p-th percentile of hist[] in microseconds, from bucket floors. */
+static double
+percentile_us(const uint64_t *hist, uint64_t total, double p)
+{
+    uint64_t want, seen = 0;
+
+    if (total == 0)
+        return 0.0;
+    want = (uint64_t)((double)total * p / 100.0);
+    if (want == 0)
+        want = 1;
+    for (uint32_t b = 0; b < SHMRING_LAT_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen >= want)
+            return (double)shmring_lat_bucket_floor(b) / 1e3;
+    }
+    return 0.0;
+}
+
+static void
+print_header(void)
+{
+    printf("%8s %10s %10s %6s %6s %8s %9s %8s %9s %9s %9s %9s %9s\n", "time", "push/s", "pop/s", "count", "hwm",
+           "fullw/s", "pblk_ms/s", "emptyw/s", "cblk_ms/s", "p50_us", "p99_us", "p999_us", "max_us");
+}
+
+int
+main(int argc, char **argv)
+{
+    static const char *const ts_names[] = { "realtime", "none", "monotonic", "tsc" };
+    shmring_metrics_t prev, cur;
+    uint64_t prev_pushed = 0, prev_popped = 0, pushed, popped, prev_ns;
+    uint64_t delta[SHMRING_LAT_BUCKETS];
+    long interval_ms = 1000, iterations = 0;
+    struct sigaction sa;
+    shmring_t *ring = NULL;
+    int rc;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <name> [interval_ms] [iterations]\n", argv[0]);
+        fprintf(stderr, "  interval_ms  refresh period (default 1000)\n");
+        fprintf(stderr, "  iterations   lines to print before exiting (default 0 = until Ctrl-C)\n");
+        return 1;
+    }
+    if (argc >= 3)
+        interval_ms = strtol(argv[2], NULL, 10);
+    if (argc >= 4)
+        iterations = strtol(argv[3], NULL, 10);
+    if (interval_ms <= 0)
+        interval_ms = 1000;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    (void)sigaction(SIGINT, &sa, NULL);
+    (void)sigaction(SIGTERM, &sa, NULL);
+
+    rc = shmring_attach_readonly(argv[1], &ring);
+    if (rc != SHMRING_OK) {
+        fprintf(stderr, "shmring_attach_readonly(%s) failed: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    printf("[shm_ring_top] %s capacity=%u max_payload=%u ts=%s\n", argv[1], shmring_capacity(ring),
+           ring->hdr->max_payload, ring->hdr->ts_mode < 4 ? ts_names[ring->hdr->ts_mode] : "?");
+
+    shmring_metrics(ring, &prev);
+    shmring_stats(ring, &prev_pushed, &prev_popped);
+    prev_ns = mono_ns();
+
+    for (long line = 0; !g_stop && (iterations == 0 || line < iterations); line++) {
+        struct timespec req = { interval_ms / 1000, (interval_ms % 1000) * 1000000L };
+        uint64_t now, total = 0, max_b = 0;
+        double secs;
+        char when[16];
+        time_t t;
+
+        (void)nanosleep(&req, NULL);
+        if (g_stop)
+            break;
+        shmring_metrics(ring, &cur);
+        shmring_stats(ring, &pushed, &popped);
+        now = mono_ns();
+        secs = (double)(now - prev_ns) / 1e9;
+
+        for (uint32_t b = 0; b < SHMRING_LAT_BUCKETS; b++) {
+            delta[b] = cur.lat_hist[b] - prev.lat_hist[b];
+            total += delta[b];
+            if (delta[b] != 0)
+                max_b = b;
+        }
+
+        if (line % TOP_HEADER_EVERY == 0)
+            print_header();
+        t = time(NULL);
+        (void)strftime(when, sizeof(when), "%H:%M:%S", localtime(&t));
+        printf("%8s %10.0f %10.0f %6u %6u %8.0f %9.1f %8.0f %9.1f %9.1f %9.1f %9.1f %9.1f\n", when,
+               (double)(pushed - prev_pushed) / secs, (double)(popped - prev_popped) / secs, shmring_count(ring),
+               cur.count_hwm, (double)(cur.full_waits - prev.full_waits) / secs,
+               (double)(cur.full_wait_ns - prev.full_wait_ns) / 1e6 / secs,
+               (double)(cur.empty_waits - prev.empty_waits) / secs,
+               (double)(cur.empty_wait_ns - prev.empty_wait_ns) / 1e6 / secs, percentile_us(delta, total, 50),
+               percentile_us(delta, total, 99), percentile_us(delta, total, 99.9),
+               total ? (double)shmring_lat_bucket_floor((uint32_t)max_b) / 1e3 : 0.0);
+        fflush(stdout);
+
+        prev = cur;
+        prev_pushed = pushed;
+        prev_popped = popped;
+        prev_ns = now;
+    }
+
+    shmring_close(ring);
+    return 0;
+}
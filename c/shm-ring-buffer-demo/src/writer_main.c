@@ -32,8 +32,9 @@ static void
 usage(const char *prog)
 {
     fprintf(stderr, "Usage: %s <name> <capacity> <max_payload> <count> [interval_ms]\n", prog);
-    fprintf(stderr, "  name         POSIX shared memory object name, e.g. /demo_ring\n");
-    fprintf(stderr, "  capacity     number of slots in the ring\n");
+    fprintf(stderr, "  name         POSIX shared memory object name, e.g. /demo_ring,\n");
+    fprintf(stderr, "               or file:<path> for a persistent file-backed ring\n");
+    fprintf(stderr, "  capacity     number of slots in the ring (rounded up to a power of two)\n");
     fprintf(stderr, "  max_payload  max bytes per message\n");
     fprintf(stderr, "  count        number of messages to push (0 = run until Ctrl-C)\n");
     fprintf(stderr, "  interval_ms  delay between pushes in milliseconds (default 200)\n");
@@ -71,7 +72,8 @@ main(int argc, char **argv)
         fprintf(stderr, "shmring_create(%s) failed: rc=%d errno=%s\n", name, rc, strerror(errno));
         return 1;
     }
-    printf("[writer pid=%d] ring '%s' ready (capacity=%u, max_payload=%u)\n", (int)getpid(), name, capacity, max_payload);
+    printf("[writer pid=%d] ring '%s' ready (capacity=%u, max_payload=%u)\n", (int)getpid(), name, shmring_capacity(ring),
+           max_payload);
 
     /*
      * NOTE: if the ring is full, shmring_push(block=1) blocks inside
@@ -116,6 +118,9 @@ main(int argc, char **argv)
         printf("[writer] stopping. total_pushed=%" PRIu64 " total_popped(all readers)=%" PRIu64 "\n", total_pushed, total_popped);
     }
 
+    /* Make everything pushed so far durable (no-op on shm rings). */
+    (void)shmring_sync(ring);
+
     /* Wake any readers currently blocked in shmring_pop() so they don't
      * hang forever once we go away. Does not remove the shm object --
      * other readers/writers may still want to attach to it. */
@@ -0,0 +1,418 @@
+/*
+ * ring_test.c
+ *
+ * Regression tests for the ring library: `make test` builds and runs this.
+ * Each test uses its own ring name and cleans up after itself; a failed
+ * CHECK prints the location and makes the run exit non-zero.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm_ring.h"
+#include "shm_shard.h"
+
+static int failures;
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+/* Overwrite a uint32_t header field of a ring file in place. */
+static void
+poke_file_u32(const char *path, size_t off, uint32_t val)
+{
+    int fd = open(path, O_RDWR);
+
+    CHECK(fd >= 0);
+    CHECK(pwrite(fd, &val, sizeof(val), (off_t)off) == (ssize_t)sizeof(val));
+    (void)close(fd);
+}
+
+/*
+ * Persistent ring files outlive the binary that wrote them: a header from
+ * another layout (old magic or different layout_version) must be refused
+ * with EPROTO, a geometry this layout cannot produce with EINVAL, and in
+ * neither case may the file be truncated and re-created.
+ */
+static void
+test_layout_version(void)
+{
+    const char *path = "/tmp/ring_test_layout.ring";
+    char name[SHMRING_NAME_MAX];
+    shmring_t *ring;
+    uint32_t msg = 42, got = 0, len = 0;
+    uint64_t seq;
+
+    snprintf(name, sizeof(name), "%s%s", SHMRING_FILE_PREFIX, path);
+    (void)unlink(path);
+    CHECK(shmring_create(name, 8, sizeof(msg), &ring) == SHMRING_OK);
+    CHECK(shmring_push(ring, &msg, sizeof(msg), &seq, 0) == SHMRING_OK);
+    shmring_close(ring);
+
+    poke_file_u32(path, offsetof(shmring_hdr_t, layout_version), SHMRING_LAYOUT_VERSION + 1);
+    errno = 0;
+    CHECK(shmring_attach(name, &ring) == SHMRING_ERR_SYS && errno == EPROTO);
+    errno = 0;
+    CHECK(shmring_attach_readonly(name, &ring) == SHMRING_ERR_SYS && errno == EPROTO);
+    errno = 0;
+    CHECK(shmring_create(name, 8, sizeof(msg), &ring) == SHMRING_ERR_SYS && errno == EPROTO);
+
+    poke_file_u32(path, offsetof(shmring_hdr_t, layout_version), SHMRING_LAYOUT_VERSION);
+    poke_file_u32(path, offsetof(shmring_hdr_t, magic), SHMRING_MAGIC_V0);
+    errno = 0;
+    CHECK(shmring_create(name, 8, sizeof(msg), &ring) == SHMRING_ERR_SYS && errno == EPROTO);
+    errno = 0;
+    CHECK(shmring_attach_readonly(name, &ring) == SHMRING_ERR_SYS && errno == EPROTO);
+
+    poke_file_u32(path, offsetof(shmring_hdr_t, magic), SHMRING_MAGIC);
+    poke_file_u32(path, offsetof(shmring_hdr_t, capacity), 6);
+    errno = 0;
+    CHECK(shmring_attach(name, &ring) == SHMRING_ERR_SYS && errno == EINVAL);
+    errno = 0;
+    CHECK(shmring_attach_readonly(name, &ring) == SHMRING_ERR_SYS && errno == EINVAL);
+
+    /* Restored, the file still holds the message pushed before. */
+    poke_file_u32(path, offsetof(shmring_hdr_t, capacity), 8);
+    CHECK(shmring_attach(name, &ring) == SHMRING_OK);
+    CHECK(shmring_pop(ring, &got, sizeof(got), &len, &seq, NULL, 0) == SHMRING_OK && got == msg);
+    shmring_close(ring);
+    (void)shmring_destroy(name);
+}
+
+/* The same check on the POSIX shm path, which has no file_open(). */
+static void
+test_layout_version_shm(void)
+{
+    const char *name = "/ring_test_layout";
+    shmring_t *ring, *other;
+    uint32_t version;
+
+    (void)shmring_destroy(name);
+    CHECK(shmring_create(name, 4, 16, &ring) == SHMRING_OK);
+    version = ring->hdr->layout_version;
+    ring->hdr->layout_version = SHMRING_LAYOUT_VERSION + 1;
+    errno = 0;
+    CHECK(shmring_attach(name, &other) == SHMRING_ERR_SYS && errno == EPROTO);
+    ring->hdr->layout_version = version;
+    CHECK(shmring_attach(name, &other) == SHMRING_OK);
+    shmring_close(other);
+    shmring_close(ring);
+    (void)shmring_destroy(name);
+}
+
+/*
+ * shmring_write_end()/shmring_read_end() with n past the window opened by
+ * begin must commit nothing and still drop the lock; an end call with no
+ * window open must not touch the lock at all.
+ */
+static void
+test_window_bounds(void)
+{
+    const char *name = "/ring_test_window";
+    shmring_t *ring;
+    uint64_t pos, seq;
+    uint32_t n, len, v = 7;
+
+    (void)shmring_destroy(name);
+    CHECK(shmring_create(name, 4, sizeof(v), &ring) == SHMRING_OK);
+
+    CHECK(shmring_write_end(ring, 0) == SHMRING_ERR_INVAL);
+    CHECK(shmring_read_end(ring, 0) == SHMRING_ERR_INVAL);
+
+    CHECK(shmring_write_begin(ring, 2, &pos, &n, 0) == SHMRING_OK && n == 2);
+    CHECK(shmring_write_end(ring, 3) == SHMRING_ERR_INVAL);
+    CHECK(shmring_count(ring) == 0);
+
+    /* The lock was dropped: the ring is usable from here on. */
+    CHECK(shmring_push(ring, &v, sizeof(v), &seq, 0) == SHMRING_OK);
+    CHECK(shmring_read_begin(ring, 4, &pos, &n, 0) == SHMRING_OK && n == 1);
+    CHECK(shmring_read_end(ring, 2) == SHMRING_ERR_INVAL);
+    CHECK(shmring_count(ring) == 1);
+    CHECK(shmring_read_end(ring, 1) == SHMRING_ERR_INVAL); /* already closed */
+
+    CHECK(shmring_read_begin(ring, 4, &pos, &n, 0) == SHMRING_OK && n == 1);
+    CHECK(shmring_read_end(ring, 1) == SHMRING_OK);
+    CHECK(shmring_pop(ring, &v, sizeof(v), &len, &seq, NULL, 0) == SHMRING_ERR_EMPTY);
+
+    shmring_close(ring);
+    (void)shmring_destroy(name);
+}
+
+/* Pop one uint32_t message; its payload must equal its seq. */
+static int
+pop_seq(shmring_t *ring, uint64_t *seq)
+{
+    uint32_t got = 0, len = 0;
+    int rc = shmring_pop(ring, &got, sizeof(got), &len, seq, NULL, 0);
+
+    if (rc == SHMRING_OK)
+        CHECK(len == sizeof(got) && got == (uint32_t)*seq);
+    return rc;
+}
+
+/*
+ * File rings: a restarted consumer gets exactly the popped-but-uncommitted
+ * messages back from shmring_recover(), recovery truncates the ring at a
+ * slot whose checksum no longer matches, and a new boot id makes the next
+ * open recover on its own.
+ */
+static void
+test_file_recover(void)
+{
+    const char *path = "/tmp/ring_test_recover.ring";
+    const uint32_t cap = 8;
+    size_t stride = (sizeof(shmring_slot_t) + sizeof(uint32_t) + 7) & ~(size_t)7;
+    char name[SHMRING_NAME_MAX];
+    shmring_t *ring;
+    uint64_t seq, resume = 0;
+    uint32_t i;
+
+    snprintf(name, sizeof(name), "%s%s", SHMRING_FILE_PREFIX, path);
+    (void)unlink(path);
+    CHECK(shmring_create(name, cap, sizeof(uint32_t), &ring) == SHMRING_OK);
+    for (i = 0; i < 6; i++) {
+        CHECK(shmring_push(ring, &i, sizeof(i), &seq, 0) == SHMRING_OK);
+        CHECK(seq == i); /* fresh ring: seq == slot position */
+    }
+    for (i = 0; i < 4; i++)
+        CHECK(pop_seq(ring, &seq) == SHMRING_OK && seq == i);
+    CHECK(shmring_commit(ring, 1) == SHMRING_OK);
+    shmring_close(ring);
+
+    /* Restart: 2 and 3 were popped but never committed. */
+    CHECK(shmring_attach(name, &ring) == SHMRING_OK);
+    CHECK(shmring_recover(ring, &resume) == SHMRING_OK && resume == 2);
+    for (i = 2; i < 6; i++)
+        CHECK(pop_seq(ring, &seq) == SHMRING_OK && seq == i);
+    CHECK(pop_seq(ring, &seq) == SHMRING_ERR_EMPTY);
+    shmring_close(ring);
+
+    /* Tear seq 4's payload: recovery keeps 2 and 3 and drops 4 and 5. */
+    poke_file_u32(path, sizeof(shmring_hdr_t) + (4 & (cap - 1)) * stride + offsetof(shmring_slot_t, payload),
+                  0xdeadbeefu);
+    CHECK(shmring_attach(name, &ring) == SHMRING_OK);
+    CHECK(shmring_recover(ring, &resume) == SHMRING_OK && resume == 2);
+    for (i = 2; i < 4; i++)
+        CHECK(pop_seq(ring, &seq) == SHMRING_OK && seq == i);
+    CHECK(pop_seq(ring, &seq) == SHMRING_ERR_EMPTY);
+    i = 4;
+    CHECK(shmring_push(ring, &i, sizeof(i), &seq, 0) == SHMRING_OK && seq == 4);
+    CHECK(pop_seq(ring, &seq) == SHMRING_OK && seq == 4);
+    shmring_close(ring);
+
+    /* A different boot id: the first open recovers 2..4 by itself. */
+    if (access("/proc/sys/kernel/random/boot_id", R_OK) == 0) {
+        poke_file_u32(path, offsetof(shmring_hdr_t, boot_id), 0x58585858u);
+        CHECK(shmring_attach(name, &ring) == SHMRING_OK);
+        for (i = 2; i < 5; i++)
+            CHECK(pop_seq(ring, &seq) == SHMRING_OK && seq == i);
+        CHECK(pop_seq(ring, &seq) == SHMRING_ERR_EMPTY);
+        shmring_close(ring);
+    }
+
+    (void)shmring_destroy(name);
+}
+
+/*
+ * The first half of shmshard_push() in ORDER_SEQ mode: announce the claim
+ * and take a seq, without publishing anything.
+ */
+static uint64_t
+shard_claim_only(shmshard_t *p)
+{
+    shmshard_sub_t *sub = &p->hdr->subs[p->sub];
+
+    __atomic_store_n(&sub->claiming, 1, __ATOMIC_SEQ_CST);
+    return __atomic_fetch_add(&p->hdr->next_seq, 1, __ATOMIC_SEQ_CST);
+}
+
+static double
+mono_ms(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/*
+ * A producer killed between taking a seq and publishing it must not stall
+ * a strict consumer forever: once no live producer is mid-claim, the gap
+ * is skipped and counted. While one is, the consumer keeps waiting.
+ */
+static void
+test_shard_dead_claimer(void)
+{
+    const char *name = "/ring_test_shard";
+    shmshard_t *cons, *prod;
+    uint64_t seq = 0, v = 0;
+    uint32_t len;
+    pid_t pid, claimer;
+    int status, ready[2];
+    double t0;
+    char c;
+
+    (void)shmshard_destroy(name);
+    CHECK(shmshard_create(name, 3, 8, sizeof(v), SHMSHARD_ORDER_SEQ, &cons) == SHMRING_OK);
+    CHECK(shmshard_consumer(cons, /*strict=*/1) == SHMRING_OK);
+
+    /* seq 0: taken by a producer that is killed before publishing it. */
+    pid = fork();
+    if (pid == 0) {
+        shmshard_t *dead;
+
+        if (shmshard_attach(name, &dead) != SHMRING_OK || shmshard_producer(dead) != SHMRING_OK)
+            _exit(1);
+        (void)shard_claim_only(dead);
+        (void)raise(SIGKILL);
+        _exit(1);
+    }
+    CHECK(waitpid(pid, &status, 0) == pid && WIFSIGNALED(status));
+
+    /* seq 1: taken by a live producer that has not published yet. */
+    CHECK(pipe(ready) == 0);
+    claimer = fork();
+    if (claimer == 0) {
+        shmshard_t *live;
+        char c = 1;
+
+        if (shmshard_attach(name, &live) != SHMRING_OK || shmshard_producer(live) != SHMRING_OK ||
+            shard_claim_only(live) != 1 || write(ready[1], &c, 1) != 1)
+            _exit(1);
+        for (;;)
+            (void)pause();
+    }
+    CHECK(read(ready[0], &c, 1) == 1);
+    (void)close(ready[0]);
+    (void)close(ready[1]);
+
+    /* seq 2: published by a producer that then exits normally. */
+    pid = fork();
+    if (pid == 0) {
+        shmshard_t *p;
+
+        v = 2;
+        if (shmshard_attach(name, &p) != SHMRING_OK || shmshard_push(p, &v, sizeof(v), &seq, 1) != SHMRING_OK)
+            _exit(1);
+        shmshard_close(p);
+        _exit(seq == 2 ? 0 : 1);
+    }
+    CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    /* The live claimer may still publish seq 1: keep waiting. */
+    CHECK(shmshard_pop(cons, &v, sizeof(v), &len, &seq, NULL, 0) == SHMRING_ERR_EMPTY);
+    CHECK(cons->hdr->gaps_skipped == 0);
+
+    /* Once it dies too, both missing seqs are given up on. */
+    CHECK(kill(claimer, SIGKILL) == 0 && waitpid(claimer, &status, 0) == claimer);
+    t0 = mono_ms();
+    CHECK(shmshard_pop(cons, &v, sizeof(v), &len, &seq, NULL, 1) == SHMRING_OK && seq == 2 && v == 2);
+    CHECK(mono_ms() - t0 < 20 * SHMSHARD_GAP_POLL_MS);
+    CHECK(cons->hdr->gaps_skipped == 2);
+
+    /* Back in order afterwards. */
+    CHECK(shmshard_attach(name, &prod) == SHMRING_OK && shmshard_producer(prod) == SHMRING_OK);
+    v = 3;
+    CHECK(shmshard_push(prod, &v, sizeof(v), &seq, 1) == SHMRING_OK && seq == 3);
+    CHECK(shmshard_pop(cons, &v, sizeof(v), &len, &seq, NULL, 0) == SHMRING_OK && seq == 3);
+    CHECK(cons->hdr->gaps_skipped == 2);
+
+    shmshard_close(prod);
+    shmshard_close(cons);
+    (void)shmshard_destroy(name);
+}
+
+#define SHARD_RACE_PRODUCERS 4
+#define SHARD_RACE_MSGS      100000
+
+static void *
+shard_race_producer(void *arg)
+{
+    shmshard_t *p;
+    uint64_t v = 0;
+
+    if (shmshard_attach((const char *)arg, &p) != SHMRING_OK || shmshard_producer(p) != SHMRING_OK)
+        return (void *)1;
+    for (int i = 0; i < SHARD_RACE_MSGS; i++) {
+        if (shmshard_push(p, &v, sizeof(v), NULL, 1) != SHMRING_OK) {
+            shmshard_close(p);
+            return (void *)1;
+        }
+    }
+    shmshard_close(p);
+    return NULL;
+}
+
+/*
+ * Live producers publish while a strict consumer polls without blocking,
+ * so the consumer keeps seeing a seq taken but not yet published, and
+ * producers keep publishing it between the consumer's pick and its
+ * liveness scan. Nothing may be skipped: seqs must come out 0, 1, 2, ...
+ */
+static void
+test_shard_strict_race(void)
+{
+    const char *name = "/ring_test_shard_race";
+    pthread_t th[SHARD_RACE_PRODUCERS];
+    shmshard_t *cons;
+    uint64_t seq, v, next = 0, bad = 0;
+    uint32_t len;
+    int rc;
+
+    (void)shmshard_destroy(name);
+    CHECK(shmshard_create(name, SHARD_RACE_PRODUCERS, 16, sizeof(v), SHMSHARD_ORDER_SEQ, &cons) == SHMRING_OK);
+    CHECK(shmshard_consumer(cons, /*strict=*/1) == SHMRING_OK);
+    for (int i = 0; i < SHARD_RACE_PRODUCERS; i++)
+        CHECK(pthread_create(&th[i], NULL, shard_race_producer, (void *)name) == 0);
+
+    while (next < (uint64_t)SHARD_RACE_PRODUCERS * SHARD_RACE_MSGS) {
+        rc = shmshard_pop(cons, &v, sizeof(v), &len, &seq, NULL, 0);
+        if (rc == SHMRING_ERR_EMPTY)
+            continue;
+        if (rc != SHMRING_OK || seq != next)
+            bad++;
+        next = seq + 1;
+    }
+    for (int i = 0; i < SHARD_RACE_PRODUCERS; i++) {
+        void *ret;
+
+        CHECK(pthread_join(th[i], &ret) == 0 && ret == NULL);
+    }
+    CHECK(bad == 0);
+    CHECK(cons->hdr->gaps_skipped == 0);
+    shmshard_close(cons);
+    (void)shmshard_destroy(name);
+}
+
+int
+main(void)
+{
+    test_layout_version();
+    test_layout_version_shm();
+    test_window_bounds();
+    test_file_recover();
+    test_shard_dead_claimer();
+    test_shard_strict_race();
+
+    if (failures) {
+        fprintf(stderr, "ring_test: %d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("ring_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * typed_test.cpp
+ *
+ * Regression tests for the C++ wrapper in shm_ring.hpp; run by `make test`
+ * after ring_test.
+ */
+
+#include <cstdio>
+
+#include <shm_ring.hpp>
+
+static int failures;
+
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                               \
+        }                                                                             \
+    } while (0)
+
+using int_ring = shm_ring<uint64_t, 4>;
+
+/* emplace_back() past the window returns nullptr instead of writing into
+ * a slot the window does not own; release(k) past size() frees nothing. */
+static void
+test_batch_bounds()
+{
+    const char *name = "/typed_test_bounds";
+    int_ring ring;
+    uint64_t v = 0;
+
+    (void)shmring_destroy(name);
+    CHECK(ring.create(name) == SHMRING_OK);
+    CHECK(ring.push(1) == SHMRING_OK);
+    CHECK(ring.push(2) == SHMRING_OK);
+    {
+        int_ring::write_batch w = ring.write(8);
+
+        CHECK(w && w.size() == 2);
+        CHECK(w.emplace_back(3) != nullptr);
+        CHECK(w.emplace_back(4) != nullptr);
+        CHECK(w.emplace_back(5) == nullptr);
+        CHECK(w.filled() == 2);
+        CHECK(w.publish() == SHMRING_OK);
+        CHECK(w.emplace_back(6) == nullptr); /* published: window closed */
+    }
+    CHECK(shmring_count(ring.handle()) == 4);
+    {
+        int_ring::read_batch r = ring.read(2);
+
+        CHECK(r && r.size() == 2);
+        CHECK(r.release(3) == SHMRING_ERR_INVAL);
+    }
+    CHECK(shmring_count(ring.handle()) == 4);
+    {
+        int_ring::read_batch r = ring.read(2);
+
+        CHECK(r && r.size() == 2 && r[0] == 1 && r[1] == 2);
+        CHECK(r.release(1) == SHMRING_OK);
+    }
+    CHECK(ring.pop(v, 0) == SHMRING_OK && v == 2);
+    ring.close();
+    (void)shmring_destroy(name);
+}
+
+int
+main()
+{
+    test_batch_bounds();
+
+    if (failures) {
+        std::fprintf(stderr, "typed_test: %d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("typed_test: ok\n");
+    return 0;
+}
@@ -7,6 +7,7 @@
  * Note: Uses 'tmr_' prefix to avoid conflicts with POSIX timer_t/timer_create.
  */
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -83,11 +84,17 @@ wheel_remove(tmr_ctx_t *ctx, tmr_t *t)
         if (cur == t) {
             /* Found it - unlink by updating previous node's next pointer */
             *prev_next = cur->next;
+            ctx->count--;
             break;
         }
         prev_next = &cur->next;
     }
 
+    /*
+     * ctx->next_when is left alone: it is only a lower bound, and a stale
+     * value merely causes one early wakeup before tmr_exec() recomputes it.
+     */
+
     /* Mark as not running */
     t->wheel_pos = -1;
 
@@ -153,6 +160,49 @@ wheel_insert(tmr_ctx_t *ctx, tmr_t *t)
 
     /* Remember which slot we're in */
     t->wheel_pos = slot;
+
+    ctx->count++;
+    if (t->when < ctx->next_when)
+        ctx->next_when = t->when;
+}
+
+/*
+ * Find the earliest expiry time in the wheel (internal function)
+ *
+ * Each slot is sorted, so only the head of each slot matters. A timer in
+ * the slot k ticks ahead of the current position never expires before
+ * wheel_time + k ticks, so the walk stops as soon as the slot time passes
+ * the best candidate found so far; in the common case that is after a
+ * handful of slots rather than the whole wheel.
+ *
+ * @param ctx   Timer context
+ * @return      Earliest expiry time, or INT64_MAX if the wheel is empty
+ */
+static int64_t
+wheel_next_expiry(tmr_ctx_t *ctx)
+{
+    int64_t best, slot_time;
+    int i, pos;
+    tmr_t *t;
+
+    best = INT64_MAX;
+    if (ctx->count == 0)
+        return best;
+
+    pos = ctx->current_pos;
+    slot_time = ctx->wheel_time;
+    for (i = 0; i < (int)NELEMS(ctx->wheel) && slot_time <= best; i++) {
+        t = ctx->wheel[pos];
+        if (t != NULL && t->when < best)
+            best = t->when;
+
+        slot_time += TMR_WHEEL_TICK_US;
+        pos++;
+        if (pos >= (int)NELEMS(ctx->wheel))
+            pos = 0;
+    }
+
+    return best;
 }
 
 /*
@@ -167,6 +217,8 @@ tmr_ctx_init(tmr_ctx_t *ctx)
     memset(ctx->wheel, 0, sizeof(ctx->wheel));
     ctx->current_pos = 0;
     ctx->wheel_time = tmr_now();
+    ctx->next_when = INT64_MAX;
+    ctx->count = 0;
 
     return TMR_OK;
 }
@@ -184,14 +236,17 @@ tmr_ctx_shutdown(tmr_ctx_t *ctx)
         return TMR_ERR_INVALID;
 
     /*
-     * Walk all wheel slots and free all timers
+     * Walk all wheel slots and free all timers (embedded timers are
+     * only unlinked, their memory belongs to the caller)
      */
     for (i = 0; i < (int)NELEMS(ctx->wheel); i++) {
         while ((t = ctx->wheel[i]) != NULL) {
             wheel_remove(ctx, t);
-            free(t);
+            if (t->allocated)
+                free(t);
         }
     }
+    ctx->next_when = INT64_MAX;
 
     return TMR_OK;
 }
@@ -239,7 +294,8 @@ tmr_delete(tmr_ctx_t *ctx, tmr_t *t)
         return TMR_OK;
 
     wheel_remove(ctx, t);
-    free(t);
+    if (t->allocated)
+        free(t);
 
     return TMR_OK;
 }
@@ -259,6 +315,24 @@ tmr_start(tmr_ctx_t *ctx, tmr_t *t, int64_t interval)
     return tmr_restart(ctx, t);
 }
 
+/*
+ * Initialize a timer embedded in a caller-owned structure
+ */
+void
+tmr_init(tmr_t *t, const char *name, tmr_callback_fn callback,
+         void *opaque, int id)
+{
+    t->callback = callback;
+    t->name = name;
+    t->interval = 0;
+    t->opaque = opaque;
+    t->id = id;
+    t->wheel_pos = -1;  /* Not running yet */
+    t->allocated = 0;
+    t->next = NULL;
+    t->when = 0;
+}
+
 /*
  * Create a new timer
  */
@@ -275,14 +349,9 @@ tmr_create(tmr_ctx_t *ctx, tmr_t **tp, const char *name,
     }
 
     /* Initialize timer fields */
-    t->callback = callback;
-    t->name = name;
+    tmr_init(t, name, callback, opaque, id);
     t->interval = interval;
-    t->opaque = opaque;
-    t->id = id;
-    t->wheel_pos = -1;  /* Not running yet */
-    t->next = NULL;
-    t->when = 0;
+    t->allocated = 1;
 
     *tp = t;
 
@@ -301,59 +370,101 @@ tmr_create(tmr_ctx_t *ctx, tmr_t **tp, const char *name,
  *
  * This is the main timer processing function. It should be called
  * periodically (e.g., from an event loop).
+ */
+int
+tmr_exec(tmr_ctx_t *ctx)
+{
+    tmr_exec_max(ctx, 0);
+
+    return TMR_OK;
+}
+
+/*
+ * Execute at most max expired timers
  *
  * Algorithm:
- * 1. Check all timers at the current wheel position
- * 2. Fire any that have expired
- * 3. Advance the wheel if enough time has passed
+ * 1. Fire the expired timers at the current wheel position
+ * 2. Advance the wheel one tick and repeat, until the wheel has caught
+ *    up with the current time (the caller may have slept for many ticks)
+ * 3. Stop early once max callbacks have fired; the wheel stays on the
+ *    current slot so the next call picks up where this one left off
  */
 int
-tmr_exec(tmr_ctx_t *ctx)
+tmr_exec_max(tmr_ctx_t *ctx, int max)
 {
     tmr_t *t;
-    int64_t now, next_tick;
+    int64_t now, next_tick, ticks;
+    int fired;
 
     now = tmr_now();
+    fired = 0;
 
     /*
-     * Process timers at current wheel position.
-     * Timers are sorted by expiry time within each slot.
+     * Nothing is running: jump straight to the current tick instead of
+     * walking every empty slot we slept through.
      */
-    for (;;) {
-        t = ctx->wheel[ctx->current_pos];
-        if (t == NULL)
-            break;
-
-        /* Stop if this timer hasn't expired yet */
-        if (tmr_cmp(t->when, now) > 0)
-            break;
+    if (ctx->count == 0) {
+        ticks = (now - ctx->wheel_time) / TMR_WHEEL_TICK_US;
+        if (ticks > 0) {
+            ctx->wheel_time += ticks * TMR_WHEEL_TICK_US;
+            ctx->current_pos = (int)((ctx->current_pos + ticks) % TMR_WHEEL_SIZE);
+        }
+        ctx->next_when = INT64_MAX;
+        return 0;
+    }
 
+    for (;;) {
         /*
-         * Timer has expired - remove from wheel and fire callback.
-         * Note: We remove before calling callback so the callback
-         * can safely restart the same timer if needed.
+         * Process timers at current wheel position.
+         * Timers are sorted by expiry time within each slot.
          */
-        ctx->wheel[ctx->current_pos] = t->next;
-        t->next = NULL;
-        t->wheel_pos = -1;
+        for (;;) {
+            t = ctx->wheel[ctx->current_pos];
+            if (t == NULL)
+                break;
+
+            /* Stop if this timer hasn't expired yet */
+            if (tmr_cmp(t->when, now) > 0)
+                break;
+
+            /* Out of budget: leave the rest for the next call */
+            if (max > 0 && fired >= max)
+                return fired;
+
+            /*
+             * Timer has expired - remove from wheel and fire callback.
+             * Note: We remove before calling callback so the callback
+             * can safely restart the same timer if needed.
+             */
+            ctx->wheel[ctx->current_pos] = t->next;
+            t->next = NULL;
+            t->wheel_pos = -1;
+            ctx->count--;
+
+            /* Fire the callback */
+            t->callback(t, t->opaque, t->id);
+            fired++;
+        }
 
-        /* Fire the callback */
-        t->callback(t, t->opaque, t->id);
-    }
+        /*
+         * Advance the wheel while we are past the next tick boundary,
+         * so that every slot we slept through gets processed.
+         */
+        next_tick = ctx->wheel_time + TMR_WHEEL_TICK_US;
+        if (tmr_cmp(now, next_tick) < 0)
+            break;
 
-    /*
-     * Advance the wheel if we've passed the next tick boundary.
-     * This rotates the wheel to process the next time slot.
-     */
-    next_tick = ctx->wheel_time + TMR_WHEEL_TICK_US;
-    if (tmr_cmp(now, next_tick) > 0) {
         ctx->wheel_time = next_tick;
         ctx->current_pos++;
         if (ctx->current_pos >= (int)NELEMS(ctx->wheel))
             ctx->current_pos = 0;  /* Wrap around */
     }
 
-    return TMR_OK;
+    /* The cached bound has passed: find the real next expiry */
+    if (tmr_cmp(ctx->next_when, now) <= 0)
+        ctx->next_when = wheel_next_expiry(ctx);
+
+    return fired;
 }
 
 /*
@@ -369,24 +480,19 @@ tmr_wheel_time(tmr_ctx_t *ctx)
  * Get timeout value for select() as a timeval
  *
  * Calculates time until the next timer expires, suitable for use
- * as a select() timeout.
+ * as a select() timeout. Returns NULL (block forever) when no timers
+ * are running.
  */
 struct timeval *
 tmr_select_timeout(tmr_ctx_t *ctx, struct timeval *tv)
 {
-    tmr_t *t;
-    int64_t remaining, next_when;
-
-    /* Default: wait until next wheel tick */
-    next_when = ctx->wheel_time + TMR_WHEEL_TICK_US;
+    int64_t remaining;
 
-    /* Check if there's a timer at current position that expires sooner */
-    t = ctx->wheel[ctx->current_pos];
-    if (t != NULL && tmr_cmp(t->when, next_when) < 0)
-        next_when = t->when;
+    if (ctx->count == 0)
+        return NULL;
 
     /* Calculate remaining time */
-    remaining = next_when - tmr_now();
+    remaining = ctx->next_when - tmr_now();
     if (remaining < 0) {
         /* Timer already expired - return minimal timeout */
         tv->tv_sec = 0;
@@ -402,29 +508,31 @@ tmr_select_timeout(tmr_ctx_t *ctx, struct timeval *tv)
 /*
  * Get timeout value for poll() in milliseconds
  *
- * Returns the time until the next timer expires.
- * Returns 0 if a timer has already expired.
+ * Returns the time until the next timer expires, or -1 if no timers
+ * are running. Returns 0 if a timer has already expired.
  */
 int
 tmr_poll_timeout(tmr_ctx_t *ctx)
 {
-    tmr_t *t;
-    int64_t remaining, next_when;
+    int64_t remaining;
 
-    /* Default: wait until next wheel tick */
-    next_when = ctx->wheel_time + TMR_WHEEL_TICK_US;
+    if (ctx->count == 0)
+        return -1;
 
-    /* Check if there's a timer at current position that expires sooner */
-    t = ctx->wheel[ctx->current_pos];
-    if (t != NULL && tmr_cmp(t->when, next_when) < 0)
-        next_when = t->when;
+    /* Calculate remaining time in microseconds */
+    remaining = ctx->next_when - tmr_now();
+    if (remaining <= 0)
+        return 0;
 
-    /* Calculate remaining time in milliseconds */
-    remaining = next_when - tmr_now();
-    if (remaining < 0)
-        remaining = 0;
+    /*
+     * Round up: a truncated timeout would wake up just before the
+     * timer is due and spin through a few zero-timeout polls.
+     */
+    remaining = (remaining + 999) / 1000;
+    if (remaining > INT_MAX)
+        remaining = INT_MAX;
 
-    return remaining / 1000;  /* Convert microseconds to milliseconds */
+    return (int)remaining;
 }
 
 /*
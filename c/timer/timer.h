@@ -73,6 +73,7 @@ struct tmr_node {
     void             *opaque;     /* User-provided opaque data */
     int               id;         /* User-provided timer ID */
     int               wheel_pos;  /* Current position in wheel (-1 = not running) */
+    int               allocated;  /* Created by tmr_create(), freed by tmr_delete() */
     tmr_t            *next;       /* Next timer in the same wheel slot */
 };
 
@@ -85,6 +86,8 @@ struct tmr_ctx {
     tmr_t    *wheel[TMR_WHEEL_SIZE];  /* The timer wheel (array of timer lists) */
     int       current_pos;             /* Current wheel position */
     int64_t   wheel_time;              /* Time corresponding to current position */
+    int64_t   next_when;               /* Lower bound on the earliest expiry (INT64_MAX = none) */
+    unsigned  count;                   /* Number of running timers */
 };
 
 /*
@@ -133,6 +136,22 @@ int tmr_ctx_shutdown(tmr_ctx_t *ctx);
 int tmr_create(tmr_ctx_t *ctx, tmr_t **tp, const char *name,
                int64_t interval, tmr_callback_fn callback, void *opaque, int id);
 
+/*
+ * Initialize a timer embedded in a caller-owned structure
+ *
+ * Same as tmr_create() with interval 0, but without the allocation:
+ * the timer lives as long as the structure that contains it, and
+ * neither tmr_delete() nor tmr_ctx_shutdown() will free it.
+ *
+ * @param t        Timer to initialize
+ * @param name     Human-readable name for debugging
+ * @param callback Function to call when timer expires
+ * @param opaque   User data passed to callback
+ * @param id       User-defined timer ID passed to callback
+ */
+void tmr_init(tmr_t *t, const char *name, tmr_callback_fn callback,
+              void *opaque, int id);
+
 /*
  * Delete a timer and free its memory
  *
@@ -174,18 +193,32 @@ int tmr_restart(tmr_ctx_t *ctx, tmr_t *t);
  * Execute expired timers
  *
  * This should be called periodically (e.g., in an event loop).
- * It checks for and fires any expired timers.
+ * It advances the wheel over every tick that has elapsed since the
+ * last call and fires any expired timers.
  *
  * @param ctx   Timer context
  * @return      TMR_OK on success
  */
 int tmr_exec(tmr_ctx_t *ctx);
 
+/*
+ * Execute at most max expired timers
+ *
+ * Like tmr_exec(), but stops after firing max callbacks so that a burst
+ * of expiries is spread over several event loop iterations. The rest stay
+ * due and tmr_poll_timeout() returns 0 until they have been run.
+ *
+ * @param ctx   Timer context
+ * @param max   Maximum number of callbacks to fire (0 = no limit)
+ * @return      Number of callbacks fired
+ */
+int tmr_exec_max(tmr_ctx_t *ctx, int max);
+
 /*
  * Get timeout value for poll() in milliseconds
  *
- * Returns the time until the next timer expires, suitable for
- * use as a poll() timeout.
+ * Returns the time until the next timer expires, rounded up to whole
+ * milliseconds, suitable for use as a poll() or epoll_wait() timeout.
  *
  * @param ctx   Timer context
  * @return      Timeout in milliseconds (0 = timer pending, -1 = no timers)
@@ -197,7 +230,7 @@ int tmr_poll_timeout(tmr_ctx_t *ctx);
  *
  * @param ctx   Timer context
  * @param tv    Output: timeval structure to fill
- * @return      Pointer to tv
+ * @return      Pointer to tv, or NULL if no timers are running
  */
 struct timeval *tmr_select_timeout(tmr_ctx_t *ctx, struct timeval *tv);
 